@@ -5,11 +5,11 @@ namespace app
 {
 	// Settings
 	bool showGrids = true, spaceEvenly = false;
-	int nodeSpacing = 40;
+	int nodeSpacing = 40, parallelGrain = 1 << 12;
 
 	// Displayed windows
 	bool displaySettings = true, displayNodeActions = true, 
-		displayNodeInfo = true, displayCanvasInfo = true;
+		displayNodeInfo = true, displayCanvasInfo = true, displayBenchmark = false;
 	bool displayInsertNode = false, displayInsertRandNodes = false;	// Popups
 	bool canInsertNode = true, canInsertRandNodes = true;	// Popup finishers
 
@@ -18,15 +18,45 @@ namespace app
 	trees::Trees selectedTree = trees::Trees::AVL;
 
 	// Trees
-	trees::AVLTree avl;
-	trees::RBTree rb;
-	trees::Treap treap;
-	trees::SplayTree splay;
+	trees::AVLTree<> avl;
+	trees::RBTree<> rb;
+	trees::Treap<> treap;
+	trees::SplayTree<> splay;
+	trees::WAVLTree<> wavl;
+	trees::ScapegoatTree<> scapegoat;
+	trees::BTree<> btree;
+	trees::ARTree<> art;
+	trees::PersistentAVLTree<> persistentAvl;
+	trees::PersistentRBTree<> persistentRb;
+	trees::PersistentTreap<> persistentTreap;
+	trees::ShardedTree<trees::AVLTree<>> sharded(4);
+
+	// Fork/join pool of the recursive tree algorithms
+	auxillary::Scheduler scheduler;
+
+	// Writer thread & published layouts. The trees and the layout scratch below belong to the writer
+	auxillary::EpochCell<TreeLayout> layouts;
+	auxillary::EpochCell<TreeLayout>::Reader shown = layouts.read();	// pinned by the render loop from one frame to the next
+	std::vector<Command> commands;
+	std::mutex commandsMutex;
+	std::condition_variable commandsReady;
+	std::thread writer;
+	bool writerStopping = false;
+	size_t shownShard = 0;
+
+	// Scaling benchmark of the thread-safe trees
+	int benchmarkReadPercent = 80, benchmarkKeys = 1 << 16;
+	std::vector<BenchmarkResult> benchmarkResults;	// guarded by benchmarkMutex
+	std::mutex benchmarkMutex;
+	std::atomic<bool> benchmarkRunning(false);
+	std::thread benchmarker;
 
 	// Canvas vars
 	scc::Canvas canvas(auxillary::vec2(-10., 2.), 20.);
 	std::vector<trees::CanvasNode> canvasNodes;
-	bool movingCanvas = false, buildNewTree = false;
+	std::vector<std::pair<float, float>> subtreeWidths;	// widths of the left and right subtrees, in preorder
+	std::vector<std::pair<auxillary::vec2, auxillary::vec2>> canvasEdges;	// links of multi-key nodes
+	bool movingCanvas = false;
 	sf::Vector2f savedCursor;
 	size_t hoveredNode = -1;
 
@@ -39,96 +69,251 @@ namespace app
 	sf::Font font;
 	sf::Image logo;
 
-	const trees::Node* getCurrentTreeRoot()
-	{
-		if (selectedTree == trees::Trees::AVL)
-			return avl.rootPtr();
-		else if (selectedTree == trees::Trees::RB)
-			return rb.rootPtr();
-		else if (selectedTree == trees::Trees::Treap)
-			return treap.rootPtr();
-		else if (selectedTree == trees::Trees::Splay)
-			return splay.rootPtr();
-		return nullptr;
-	}
-
-	void _calculateTree(const trees::Node* node, const auxillary::vec2& c, bool init)
-	{
-		static std::map<const trees::Node*, float> widths;
-		static std::function<float(const trees::Node*)> width = [&](const trees::Node* node)
-		{
-			if (node == nullptr)
-				return 0.f;
-			if (widths.find(node) != widths.end())
-				return widths[node];
-			if (node->l == nullptr && node->r == nullptr)
-				return widths[node] = node->diameter + node->spacing;
-			if (node->r == nullptr)
-				return widths[node] = width(node->l) + .5f * (node->diameter + node->spacing);
-			if (node->l == nullptr)
-				return widths[node] = width(node->r) + .5f * (node->diameter + node->spacing);
-			return widths[node] = width(node->l) + width(node->r);
-		};
-		if (init)
-			widths.clear(), width(node);
-		canvasNodes.push_back(
-			trees::CanvasNode(
-				node, auxillary::BoundingBox::CreateFromCenter(c, { node->diameter, node->diameter })
-			)
-		);
-		if (node->l != nullptr)
+	template<class NodeType>
+	float _calculateWidths(const NodeType* node, size_t i)
+	{
+		static const float& diameter = trees::CanvasNode::diameter, & spacing = trees::CanvasNode::spacing;
+		if (node == nullptr)
+			return 0.f;
+		// i is the preorder index of node, so the right subtree starts past the left one and both are measured
+		// in parallel
+		float l, r;
+		auxillary::parallelInvoke(auxillary::forkable(node->n),
+			[&]() { l = _calculateWidths(node->l, i + 1); },
+			[&]() { r = _calculateWidths(node->r, i + 1 + (node->l != nullptr ? node->l->n : 0)); });
+		subtreeWidths[i] = { l, r };
+		if (l == 0.f && r == 0.f)
+			return diameter + spacing;
+		if (r == 0.f)
+			return l + .5f * (diameter + spacing);
+		if (l == 0.f)
+			return r + .5f * (diameter + spacing);
+		return l + r;
+	}
+
+	template<class NodeType>
+	void _calculateTree(const NodeType* node, const auxillary::vec2& c, size_t i)
+	{
+		static const float& diameter = trees::CanvasNode::diameter, & spacing = trees::CanvasNode::spacing;
+		canvasNodes[i] = trees::CanvasNode(node, auxillary::BoundingBox::CreateFromCenter(c, { diameter, diameter }));
+		// Records are in preorder: the left child follows its parent, the right one the left subtree
+		size_t r = i + 1 + (node->l != nullptr ? node->l->n : 0);
+		auxillary::parallelInvoke(auxillary::forkable(node->n),
+			[&]() {
+				if (node->l == nullptr)
+					return;
+				float inner = subtreeWidths[i + 1].second;
+				_calculateTree<NodeType>(
+					node->l, c - auxillary::vec2(
+						inner == 0.f ? .5f * (diameter + spacing) : inner,
+						diameter + spacing
+					), i + 1
+				);
+			},
+			[&]() {
+				if (node->r == nullptr)
+					return;
+				float inner = subtreeWidths[r].first;
+				_calculateTree<NodeType>(
+					node->r, c - auxillary::vec2(
+						-(inner == 0.f ? .5f * (diameter + spacing) : inner),
+						diameter + spacing
+					), r
+				);
+			});
+	}
+
+	template<class TreeType>
+	void calculateTree(const TreeType& tree)
+	{
+		if (tree.rootPtr() != nullptr)
+		{
+			canvasNodes.resize(tree.rootPtr()->n);
+			subtreeWidths.clear();
+			subtreeWidths.resize(tree.rootPtr()->n);
+			_calculateWidths(tree.rootPtr(), 0);
+			_calculateTree(tree.rootPtr(), { 0., 0. }, 0);
+			std::vector<std::pair<float, float>>().swap(subtreeWidths);
+		}
+	}
+
+	// Multi-key nodes. subtreeWidths holds the widths of the node itself and of its children, in preorder
+	template<class Key, size_t KeyBytes>
+	float _calculateBTreeWidths(const trees::BTreeNode<Key, KeyBytes>* node)
+	{
+		static const float& diameter = trees::CanvasNode::diameter, & spacing = trees::CanvasNode::spacing;
+		size_t i = subtreeWidths.size();
+		subtreeWidths.emplace_back();
+		float own = node->count * diameter + spacing, children = 0.f;
+		if (node->h > 1)
+		{
+			auto inner = static_cast<const trees::BTreeInner<Key, KeyBytes>*>(node);
+			for (uint32_t j = 0; j <= node->count; ++j)
+				children += _calculateBTreeWidths(inner->children[j]);
+		}
+		subtreeWidths[i] = { own, children };
+		return std::max(own, children);
+	}
+
+	template<class Key, size_t KeyBytes>
+	void _calculateBTree(const trees::BTreeNode<Key, KeyBytes>* node, const auxillary::vec2& c, size_t& i)
+	{
+		static const float& diameter = trees::CanvasNode::diameter;
+		float left = c.x - node->count * diameter / 2.f, x = c.x - subtreeWidths[i++].second / 2.f;
+		for (uint32_t j = 0; j < node->count; ++j)
 		{
-			_calculateTree(
-				node->l, c - auxillary::vec2(
-					widths[node->l->r] == 0.f ? .5f * (node->diameter + node->spacing) : widths[node->l->r],
-					node->diameter + node->spacing
+			canvasNodes.push_back(
+				trees::CanvasNode(
+					node, j, auxillary::BoundingBox::CreateFromCenter(
+						{ left + (j + .5f) * diameter, c.y }, { diameter, diameter }
+					)
 				)
 			);
 		}
-		if (node->r != nullptr)
+		if (node->h == 1)
+			return;
+		// Children hang from the gaps between the keys, a level two diameters below
+		auto inner = static_cast<const trees::BTreeInner<Key, KeyBytes>*>(node);
+		for (uint32_t j = 0; j <= node->count; ++j)
 		{
-			_calculateTree(
-				node->r, c - auxillary::vec2(
-					-(widths[node->r->l] == 0.f ? .5f * (node->diameter + node->spacing) : widths[node->r->l]),
-					node->diameter + node->spacing
-				)
+			float width = std::max(subtreeWidths[i].first, subtreeWidths[i].second);
+			auxillary::vec2 child(x + width / 2.f, c.y - 2.f * diameter);
+			canvasEdges.emplace_back(
+				auxillary::vec2(left + j * diameter, c.y - diameter / 2.f), child + auxillary::vec2(0.f, diameter / 2.f)
 			);
+			_calculateBTree(inner->children[j], child, i);
+			x += width;
 		}
 	}
 
-	void calculateTree()
+	template<class Key, class Value, class Compare, size_t KeyBytes>
+	void calculateTree(const trees::BTree<Key, Value, Compare, KeyBytes>& tree)
+	{
+		if (tree.rootPtr() != nullptr)
+		{
+			canvasNodes.reserve(tree.size());
+			subtreeWidths.clear();
+			_calculateBTreeWidths(tree.rootPtr());
+			size_t i = 0;
+			_calculateBTree(tree.rootPtr(), { 0., 0. }, i);
+			std::vector<std::pair<float, float>>().swap(subtreeWidths);
+		}
+	}
+
+	// Radix nodes, the same way. Children hang from the cells of their key bytes, leaves are drawn as plain nodes
+	template<class Key, class Value>
+	float _calculateARTWidths(const trees::ARTNode* node)
+	{
+		static const float& diameter = trees::CanvasNode::diameter, & spacing = trees::CanvasNode::spacing;
+		size_t i = subtreeWidths.size();
+		subtreeWidths.emplace_back();
+		if (node->type == trees::ARTNode::Type::Leaf)
+			return subtreeWidths[i] = { diameter + spacing, 0.f }, diameter + spacing;
+		float own = node->count * diameter + spacing, children = 0.f;
+		trees::ARTree<Key, Value>::forEachChild(node, [&children](uint8_t, const trees::ARTNode* child) {
+			children += _calculateARTWidths<Key, Value>(child);
+		});
+		subtreeWidths[i] = { own, children };
+		return std::max(own, children);
+	}
+
+	template<class Key, class Value>
+	void _calculateART(const trees::ARTNode* node, const auxillary::vec2& c, size_t& i)
+	{
+		static const float& diameter = trees::CanvasNode::diameter;
+		auxillary::BoundingBox box = auxillary::BoundingBox::CreateFromCenter(c, { diameter, diameter });
+		if (node->type == trees::ARTNode::Type::Leaf)
+		{
+			canvasNodes.push_back(trees::CanvasNode(static_cast<const trees::ARTLeaf<Key, Value>*>(node), box));
+			++i;
+			return;
+		}
+		float left = c.x - node->count * diameter / 2.f, x = c.x - subtreeWidths[i++].second / 2.f;
+		uint32_t j = 0;
+		trees::ARTree<Key, Value>::forEachChild(node, [&](uint8_t byte, const trees::ARTNode* child) {
+			auxillary::vec2 cell(left + (j++ + .5f) * diameter, c.y);
+			canvasNodes.push_back(
+				trees::CanvasNode(node, byte, auxillary::BoundingBox::CreateFromCenter(cell, { diameter, diameter }))
+			);
+			float width = std::max(subtreeWidths[i].first, subtreeWidths[i].second);
+			auxillary::vec2 to(x + width / 2.f, c.y - 2.f * diameter);
+			canvasEdges.emplace_back(
+				cell - auxillary::vec2(0.f, diameter / 2.f), to + auxillary::vec2(0.f, diameter / 2.f)
+			);
+			_calculateART<Key, Value>(child, to, i);
+			x += width;
+		});
+	}
+
+	template<class Key, class Value>
+	void calculateTree(const trees::ARTree<Key, Value>& tree)
 	{
-		const trees::Node* tree = getCurrentTreeRoot();
-		if (tree != nullptr)
+		if (tree.rootPtr() != nullptr)
 		{
-			canvasNodes.clear(), canvasNodes.reserve(tree->n);
-			_calculateTree(tree, { 0., 0. }, true);
+			canvasNodes.reserve(2 * tree.size());
+			subtreeWidths.clear();
+			_calculateARTWidths<Key, Value>(tree.rootPtr());
+			size_t i = 0;
+			_calculateART<Key, Value>(tree.rootPtr(), { 0., 0. }, i);
+			std::vector<std::pair<float, float>>().swap(subtreeWidths);
 		}
 	}
 
-	void drawNode(sf::RenderWindow* window, const trees::Node* node, size_t i)
+	void calculateTree(trees::Trees tree)
+	{
+		canvasNodes.clear(), canvasEdges.clear();
+		if (tree == trees::Trees::AVL)
+			calculateTree(avl);
+		else if (tree == trees::Trees::RB)
+			calculateTree(rb);
+		else if (tree == trees::Trees::Treap)
+			calculateTree(treap);
+		else if (tree == trees::Trees::Splay)
+			calculateTree(splay);
+		else if (tree == trees::Trees::WAVL)
+			calculateTree(wavl);
+		else if (tree == trees::Trees::Scapegoat)
+			calculateTree(scapegoat);
+		else if (tree == trees::Trees::BTree)
+			calculateTree(btree);
+		else if (tree == trees::Trees::ART)
+			calculateTree(art);
+		else if (tree == trees::Trees::PersistentAVL)
+			calculateTree(persistentAvl);
+		else if (tree == trees::Trees::PersistentRB)
+			calculateTree(persistentRb);
+		else if (tree == trees::Trees::PersistentTreap)
+			calculateTree(persistentTreap);
+		else if (tree == trees::Trees::Sharded)
+			sharded.visit(shownShard, [](const trees::AVLTree<>& shard) { calculateTree(shard); });
+	}
+
+	void drawNode(sf::RenderWindow* window, size_t i)
 	{
-		const auxillary::BoundingBox& box = canvasNodes[i].box;
-		if (!canvas.view.overlaps(box))
+		const trees::CanvasNode& node = shown->nodes[i];
+		if (!canvas.view.overlaps(node.box))
 			return;
 		sf::FloatRect boundary;
-		node->draw(window, canvas, box.center, &boundary);
+		node.draw(window, canvas, &boundary);
 		sf::Vector2f cursor(sf::Mouse::getPosition(*window));
-		if (canvasNodes[i].contains(canvas.pixelPosToCanvas(cursor)))
+		if (node.contains(canvas.pixelPosToCanvas(cursor)))
 			hoveredNode = i;
 	}
 
-	void _drawTree(sf::RenderWindow* window, const trees::Node* tree, size_t& i)
+	void _drawTree(sf::RenderWindow* window, size_t& i)
 	{
-		const auxillary::BoundingBox& box = canvasNodes[i].box;
+		const std::vector<trees::CanvasNode>& canvasNodes = shown->nodes;
+		const trees::CanvasNode& node = canvasNodes[i];
+		const auxillary::BoundingBox& box = node.box;
+		const size_t ln = (node.hasL ? canvasNodes[i + 1].n : 0), rn = node.n - ln - 1;
 		if (box.top <= canvas.view.bottom)
 		{
-			i += (tree->l == nullptr ? 0 : tree->l->n) + (tree->r == nullptr ? 0 : tree->r->n) + 1;
+			i += node.n;
 		}
 		else if (box.right <= canvas.view.left)
 		{
-			i += (tree->l == nullptr ? 0 : tree->l->n) + 1;
-			if (tree->r != nullptr)
+			i += ln + 1;
+			if (node.hasR)
 			{
 				auxillary::BoundingBox lineBox = auxillary::BoundingBox::CreateFromPoints(
 					box.center, canvasNodes[i].box.center
@@ -137,18 +322,18 @@ namespace app
 				{
 					sf::RectangleShape line = canvas.getLine(
 						{ lineBox.left, lineBox.top }, { lineBox.right, lineBox.bottom },
-						trees::Node::outlineThickness
+						trees::CanvasNode::outlineThickness
 					);
 					line.setFillColor(sf::Color::Black);
 					window->draw(line);
 				}
-				_drawTree(window, tree->r, i);
+				_drawTree(window, i);
 			}
 		}
 		else if (box.left >= canvas.view.right)
 		{
 			i += 1;
-			if (tree->l != nullptr)
+			if (node.hasL)
 			{
 				auxillary::BoundingBox lineBox = auxillary::BoundingBox::CreateFromPoints(
 					box.center, canvasNodes[i].box.center
@@ -157,20 +342,20 @@ namespace app
 				{
 					sf::RectangleShape line = canvas.getLine(
 						{ lineBox.right, lineBox.top }, { lineBox.left, lineBox.bottom },
-						trees::Node::outlineThickness
+						trees::CanvasNode::outlineThickness
 					);
 					line.setFillColor(sf::Color::Black);
 					window->draw(line);
 				}
-				_drawTree(window, tree->l, i);
+				_drawTree(window, i);
 			}
-			i += (tree->r == nullptr ? 0 : tree->r->n);
+			i += rn;
 		}
 		else
 		{
 			size_t srcI = i;
 			i += 1;
-			if (tree->l != nullptr)
+			if (node.hasL)
 			{
 				auxillary::BoundingBox lineBox = auxillary::BoundingBox::CreateFromPoints(
 					box.center, canvasNodes[i].box.center
@@ -179,14 +364,14 @@ namespace app
 				{
 					sf::RectangleShape line = canvas.getLine(
 						{ lineBox.right, lineBox.top }, { lineBox.left, lineBox.bottom },
-						trees::Node::outlineThickness
+						trees::CanvasNode::outlineThickness
 					);
 					line.setFillColor(sf::Color::Black);
 					window->draw(line);
 				}
-				_drawTree(window, tree->l, i);
+				_drawTree(window, i);
 			}
-			if (tree->r != nullptr)
+			if (node.hasR)
 			{
 				auxillary::BoundingBox lineBox = auxillary::BoundingBox::CreateFromPoints(
 					box.center, canvasNodes[i].box.center
@@ -195,26 +380,44 @@ namespace app
 				{
 					sf::RectangleShape line = canvas.getLine(
 						{ lineBox.left, lineBox.top }, { lineBox.right, lineBox.bottom },
-						trees::Node::outlineThickness
+						trees::CanvasNode::outlineThickness
 					);
 					line.setFillColor(sf::Color::Black);
 					window->draw(line);
 				}
-				_drawTree(window, tree->r, i);
+				_drawTree(window, i);
 			}
-			drawNode(window, tree, srcI);
+			drawNode(window, srcI);
 		}
 	}
 
+	void _drawMultiKeyTree(sf::RenderWindow* window)
+	{
+		for (const auto& edge : shown->edges)
+		{
+			if (!canvas.view.overlaps(auxillary::BoundingBox::CreateFromPoints(edge.first, edge.second)))
+				continue;
+			sf::RectangleShape line = canvas.getLine(edge.first, edge.second, trees::CanvasNode::outlineThickness);
+			line.setFillColor(sf::Color::Black);
+			window->draw(line);
+		}
+		for (size_t i = 0; i < shown->nodes.size(); ++i)
+			drawNode(window, i);
+	}
+
 	void drawTree(sf::RenderWindow* window)
 	{
-		if (buildNewTree) calculateTree(), buildNewTree = false;
-		const trees::Node* tree = getCurrentTreeRoot();
+		// Moves on to the last published layout. The previous one stays pinned until here, since the events
+		// handled before drawing still refer to the node hovered in it
+		shown.refresh();
 		hoveredNode = -1;
-		if (tree != nullptr)
+		if (shown && !shown->nodes.empty())
 		{
 			size_t i = 0;
-			_drawTree(window, getCurrentTreeRoot(), i);
+			if (shown->tree == trees::Trees::BTree || shown->tree == trees::Trees::ART)
+				_drawMultiKeyTree(window);
+			else
+				_drawTree(window, i);
 		}
 	}
 
@@ -274,54 +477,358 @@ namespace app
 
 	void insertNode()
 	{
-		if (selectedTree == trees::Trees::AVL)
+		post({ Command::Type::Insert, selectedTree, inputNodeValue, inputNodePriorValue });
+		inputNodeValue = 0, inputNodePriorValue = -1;
+	}
+
+	void insertRandomNodes()
+	{
+		post({ Command::Type::InsertRandom, selectedTree, inputNodesCountValue });
+		inputNodesCountValue = 0;
+	}
+
+	void eraseNode()
+	{
+		const trees::CanvasNode& node = shown->nodes[hoveredNode];
+		if (shown->tree == trees::Trees::ART && node.style == trees::CanvasNode::Style::Cell)
+			return;	// cells of inner nodes hold key bytes, not keys
+		post({ Command::Type::Erase, shown->tree, (long long)node.elem, -1, node.node, shown->id });
+	}
+
+	void clearTree()
+	{
+		post({ Command::Type::Clear, selectedTree });
+	}
+
+	void post(const Command& command)
+	{
 		{
-			avl.insert(inputNodeValue);
+			std::lock_guard<std::mutex> lock(commandsMutex);
+			commands.push_back(command);
 		}
-		else if (selectedTree == trees::Trees::RB)
+		commandsReady.notify_one();
+	}
+
+	template<class TreeType>
+	void _eraseNode(TreeType& tree, const Command& command, bool current)
+	{
+		// The node is erased where it is, without searching for its key, if the tree did not change since the
+		// layout it was picked from. Otherwise the handle may dangle, so its key is looked up instead
+		if (current)
+			tree.erase(static_cast<const typename TreeType::NodeType*>(command.node));
+		else
+			tree.erase((size_t)command.value);
+	}
+
+	template<class TreeType>
+	void _applyHistory(TreeType& tree, const Command& command)
+	{
+		if (command.type == Command::Type::Undo && tree.version() > 0)
+			tree.undo();
+		else if (command.type == Command::Type::Redo && tree.version() + 1 < tree.versions())
+			tree.redo();
+		else if (command.type == Command::Type::Checkout && (size_t)command.value < tree.versions())
+			tree.checkout((size_t)command.value);
+	}
+
+	void applyCommand(const Command& command, bool current)
+	{
+		const trees::Trees selectedTree = command.tree;
+		const size_t value = (size_t)command.value;
+		if (command.type == Command::Type::Insert)
 		{
-			rb.insert(inputNodeValue);
+			if (selectedTree == trees::Trees::AVL)
+				avl.insert(value);
+			else if (selectedTree == trees::Trees::RB)
+				rb.insert(value);
+			else if (selectedTree == trees::Trees::Treap)
+			{
+				if (command.prior == -1)
+					treap.insert(value);
+				else
+					treap.insert(value, {}, (uint32_t)command.prior);
+			}
+			else if (selectedTree == trees::Trees::Splay)
+				splay.insert(value);
+			else if (selectedTree == trees::Trees::WAVL)
+				wavl.insert(value);
+			else if (selectedTree == trees::Trees::Scapegoat)
+				scapegoat.insert(value);
+			else if (selectedTree == trees::Trees::BTree)
+				btree.insert(value);
+			else if (selectedTree == trees::Trees::ART)
+				art.insert(value);
+			else if (selectedTree == trees::Trees::PersistentAVL)
+				persistentAvl.insert(value);
+			else if (selectedTree == trees::Trees::PersistentRB)
+				persistentRb.insert(value);
+			else if (selectedTree == trees::Trees::PersistentTreap)
+				persistentTreap.insert(value);
+			else if (selectedTree == trees::Trees::Sharded)
+				sharded.insert(value);
 		}
-		else if (selectedTree == trees::Trees::Treap)
+		else if (command.type == Command::Type::InsertRandom)
 		{
-			if (inputNodePriorValue == -1)
-				treap.insert(inputNodeValue);
-			else
-				treap.insert(inputNodeValue, inputNodePriorValue);
+			if (selectedTree == trees::Trees::AVL)
+				avl.insertRandom(value);
+			else if (selectedTree == trees::Trees::RB)
+				rb.insertRandom(value);
+			else if (selectedTree == trees::Trees::Treap)
+				treap.insertRandom(value);
+			else if (selectedTree == trees::Trees::Splay)
+				splay.insertRandom(value);
+			else if (selectedTree == trees::Trees::WAVL)
+				wavl.insertRandom(value);
+			else if (selectedTree == trees::Trees::Scapegoat)
+				scapegoat.insertRandom(value);
+			else if (selectedTree == trees::Trees::BTree)
+				btree.insertRandom(value);
+			else if (selectedTree == trees::Trees::ART)
+				art.insertRandom(value);
+			else if (selectedTree == trees::Trees::PersistentAVL)
+				persistentAvl.insertRandom(value);
+			else if (selectedTree == trees::Trees::PersistentRB)
+				persistentRb.insertRandom(value);
+			else if (selectedTree == trees::Trees::PersistentTreap)
+				persistentTreap.insertRandom(value);
+			else if (selectedTree == trees::Trees::Sharded)
+				sharded.insertRandom(value);
 		}
-		else if (selectedTree == trees::Trees::Splay)
+		else if (command.type == Command::Type::Erase)
 		{
-			splay.insert(inputNodeValue);
+			if (selectedTree == trees::Trees::AVL)
+				_eraseNode(avl, command, current);
+			else if (selectedTree == trees::Trees::RB)
+				_eraseNode(rb, command, current);
+			else if (selectedTree == trees::Trees::Treap)
+				_eraseNode(treap, command, current);
+			else if (selectedTree == trees::Trees::Splay)
+				_eraseNode(splay, command, current);
+			else if (selectedTree == trees::Trees::WAVL)
+				_eraseNode(wavl, command, current);
+			else if (selectedTree == trees::Trees::Scapegoat)
+				_eraseNode(scapegoat, command, current);
+			else if (selectedTree == trees::Trees::BTree)
+				btree.erase(value);
+			else if (selectedTree == trees::Trees::ART)
+				art.erase(value);
+			else if (selectedTree == trees::Trees::PersistentAVL)
+				persistentAvl.erase(value);
+			else if (selectedTree == trees::Trees::PersistentRB)
+				persistentRb.erase(value);
+			else if (selectedTree == trees::Trees::PersistentTreap)
+				persistentTreap.erase(value);
+			else if (selectedTree == trees::Trees::Sharded)
+				sharded.erase(value);
+		}
+		else if (command.type == Command::Type::Clear)
+		{
+			if (selectedTree == trees::Trees::AVL)
+				avl.clear();
+			else if (selectedTree == trees::Trees::RB)
+				rb.clear();
+			else if (selectedTree == trees::Trees::Treap)
+				treap.clear();
+			else if (selectedTree == trees::Trees::Splay)
+				splay.clear();
+			else if (selectedTree == trees::Trees::WAVL)
+				wavl.clear();
+			else if (selectedTree == trees::Trees::Scapegoat)
+				scapegoat.clear();
+			else if (selectedTree == trees::Trees::BTree)
+				btree.clear();
+			else if (selectedTree == trees::Trees::ART)
+				art.clear();
+			else if (selectedTree == trees::Trees::PersistentAVL)
+				persistentAvl.clear();
+			else if (selectedTree == trees::Trees::PersistentRB)
+				persistentRb.clear();
+			else if (selectedTree == trees::Trees::PersistentTreap)
+				persistentTreap.clear();
+			else if (selectedTree == trees::Trees::Sharded)
+				sharded.clear();
+		}
+		else if (command.type == Command::Type::Relayout)
+		{
+			trees::CanvasNode::spacing = (float)command.value / 100 * trees::CanvasNode::diameter;
+		}
+		else if (command.type == Command::Type::ShowShard)
+		{
+			shownShard = std::min(value, sharded.shardCount() - 1);
+		}
+		else if (selectedTree == trees::Trees::PersistentAVL)
+		{
+			_applyHistory(persistentAvl, command);
+		}
+		else if (selectedTree == trees::Trees::PersistentRB)
+		{
+			_applyHistory(persistentRb, command);
+		}
+		else if (selectedTree == trees::Trees::PersistentTreap)
+		{
+			_applyHistory(persistentTreap, command);
 		}
-		buildNewTree = true;
-		inputNodeValue = 0, inputNodePriorValue = -1;
 	}
 
-	void insertRandomNodes()
+	void publishLayout(trees::Trees tree, uint64_t id)
 	{
-		if (selectedTree == trees::Trees::AVL)
-			avl.insertRandom(inputNodesCountValue);
-		else if (selectedTree == trees::Trees::RB)
-			rb.insertRandom(inputNodesCountValue);
-		else if (selectedTree == trees::Trees::Treap)
-			treap.insertRandom(inputNodesCountValue);
-		else if (selectedTree == trees::Trees::Splay)
-			splay.insertRandom(inputNodesCountValue);
-		buildNewTree = true;
-		inputNodesCountValue = 0;
+		calculateTree(tree);
+		std::unique_ptr<TreeLayout> layout(new TreeLayout());
+		layout->nodes.swap(canvasNodes), layout->edges.swap(canvasEdges);
+		layout->tree = tree, layout->id = id;
+		if (tree == trees::Trees::PersistentAVL)
+			layout->version = persistentAvl.version(), layout->versions = persistentAvl.versions();
+		else if (tree == trees::Trees::PersistentRB)
+			layout->version = persistentRb.version(), layout->versions = persistentRb.versions();
+		else if (tree == trees::Trees::PersistentTreap)
+			layout->version = persistentTreap.version(), layout->versions = persistentTreap.versions();
+		else if (tree == trees::Trees::Sharded)
+			layout->shard = shownShard, layout->shards = sharded.shardCount();
+		auto measure = [&layout](const auto& tree) { layout->statistics = tree.statistics(), layout->measured = true; };
+		if (tree == trees::Trees::AVL)
+			measure(avl);
+		else if (tree == trees::Trees::RB)
+			measure(rb);
+		else if (tree == trees::Trees::Treap)
+			measure(treap);
+		else if (tree == trees::Trees::Splay)
+			measure(splay);
+		else if (tree == trees::Trees::WAVL)
+			measure(wavl);
+		else if (tree == trees::Trees::Scapegoat)
+			measure(scapegoat);
+		else if (tree == trees::Trees::Sharded)
+			layout->statistics = sharded.statistics(shownShard), layout->measured = true;
+		layouts.publish(std::move(layout));
 	}
 
-	void eraseNode()
+	void runWriter()
+	{
+		std::vector<Command> batch;
+		trees::Trees tree = trees::Trees::AVL;
+		uint64_t id = 0;
+		while (true)
+		{
+			{
+				std::unique_lock<std::mutex> lock(commandsMutex);
+				commandsReady.wait(lock, [] { return writerStopping || !commands.empty(); });
+				if (writerStopping)
+					return;
+				batch.swap(commands);
+			}
+			// Everything queued meanwhile is applied at once, and laid out once. Handles picked from the
+			// last published layout are valid up to the first applied command
+			for (size_t i = 0; i < batch.size(); ++i)
+				applyCommand(batch[i], i == 0 && batch[i].layout == id), tree = batch[i].tree;
+			batch.clear();
+			publishLayout(tree, ++id);
+		}
+	}
+
+	void startScheduler()
+	{
+		// Forking threads run their own jobs until they are stolen, so one worker less than there are cores
+		scheduler.setGrain((size_t)parallelGrain);
+		scheduler.start(std::max<size_t>(1, std::thread::hardware_concurrency()) - 1);
+	}
+
+	void stopScheduler()
+	{
+		scheduler.stop();
+	}
+
+	void startWriter()
+	{
+		writerStopping = false;
+		post({ Command::Type::Relayout, selectedTree, nodeSpacing });	// the first layout
+		writer = std::thread(runWriter);
+	}
+
+	void stopWriter()
+	{
+		{
+			std::lock_guard<std::mutex> lock(commandsMutex);
+			writerStopping = true;
+		}
+		commandsReady.notify_one();
+		writer.join();
+	}
+
+	template<class TreeType>
+	double _measureThroughput(size_t threads, int readPercent, size_t keys)
+	{
+		// Half of the keys are present and stay so on average, inserts and erases are equally likely
+		static const std::chrono::milliseconds duration(250);
+		TreeType tree;
+		std::mt19937_64 rng(1);
+		for (size_t i = 0; i < keys / 2; ++i)
+			tree.insert(rng() % keys);
+		std::atomic<bool> stop(false);
+		std::atomic<size_t> total(0);
+		std::vector<std::thread> workers;
+		for (size_t t = 0; t < threads; ++t)
+		{
+			workers.emplace_back([&, t] {
+				std::mt19937_64 rng(t + 2);
+				size_t done = 0;
+				for (; !stop.load(std::memory_order_relaxed); ++done)
+				{
+					size_t key = rng() % keys, op = rng() % 200;
+					if (op < 2 * (size_t)readPercent)
+						tree.contains(key);
+					else if (op % 2 == 0)
+						tree.insert(key);
+					else
+						tree.erase(key);
+				}
+				total += done;
+			});
+		}
+		auto start = std::chrono::steady_clock::now();
+		std::this_thread::sleep_for(duration);
+		stop = true;
+		for (std::thread& worker : workers)
+			worker.join();
+		double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		return total / seconds / 1e6;
+	}
+
+	void runBenchmark(int readPercent, size_t keys)
 	{
-		if (selectedTree == trees::Trees::AVL)
-			avl.erase(canvasNodes[hoveredNode].node->elem);
-		else if (selectedTree == trees::Trees::RB)
-			rb.erase(canvasNodes[hoveredNode].node->elem);
-		else if (selectedTree == trees::Trees::Treap)
-			treap.erase(canvasNodes[hoveredNode].node->elem);
-		else if (selectedTree == trees::Trees::Splay)
-			splay.erase(canvasNodes[hoveredNode].node->elem);
-		buildNewTree = true;
+		{
+			std::lock_guard<std::mutex> lock(benchmarkMutex);
+			benchmarkResults.clear();
+		}
+		size_t cores = std::max<size_t>(1, std::thread::hardware_concurrency());
+		for (size_t threads = 1; ; threads = std::min(2 * threads, cores))
+		{
+			BenchmarkResult result = {
+				threads,
+				_measureThroughput<trees::ConcurrentAVLTree<>>(threads, readPercent, keys),
+				_measureThroughput<trees::LockedTree<trees::AVLTree<>>>(threads, readPercent, keys),
+				_measureThroughput<trees::LockedTree<trees::RBTree<>>>(threads, readPercent, keys)
+			};
+			{
+				std::lock_guard<std::mutex> lock(benchmarkMutex);
+				benchmarkResults.push_back(result);
+			}
+			if (threads == cores)
+				break;
+		}
+		benchmarkRunning = false;
+	}
+
+	void startBenchmark()
+	{
+		stopBenchmark();
+		benchmarkRunning = true;
+		benchmarker = std::thread(runBenchmark, benchmarkReadPercent, (size_t)benchmarkKeys);
+	}
+
+	void stopBenchmark()
+	{
+		if (benchmarker.joinable())
+			benchmarker.join();
 	}
 
 	void handleWindowEvents(sf::Window* window)
@@ -350,6 +857,8 @@ namespace app
 				displayNodeInfo ^= 1;
 			else if (event.key.code == sf::Keyboard::F4)
 				displayCanvasInfo ^= 1;
+			else if (event.key.code == sf::Keyboard::F5)
+				displayBenchmark ^= 1;
 			else if (event.key.code == sf::Keyboard::Escape && displayInsertNode)
 				closeInsertNodePopup(true);
 			else if (event.key.code == sf::Keyboard::Escape && displayInsertRandNodes)
@@ -497,7 +1006,7 @@ namespace app
 					{
 						selectedTree = tree;
 						canvas.restoreDefaultView();
-						buildNewTree = true;
+						post({ Command::Type::Relayout, selectedTree, nodeSpacing });
 					}
 				}
 			}
@@ -508,10 +1017,11 @@ namespace app
 		ImGui::Dummy({ 0., 1. });
 		ImGui::Text("Node spacing:");
 		if (ImGui::SliderInt("##NodeSpacingSlider", &nodeSpacing, 10, 100, "%d%%"))
-		{
-			trees::Node::spacing = (float)nodeSpacing / 100 * trees::Node::diameter;
-			buildNewTree = true;
-		}
+			post({ Command::Type::Relayout, selectedTree, nodeSpacing });
+		ImGui::Dummy({ 0., 1. });
+		ImGui::Text("Parallel grain:");
+		if (ImGui::SliderInt("##ParallelGrainSlider", &parallelGrain, 64, 1 << 20, "%d nodes", ImGuiSliderFlags_Logarithmic))
+			scheduler.setGrain((size_t)parallelGrain);
 		ImGui::End();
 	}
 
@@ -524,25 +1034,52 @@ namespace app
 		}
 		else
 		{
-			ImGui::Text("Height: %llu", canvasNodes[hoveredNode].node->h);
-			ImGui::Text("Nodes count: %llu", canvasNodes[hoveredNode].node->n);
-			ImGui::Text("Node value: %llu", canvasNodes[hoveredNode].node->elem);
-			ImGui::BeginDisabled(selectedTree != trees::Trees::Treap);
-			ImGui::Text(
-				selectedTree != trees::Trees::Treap ? "Node priority: None" : "Node priority: %llu",
-				((trees::Treap::NodeType*)(canvasNodes[hoveredNode].node))->prior
-			);
+			const trees::CanvasNode& node = shown->nodes[hoveredNode];
+			ImGui::Text("Height: %llu", node.h);
+			ImGui::Text("Nodes count: %llu", node.n);
+			ImGui::Text("Node value: %llu", node.elem);
+			bool prioritized = (node.style == trees::CanvasNode::Style::Prioritized),
+				colored = (node.style == trees::CanvasNode::Style::Red || node.style == trees::CanvasNode::Style::Black);
+			ImGui::BeginDisabled(!prioritized);
+			ImGui::Text(!prioritized ? "Node priority: None" : "Node priority: %llu", node.prior);
 			ImGui::EndDisabled();
-			ImGui::BeginDisabled(selectedTree != trees::Trees::RB);
+			ImGui::BeginDisabled(!colored);
 			ImGui::Text(
-				selectedTree != trees::Trees::RB ? "Node color: None" : "Node color: %s",
-				((trees::RBTree::NodeType*)(canvasNodes[hoveredNode].node))->red ? "Red" : "Black"
+				!colored ? "Node color: None" : "Node color: %s",
+				node.style == trees::CanvasNode::Style::Red ? "Red" : "Black"
 			);
 			ImGui::EndDisabled();
 		}
 		ImGui::End();
 	}
 
+	void showHistoryControls()
+	{
+		// Every version is kept, stepping through them only switches the shown root
+		ImGui::Dummy({ 0., 3. });
+		ImGui::BeginDisabled(shown->version == 0);
+		if (ImGui::Button("Undo"))
+			post({ Command::Type::Undo, shown->tree });
+		ImGui::EndDisabled();
+		ImGui::SameLine();
+		ImGui::BeginDisabled(shown->version + 1 == shown->versions);
+		if (ImGui::Button("Redo"))
+			post({ Command::Type::Redo, shown->tree });
+		ImGui::EndDisabled();
+		int version = (int)shown->version;
+		if (ImGui::SliderInt("##VersionSlider", &version, 0, (int)shown->versions - 1, "Version %d"))
+			post({ Command::Type::Checkout, shown->tree, version });
+	}
+
+	void showShardControls()
+	{
+		// The updates are applied by the worker of their shard, the layout waits for those queued before it
+		ImGui::Dummy({ 0., 3. });
+		int shard = (int)shown->shard;
+		if (ImGui::SliderInt("##ShardSlider", &shard, 0, (int)shown->shards - 1, "Shard %d"))
+			post({ Command::Type::ShowShard, shown->tree, shard });
+	}
+
 	void showNodeActionsWindow()
 	{
 		ImGui::Begin("Node actions");
@@ -551,6 +1088,22 @@ namespace app
 		ImGui::SameLine();
 		if (ImGui::Button("Insert Random"))
 			displayInsertRandNodes = true;
+		ImGui::SameLine();
+		if (ImGui::Button("Clear"))
+			clearTree();
+		if (shown && shown->tree == selectedTree && (
+			selectedTree == trees::Trees::PersistentAVL || selectedTree == trees::Trees::PersistentRB ||
+			selectedTree == trees::Trees::PersistentTreap
+		))
+			showHistoryControls();
+		if (shown && shown->tree == selectedTree && selectedTree == trees::Trees::Sharded)
+			showShardControls();
+		if (shown && shown->tree == selectedTree && shown->measured)
+		{
+			ImGui::Dummy({ 0., 3. });
+			ImGui::Text("Height: %llu, leaves: %llu", shown->statistics.height, shown->statistics.leaves);
+			ImGui::Text(shown->statistics.valid ? "Invariants hold" : "Invariants broken");
+		}
 		ImGui::End();
 	}
 
@@ -578,4 +1131,30 @@ namespace app
 		ImGui::EndDisabled();
 		ImGui::End();
 	}
+
+	void showBenchmarkWindow()
+	{
+		ImGui::Begin("Benchmark");
+		ImGui::BeginDisabled(benchmarkRunning);
+		ImGui::Text("Lookups:");
+		ImGui::SliderInt("##ReadPercentSlider", &benchmarkReadPercent, 0, 100, "%d%%");
+		ImGui::Text("Key range:");
+		ImGui::InputInt("##KeysInput", &benchmarkKeys);
+		benchmarkKeys = std::max(benchmarkKeys, 2);
+		ImGui::Dummy({ 0., 3. });
+		if (ImGui::Button("Run"))
+			startBenchmark();
+		ImGui::EndDisabled();
+		ImGui::Dummy({ 0., 3. });
+		ImGui::TextWrapped("Millions of operations per second, concurrent AVL / locked AVL / locked RB:");
+		std::lock_guard<std::mutex> lock(benchmarkMutex);
+		for (const BenchmarkResult& result : benchmarkResults)
+		{
+			ImGui::Text(
+				"%2zu threads: %6.2f / %6.2f / %6.2f",
+				result.threads, result.concurrentAvl, result.lockedAvl, result.lockedRb
+			);
+		}
+		ImGui::End();
+	}
 }
@@ -3,6 +3,12 @@
 #include <array>
 #include <vector>
 #include <functional>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <chrono>
+#include <random>
 
 #include <SFML/Graphics.hpp>
 #include <SFML/System/Clock.hpp>
@@ -19,12 +25,37 @@
 
 namespace app
 {
+	// Tree edits, queued by the UI and applied by the writer thread in batches
+	struct Command
+	{
+		enum class Type { Insert, InsertRandom, Erase, Clear, Undo, Redo, Checkout, Relayout, ShowShard };
+
+		Type type;
+		trees::Trees tree;
+		long long value = 0, prior = -1;	// key, nodes count, version, node spacing or shard
+		const void* node = nullptr;	// erased node, only valid in the layout it was picked from
+		uint64_t layout = 0;
+	};
+
+	// Everything the renderer reads of a tree, published by the writer after each batch
+	struct TreeLayout
+	{
+		std::vector<trees::CanvasNode> nodes;
+		std::vector<std::pair<auxillary::vec2, auxillary::vec2>> edges;
+		trees::Trees tree = trees::Trees::AVL;
+		uint64_t id = 0;
+		size_t version = 0, versions = 1;	// history of persistent trees
+		size_t shard = 0, shards = 1;	// shard shown of a sharded tree
+		trees::TreeStatistics statistics;
+		bool measured = false;	// binary engines only
+	};
+
 	// Settings
 	extern bool showGrids;
-	extern int nodeSpacing;
+	extern int nodeSpacing, parallelGrain;
 
 	// Displayed windows 
-	extern bool displaySettings, displayNodeActions, displayNodeInfo, displayCanvasInfo;
+	extern bool displaySettings, displayNodeActions, displayNodeInfo, displayCanvasInfo, displayBenchmark;
 	extern bool displayInsertNode, displayInsertRandNodes;	// Popups
 
 	// Input params
@@ -32,15 +63,50 @@ namespace app
 	extern trees::Trees selectedTree;
 
 	// Trees
-	extern trees::AVLTree avl;
-	extern trees::RBTree rb;
-	extern trees::Treap treap;
-	extern trees::SplayTree splay;
+	extern trees::AVLTree<> avl;
+	extern trees::RBTree<> rb;
+	extern trees::Treap<> treap;
+	extern trees::SplayTree<> splay;
+	extern trees::WAVLTree<> wavl;
+	extern trees::ScapegoatTree<> scapegoat;
+	extern trees::BTree<> btree;
+	extern trees::ARTree<> art;
+	extern trees::PersistentAVLTree<> persistentAvl;
+	extern trees::PersistentRBTree<> persistentRb;
+	extern trees::PersistentTreap<> persistentTreap;
+	extern trees::ShardedTree<trees::AVLTree<>> sharded;
+
+	// Fork/join pool of the recursive tree algorithms
+	extern auxillary::Scheduler scheduler;
+
+	// Writer thread & published layouts
+	extern auxillary::EpochCell<TreeLayout> layouts;
+	extern auxillary::EpochCell<TreeLayout>::Reader shown;
+	extern std::vector<Command> commands;
+	extern std::mutex commandsMutex;
+	extern std::condition_variable commandsReady;
+	extern std::thread writer;
+	extern bool writerStopping;
+	extern size_t shownShard;
+
+	// Scaling benchmark of the thread-safe trees
+	struct BenchmarkResult
+	{
+		size_t threads;
+		double concurrentAvl, lockedAvl, lockedRb;	// millions of operations per second
+	};
+	extern int benchmarkReadPercent, benchmarkKeys;
+	extern std::vector<BenchmarkResult> benchmarkResults;
+	extern std::mutex benchmarkMutex;
+	extern std::atomic<bool> benchmarkRunning;
+	extern std::thread benchmarker;
 
 	// Canvas vars
 	extern scc::Canvas canvas;
 	extern std::vector<trees::CanvasNode> canvasNodes;
-	extern bool movingCanvas, buildNewTree;
+	extern std::vector<std::pair<float, float>> subtreeWidths;
+	extern std::vector<std::pair<auxillary::vec2, auxillary::vec2>> canvasEdges;
+	extern bool movingCanvas;
 	extern sf::Vector2f savedCursor;
 	extern size_t hoveredNode;
 
@@ -54,11 +120,28 @@ namespace app
 	extern sf::Image logo;
 
 	// Tree logic & display
-	const trees::Node* getCurrentTreeRoot();
-	void _calculateTree(const trees::Node* tree, const auxillary::vec2& c, bool init = false);
-	void calculateTree();
-	void drawNode(sf::RenderWindow* window, const trees::Node* node, size_t i);
-	void _drawTree(sf::RenderWindow* window, const trees::Node* tree, size_t& i);
+	template<class NodeType>
+	float _calculateWidths(const NodeType* node, size_t i);
+	template<class NodeType>
+	void _calculateTree(const NodeType* tree, const auxillary::vec2& c, size_t i);
+	template<class TreeType>
+	void calculateTree(const TreeType& tree);
+	template<class Key, size_t KeyBytes>
+	float _calculateBTreeWidths(const trees::BTreeNode<Key, KeyBytes>* node);
+	template<class Key, size_t KeyBytes>
+	void _calculateBTree(const trees::BTreeNode<Key, KeyBytes>* node, const auxillary::vec2& c, size_t& i);
+	template<class Key, class Value, class Compare, size_t KeyBytes>
+	void calculateTree(const trees::BTree<Key, Value, Compare, KeyBytes>& tree);
+	template<class Key, class Value>
+	float _calculateARTWidths(const trees::ARTNode* node);
+	template<class Key, class Value>
+	void _calculateART(const trees::ARTNode* node, const auxillary::vec2& c, size_t& i);
+	template<class Key, class Value>
+	void calculateTree(const trees::ARTree<Key, Value>& tree);
+	void calculateTree(trees::Trees tree);
+	void drawNode(sf::RenderWindow* window, size_t i);
+	void _drawTree(sf::RenderWindow* window, size_t& i);
+	void _drawMultiKeyTree(sf::RenderWindow* window);
 	void drawTree(sf::RenderWindow* window);
 
 	// Grid
@@ -69,6 +152,30 @@ namespace app
 	void insertNode();
 	void insertRandomNodes();
 	void eraseNode();
+	void clearTree();
+
+	// Scheduler
+	void startScheduler();
+	void stopScheduler();
+
+	// Writer
+	void post(const Command& command);
+	template<class TreeType>
+	void _eraseNode(TreeType& tree, const Command& command, bool current);
+	template<class TreeType>
+	void _applyHistory(TreeType& tree, const Command& command);
+	void applyCommand(const Command& command, bool current);
+	void publishLayout(trees::Trees tree, uint64_t id);
+	void runWriter();
+	void startWriter();
+	void stopWriter();
+
+	// Benchmark
+	template<class TreeType>
+	double _measureThroughput(size_t threads, int readPercent, size_t keys);
+	void runBenchmark(int readPercent, size_t keys);
+	void startBenchmark();
+	void stopBenchmark();
 
 	// Events
 	void handleWindowEvents(sf::Window* window);
@@ -83,6 +190,9 @@ namespace app
 	// Windows
 	void showSettingsWindow();
 	void showNodeInfoWindow();
+	void showHistoryControls();
+	void showShardControls();
 	void showNodeActionsWindow();
 	void showCanvasInfoWindow(sf::Window* window);
+	void showBenchmarkWindow();
 }
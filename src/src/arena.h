@@ -0,0 +1,297 @@
+#pragma once
+
+#include <vector>
+#include <utility>
+#include <algorithm>
+#include <type_traits>
+#include <atomic>
+#include <mutex>
+#include <new>
+#include <cstdint>
+
+
+// Node memory management
+namespace arena
+{
+    // Slab allocator for tree nodes. Nodes are handed out from contiguous chunks of ChunkSize slots,
+    // erased nodes are kept in an intrusive free list and reused by the next allocation.
+    // The whole arena is released in O(chunks), without visiting the nodes: clear() does not run the
+    // destructors of nodes still alive, owners of non-trivial nodes destroy them first
+    template<class T, size_t ChunkSize = 1024>
+    class NodeArena
+    {
+        union Slot
+        {
+            Slot* next;
+            alignas(T) unsigned char storage[sizeof(T)];
+        };
+
+        std::vector<Slot*> chunks;
+        Slot* freeList;
+        size_t used;    // slots taken from the last chunk
+        size_t count;   // nodes alive
+
+        Slot* acquire()
+        {
+            if (freeList != nullptr)
+            {
+                Slot* slot = freeList;
+                freeList = slot->next;
+                return slot;
+            }
+            if (chunks.empty() || used == ChunkSize)
+                chunks.push_back(new Slot[ChunkSize]), used = 0;
+            return chunks.back() + used++;
+        }
+    public:
+        NodeArena() : freeList(nullptr), used(0), count(0) {}
+
+        NodeArena(const NodeArena&) = delete;
+        NodeArena& operator=(const NodeArena&) = delete;
+
+        ~NodeArena()
+        {
+            clear();
+        }
+
+        template<class... Args>
+        T* create(Args&&... args)
+        {
+            Slot* slot = acquire();
+            ++count;
+            return new (slot->storage) T(std::forward<Args>(args)...);
+        }
+
+        void destroy(T* node)
+        {
+            if (node == nullptr)
+                return;
+            node->~T();
+            Slot* slot = reinterpret_cast<Slot*>(node);
+            slot->next = freeList;
+            freeList = slot;
+            --count;
+        }
+
+        void clear()
+        {
+            for (Slot* chunk : chunks)
+                delete[] chunk;
+            chunks.clear();
+            freeList = nullptr;
+            used = count = 0;
+        }
+
+        // Takes over the chunks of other, whose nodes stay where they are. other is left empty
+        void splice(NodeArena& other)
+        {
+            if (other.chunks.empty())
+                return;
+            Slot* tail = other.chunks.back();
+            for (size_t i = other.used; i < ChunkSize; ++i)
+                tail[i].next = other.freeList, other.freeList = tail + i;
+            chunks.insert(chunks.empty() ? chunks.end() : chunks.end() - 1, other.chunks.begin(), other.chunks.end());
+            if (chunks.size() == other.chunks.size())
+                used = ChunkSize;
+            Slot* last = other.freeList;
+            while (last != nullptr && last->next != nullptr)
+                last = last->next;
+            if (last != nullptr)
+                last->next = freeList, freeList = other.freeList;
+            count += other.count;
+            other.chunks.clear();
+            other.freeList = nullptr;
+            other.used = other.count = 0;
+        }
+
+        size_t size() const
+        {
+            return count;
+        }
+    };
+
+    // Slab allocator addressing its nodes by 32-bit indices: the upper bits of an index select
+    // a chunk in the process-wide directory of T chunks, the lower ChunkBits bits a slot inside it.
+    // Chunks are aligned to their size, so the index of a node is recovered from its address alone.
+    // The first slot of every chunk stores the chunk id, which also keeps index 0 free for null
+    template<class T>
+    class IndexedNodeArena
+    {
+    public:
+        static constexpr uint32_t ChunkBits = 12, PageBits = 10;
+        static constexpr size_t ChunkBytes = (size_t)1 << 17;
+    private:
+        union Slot
+        {
+            Slot* next;
+            uint32_t chunkId;
+            alignas(T) unsigned char storage[sizeof(T)];
+        };
+
+        static constexpr size_t SlotsPerChunk = std::min(ChunkBytes / sizeof(Slot), (size_t)1 << ChunkBits);
+        static constexpr uint32_t SlotMask = ((uint32_t)1 << ChunkBits) - 1, PageMask = ((uint32_t)1 << PageBits) - 1;
+
+        // Chunk directory, shared by all arenas of T. Pages are never moved once published,
+        // so lookups need no locking
+        static inline std::atomic<Slot**> pages[(size_t)1 << (32 - ChunkBits - PageBits)];
+        static inline std::mutex directoryLock;
+        static inline std::vector<uint32_t> freeIds;
+        static inline uint32_t nextId = 0;
+
+        std::vector<Slot*> chunks;
+        Slot* freeList;
+        size_t used;    // slots taken from the last chunk
+        size_t count;   // nodes alive
+
+        static Slot* allocateChunk()
+        {
+            Slot* chunk = static_cast<Slot*>(::operator new(ChunkBytes, std::align_val_t(ChunkBytes)));
+            std::lock_guard<std::mutex> lock(directoryLock);
+            uint32_t id;
+            if (!freeIds.empty())
+                id = freeIds.back(), freeIds.pop_back();
+            else if (nextId >> (32 - ChunkBits) == 0)
+                id = nextId++;
+            else
+                ::operator delete(chunk, std::align_val_t(ChunkBytes)), throw std::bad_alloc();
+            Slot** page = pages[id >> PageBits].load(std::memory_order_acquire);
+            if (page == nullptr)
+            {
+                page = new Slot*[(size_t)1 << PageBits]();
+                pages[id >> PageBits].store(page, std::memory_order_release);
+            }
+            page[id & PageMask] = chunk;
+            chunk->chunkId = id;
+            return chunk;
+        }
+
+        static void releaseChunk(Slot* chunk)
+        {
+            std::lock_guard<std::mutex> lock(directoryLock);
+            freeIds.push_back(chunk->chunkId);
+            ::operator delete(chunk, std::align_val_t(ChunkBytes));
+        }
+
+        Slot* acquire()
+        {
+            if (freeList != nullptr)
+            {
+                Slot* slot = freeList;
+                freeList = slot->next;
+                return slot;
+            }
+            if (chunks.empty() || used == SlotsPerChunk)
+                chunks.push_back(allocateChunk()), used = 1;
+            return chunks.back() + used++;
+        }
+    public:
+        IndexedNodeArena() : freeList(nullptr), used(0), count(0) {}
+
+        IndexedNodeArena(const IndexedNodeArena&) = delete;
+        IndexedNodeArena& operator=(const IndexedNodeArena&) = delete;
+
+        ~IndexedNodeArena()
+        {
+            clear();
+        }
+
+        static T* nodeAt(uint32_t index)
+        {
+            if (index == 0)
+                return nullptr;
+            Slot* chunk = pages[index >> (ChunkBits + PageBits)].load(std::memory_order_acquire)
+                [(index >> ChunkBits) & PageMask];
+            return reinterpret_cast<T*>(chunk + (index & SlotMask));
+        }
+
+        static uint32_t indexOf(const T* node)
+        {
+            if (node == nullptr)
+                return 0;
+            const Slot* slot = reinterpret_cast<const Slot*>(node),
+                * chunk = reinterpret_cast<const Slot*>((uintptr_t)node & ~(uintptr_t)(ChunkBytes - 1));
+            return chunk->chunkId << ChunkBits | (uint32_t)(slot - chunk);
+        }
+
+        template<class... Args>
+        T* create(Args&&... args)
+        {
+            Slot* slot = acquire();
+            ++count;
+            return new (slot->storage) T(std::forward<Args>(args)...);
+        }
+
+        void destroy(T* node)
+        {
+            if (node == nullptr)
+                return;
+            node->~T();
+            Slot* slot = reinterpret_cast<Slot*>(node);
+            slot->next = freeList;
+            freeList = slot;
+            --count;
+        }
+
+        void clear()
+        {
+            for (Slot* chunk : chunks)
+                releaseChunk(chunk);
+            chunks.clear();
+            freeList = nullptr;
+            used = count = 0;
+        }
+
+        // Takes over the chunks of other. Indices stay valid, the chunk directory is shared
+        void splice(IndexedNodeArena& other)
+        {
+            if (other.chunks.empty())
+                return;
+            Slot* tail = other.chunks.back();
+            for (size_t i = other.used; i < SlotsPerChunk; ++i)
+                tail[i].next = other.freeList, other.freeList = tail + i;
+            chunks.insert(chunks.empty() ? chunks.end() : chunks.end() - 1, other.chunks.begin(), other.chunks.end());
+            if (chunks.size() == other.chunks.size())
+                used = SlotsPerChunk;
+            Slot* last = other.freeList;
+            while (last != nullptr && last->next != nullptr)
+                last = last->next;
+            if (last != nullptr)
+                last->next = freeList, freeList = other.freeList;
+            count += other.count;
+            other.chunks.clear();
+            other.freeList = nullptr;
+            other.used = other.count = 0;
+        }
+
+        size_t size() const
+        {
+            return count;
+        }
+    };
+
+    // 32-bit link to a node of an IndexedNodeArena, behaving like a T*
+    template<class T>
+    class IndexLink
+    {
+        uint32_t index;
+    public:
+        IndexLink() : index(0) {}
+        explicit IndexLink(T* node) : index(IndexedNodeArena<T>::indexOf(node)) {}
+
+        IndexLink& operator=(T* node)
+        {
+            index = IndexedNodeArena<T>::indexOf(node);
+            return *this;
+        }
+
+        operator T*() const
+        {
+            return IndexedNodeArena<T>::nodeAt(index);
+        }
+
+        T* operator->() const
+        {
+            return IndexedNodeArena<T>::nodeAt(index);
+        }
+    };
+}
@@ -1,10 +1,18 @@
 #include "auxillary.h"
 
+#include <ctime>
+#include <functional>
+
 
 const float PI = 3.141592653589793f;
 
 namespace auxillary
 {
+    unsigned threadSeed()
+    {
+        return (unsigned)std::time(nullptr) ^ (unsigned)std::hash<std::thread::id>()(std::this_thread::get_id());
+    }
+
     sf::Vector2f round(sf::Vector2f v)
     {
         return sf::Vector2f(std::round(v.x), std::round(v.y));
@@ -115,4 +123,177 @@ namespace auxillary
         return true;
     }
     #pragma endregion
+
+    #pragma region Scheduler
+    std::atomic<Scheduler*> Scheduler::active{ nullptr };
+    thread_local const Scheduler* Scheduler::owner = nullptr;
+    thread_local size_t Scheduler::ownIndex = 0;
+
+    Scheduler::~Scheduler()
+    {
+        stop();
+    }
+
+    void Scheduler::start(size_t workers)
+    {
+        stop();
+        stopping = false;
+        for (size_t i = 0; i <= workers; ++i)
+            deques.emplace_back(new Deque());
+        for (size_t i = 0; i < workers; ++i)
+            threads.emplace_back(&Scheduler::run, this, i);
+        active.store(this);
+    }
+
+    void Scheduler::stop()
+    {
+        // No fork may be in progress
+        Scheduler* self = this;
+        active.compare_exchange_strong(self, nullptr);
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (std::thread& thread : threads)
+            thread.join();
+        threads.clear(), deques.clear();
+    }
+
+    size_t Scheduler::workers() const
+    {
+        return threads.size();
+    }
+
+    void Scheduler::setGrain(size_t grain)
+    {
+        grainSize.store(std::max<size_t>(grain, 1), std::memory_order_relaxed);
+    }
+
+    size_t Scheduler::grain() const
+    {
+        return grainSize.load(std::memory_order_relaxed);
+    }
+
+    bool Scheduler::forkable(size_t work) const
+    {
+        return !threads.empty() && work >= grain();
+    }
+
+    Scheduler* Scheduler::current()
+    {
+        return active.load(std::memory_order_acquire);
+    }
+
+    Scheduler::Deque& Scheduler::local()
+    {
+        return owner == this ? *deques[ownIndex] : *deques.back();
+    }
+
+    void Scheduler::push(Deque& deque, Job* job)
+    {
+        {
+            std::lock_guard<SpinLock> lock(deque.lock);
+            deque.jobs.push_back(job);
+            queued.fetch_add(1);
+        }
+        // Sleepers announce themselves before they check queued, so one of the two sides sees the other
+        if (sleepers.load() > 0)
+        {
+            std::lock_guard<std::mutex> lock(sleepMutex);
+            wake.notify_one();
+        }
+    }
+
+    bool Scheduler::retract(Deque& deque, Job* job)
+    {
+        // The job is the newest one of a worker's deque, but threads outside the pool share theirs
+        std::lock_guard<SpinLock> lock(deque.lock);
+        auto it = std::find(deque.jobs.rbegin(), deque.jobs.rend(), job);
+        if (it == deque.jobs.rend())
+            return false;
+        deque.jobs.erase(std::next(it).base());
+        queued.fetch_sub(1);
+        return true;
+    }
+
+    Scheduler::Job* Scheduler::take(Deque& own)
+    {
+        if (queued.load() == 0)
+            return nullptr;
+        {
+            std::lock_guard<SpinLock> lock(own.lock);
+            if (!own.jobs.empty())
+            {
+                Job* job = own.jobs.back();
+                own.jobs.pop_back(), queued.fetch_sub(1);
+                return job;
+            }
+        }
+        // Thieves start from a different victim each time, so they spread over the deques
+        static thread_local size_t victim = 0;
+        ++victim;
+        for (size_t i = 0; i < deques.size(); ++i)
+        {
+            Deque& deque = *deques[(victim + i) % deques.size()];
+            if (&deque == &own)
+                continue;
+            std::lock_guard<SpinLock> lock(deque.lock);
+            if (!deque.jobs.empty())
+            {
+                Job* job = deque.jobs.front();
+                deque.jobs.pop_front(), queued.fetch_sub(1);
+                return job;
+            }
+        }
+        return nullptr;
+    }
+
+    void Scheduler::execute(Job* job)
+    {
+        // The job lives on the stack of its forking thread, which may return once done is set
+        job->run(job);
+        job->done.store(true, std::memory_order_release);
+    }
+
+    void Scheduler::join(Deque& own, Job& job)
+    {
+        while (!job.done.load(std::memory_order_acquire))
+        {
+            if (Job* other = take(own))
+                execute(other);
+            else
+                std::this_thread::yield();
+        }
+    }
+
+    void Scheduler::run(size_t index)
+    {
+        owner = this, ownIndex = index;
+        Deque& own = *deques[index];
+        while (true)
+        {
+            Job* job = take(own);
+            for (int spins = 0; job == nullptr && spins < 64; ++spins)
+                std::this_thread::yield(), job = take(own);
+            if (job != nullptr)
+            {
+                execute(job);
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(sleepMutex);
+            sleepers.fetch_add(1);
+            wake.wait(lock, [this] { return stopping || queued.load() > 0; });
+            sleepers.fetch_sub(1);
+            if (stopping)
+                return;
+        }
+    }
+
+    bool forkable(size_t work)
+    {
+        Scheduler* scheduler = Scheduler::current();
+        return scheduler != nullptr && scheduler->forkable(work);
+    }
+    #pragma endregion
 }
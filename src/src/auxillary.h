@@ -2,6 +2,15 @@
 
 #include <SFML/Graphics.hpp>
 #include <array>
+#include <vector>
+#include <algorithm>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <memory>
+#include <limits>
 
 
 extern const float PI;
@@ -28,6 +37,265 @@ namespace auxillary
         return lv + (arg - l) / (r - l) * (rv - lv);
     }
 
+    // Lock of a single flag for short critical sections, spinning before it yields the thread
+    class SpinLock
+    {
+        std::atomic<bool> locked{ false };
+    public:
+        void lock()
+        {
+            for (int spins = 0; locked.exchange(true, std::memory_order_acquire); ++spins)
+            {
+                while (locked.load(std::memory_order_relaxed))
+                    if (++spins > 64)
+                        std::this_thread::yield();
+            }
+        }
+        bool try_lock() { return !locked.exchange(true, std::memory_order_acquire); }
+        void unlock() { locked.store(false, std::memory_order_release); }
+    };
+
+    // Work-stealing fork/join pool. Each worker pushes the jobs it forks to the back of its own deque and pops
+    // them from there, idle workers steal from the front of the others. Threads outside the pool fork into one
+    // shared deque. A join runs its job inline unless it was stolen, and otherwise runs other jobs until the
+    // thief is done. Recursive algorithms fork only for at least grain() items of work, below it they run serially
+    class Scheduler
+    {
+    public:
+        Scheduler() = default;
+        Scheduler(const Scheduler&) = delete;
+        Scheduler& operator=(const Scheduler&) = delete;
+        ~Scheduler();
+
+        // Starts the workers and makes this the scheduler of the parallel helpers below
+        void start(size_t workers);
+        void stop();
+        size_t workers() const;
+
+        void setGrain(size_t grain);
+        size_t grain() const;
+        bool forkable(size_t work) const;
+
+        // Runs f here and g on whichever worker takes it first, returns once both are done
+        template<class F, class G>
+        void invoke(F&& f, G&& g)
+        {
+            Task<G> task(g);
+            Deque& own = local();
+            push(own, &task);
+            f();
+            if (retract(own, &task))
+                g();
+            else
+                join(own, task);
+        }
+
+        static Scheduler* current();    // the started scheduler, nullptr if none is
+    private:
+        struct Job
+        {
+            void (*run)(Job*) = nullptr;
+            std::atomic<bool> done{ false };
+        };
+
+        template<class F>
+        struct Task : Job
+        {
+            F& f;
+
+            Task(F& f) : f(f)
+            {
+                this->run = [](Job* job) { static_cast<Task*>(job)->f(); };
+            }
+        };
+
+        struct alignas(64) Deque
+        {
+            SpinLock lock;
+            std::deque<Job*> jobs;
+        };
+
+        static std::atomic<Scheduler*> active;
+        // Deque of the calling thread, if it is a worker
+        static thread_local const Scheduler* owner;
+        static thread_local size_t ownIndex;
+
+        std::vector<std::unique_ptr<Deque>> deques;     // one per worker, the last one for the other threads
+        std::vector<std::thread> threads;
+        std::atomic<size_t> queued{ 0 }, sleepers{ 0 };
+        std::atomic<size_t> grainSize{ 1 << 12 };
+        std::mutex sleepMutex;
+        std::condition_variable wake;
+        bool stopping = false;
+
+        Deque& local();
+        void push(Deque& deque, Job* job);
+        bool retract(Deque& deque, Job* job);   // takes job back unless it was stolen
+        Job* take(Deque& own);  // the newest job of own, else the oldest of another deque
+        static void execute(Job* job);
+        void join(Deque& own, Job& job);
+        void run(size_t index);
+    };
+
+    // Whether the current scheduler forks for work items
+    bool forkable(size_t work);
+
+    // Runs f and g, in parallel if parallel is set and a scheduler is started
+    template<class F, class G>
+    void parallelInvoke(bool parallel, F&& f, G&& g)
+    {
+        Scheduler* scheduler = Scheduler::current();
+        if (!parallel || scheduler == nullptr)
+        {
+            f(), g();
+            return;
+        }
+        scheduler->invoke(f, g);
+    }
+
+    template<class F>
+    void _parallelFor(size_t begin, size_t end, F& f, size_t grain)
+    {
+        if (end - begin < 2 * grain || Scheduler::current() == nullptr)
+        {
+            f(begin, end);
+            return;
+        }
+        size_t mid = begin + (end - begin) / 2;
+        parallelInvoke(true, [&]() { _parallelFor(begin, mid, f, grain); }, [&]() { _parallelFor(mid, end, f, grain); });
+    }
+
+    // Runs f(begin, end) over contiguous blocks of [0, count), halving the range while the halves hold grain items
+    template<class F>
+    void parallelFor(size_t count, F&& f, size_t grain = 1 << 16)
+    {
+        _parallelFor(0, count, f, std::max<size_t>(grain, 1));
+    }
+
+    // Merge sort, sorting the halves in parallel down to blocks of grain items
+    template<class RandomIt, class Compare>
+    void parallelSort(RandomIt begin, RandomIt end, Compare comp, size_t grain = 1 << 16)
+    {
+        size_t count = (size_t)(end - begin);
+        if (count < 2 * grain || Scheduler::current() == nullptr)
+        {
+            std::sort(begin, end, comp);
+            return;
+        }
+        RandomIt mid = begin + count / 2;
+        parallelInvoke(true,
+            [&]() { parallelSort(begin, mid, comp, grain); },
+            [&]() { parallelSort(mid, end, comp, grain); });
+        std::inplace_merge(begin, mid, end, comp);
+    }
+
+    // Single-writer publication cell. Readers pin the current value lock-free by announcing the epoch they
+    // entered in, the writer frees a replaced value once every pinned reader has entered after it was replaced
+    template<class T, size_t Readers = 4>
+    class EpochCell
+    {
+    public:
+        class Reader
+        {
+        public:
+            Reader() = default;
+            Reader(EpochCell* cell, size_t slot) : cell(cell), slot(slot) { refresh(); }
+            Reader(Reader&& other) noexcept : cell(other.cell), slot(other.slot), value(other.value)
+            {
+                other.cell = nullptr, other.value = nullptr;
+            }
+            Reader& operator=(Reader&& other) noexcept
+            {
+                if (this != &other)
+                {
+                    unpin();
+                    cell = other.cell, slot = other.slot, value = other.value;
+                    other.cell = nullptr, other.value = nullptr;
+                }
+                return *this;
+            }
+            ~Reader() { unpin(); }
+
+            // Moves the pin to the last published value, the previous one may be freed from then on
+            void refresh()
+            {
+                cell->slots[slot].epoch.store(cell->epoch.load());
+                value = cell->value.load();
+            }
+
+            const T* get() const { return value; }
+            const T* operator->() const { return value; }
+            const T& operator*() const { return *value; }
+            explicit operator bool() const { return value != nullptr; }
+
+        private:
+            void unpin()
+            {
+                if (cell != nullptr)
+                    cell->slots[slot].epoch.store(Idle);
+            }
+
+            EpochCell* cell = nullptr;
+            size_t slot = 0;
+            const T* value = nullptr;
+        };
+
+        EpochCell() = default;
+        EpochCell(const EpochCell&) = delete;
+        EpochCell& operator=(const EpochCell&) = delete;
+        ~EpochCell()
+        {
+            for (auto& retiree : retired)
+                delete retiree.second;
+            delete value.load();
+        }
+
+        // Each reading thread uses its own slot
+        Reader read(size_t slot = 0) { return Reader(this, slot); }
+
+        // Writer side. Replaces the value, then frees the replaced values no reader can reach anymore
+        void publish(std::unique_ptr<T> next)
+        {
+            T* previous = value.exchange(next.release());
+            uint64_t retiredAt = epoch.fetch_add(1) + 1;
+            if (previous != nullptr)
+                retired.emplace_back(retiredAt, previous);
+            reclaim();
+        }
+
+        void reclaim()
+        {
+            uint64_t oldest = Idle;
+            for (const Slot& slot : slots)
+                oldest = std::min(oldest, slot.epoch.load());
+            // A reader that announced epoch e loaded the value after every replacement tagged e or earlier
+            auto kept = std::partition(retired.begin(), retired.end(), [oldest](const auto& retiree) {
+                return retiree.first > oldest;
+            });
+            for (auto it = kept; it != retired.end(); ++it)
+                delete it->second;
+            retired.erase(kept, retired.end());
+        }
+
+        size_t pending() const { return retired.size(); }
+
+    private:
+        static constexpr uint64_t Idle = std::numeric_limits<uint64_t>::max();
+
+        struct alignas(64) Slot
+        {
+            std::atomic<uint64_t> epoch{ Idle };
+        };
+
+        std::atomic<T*> value{ nullptr };
+        std::atomic<uint64_t> epoch{ 0 };
+        std::array<Slot, Readers> slots;
+        std::vector<std::pair<uint64_t, T*>> retired;
+    };
+
+    // Seed of the random generators kept per thread, different for threads started at the same time
+    unsigned threadSeed();
+
     sf::Vector2f round(sf::Vector2f v);
 
     struct vec2
@@ -5,7 +5,7 @@ int WinMain(int argc, char** argv)
 {
     if (!app::font.loadFromFile("resources/CascadiaMonoPLItalic-BoldItalic.otf"))
         throw std::runtime_error("Failed to load font");
-    trees::Node::font = app::font;
+    trees::CanvasNode::font = app::font;
 
     sf::ContextSettings settings;
     settings.antialiasingLevel = 2;
@@ -25,6 +25,8 @@ int WinMain(int argc, char** argv)
     io.ConfigFlags |= ImGuiConfigFlags_NavEnableKeyboard;
 
     app::setupGridLines();
+    app::startScheduler();
+    app::startWriter();
 
     sf::Clock deltaClock;
     while (window.isOpen()) 
@@ -50,10 +52,15 @@ int WinMain(int argc, char** argv)
             app::showInsertRandomNodesPopup();
         if (app::displayCanvasInfo)
             app::showCanvasInfoWindow(&window);
+        if (app::displayBenchmark)
+            app::showBenchmarkWindow();
 
         ImGui::SFML::Render(window);
         window.display();
     }
 
+    app::stopWriter();
+    app::stopBenchmark();
+    app::stopScheduler();
     ImGui::SFML::Shutdown();
 }
@@ -3,10 +3,34 @@
 #include <SFML/Graphics.hpp>
 
 #include <utility>
+#include <iterator>
+#include <vector>
+#include <deque>
+#include <memory>
+#include <functional>
+#include <type_traits>
 #include <random>
 #include <ctime>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <atomic>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <thread>
+#include <optional>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
 
 #include "auxillary.h"
+#include "arena.h"
 #include "scc.h"
 
 
@@ -14,159 +38,1536 @@ namespace trees
 {
     enum class Trees
     {
-        AVL, RB, Treap, Splay
+        AVL, RB, Treap, Splay, WAVL, Scapegoat, BTree, ART, PersistentAVL, PersistentRB, PersistentTreap, Sharded
     };
 
-    extern const std::array<Trees, 4> TreesIter;
+    extern const std::array<Trees, 12> TreesIter;
 
     const char* treeToString(Trees tree);
 
-    // Base class for all nodes
-    class Node
+    // Node layouts. PointerLayout links nodes with plain pointers, CompactLayout with 32-bit indices
+    // into the tree's arena, which together with the packed fields below halves the node size
+    struct PointerLayout
+    {
+        template<class NodeType>
+        using Link = NodeType*;
+        template<class NodeType>
+        using Arena = arena::NodeArena<NodeType>;
+    };
+
+    struct CompactLayout
+    {
+        template<class NodeType>
+        using Link = arena::IndexLink<NodeType>;
+        template<class NodeType>
+        using Arena = arena::IndexedNodeArena<NodeType>;
+    };
+
+    // Monoids aggregated over the keys of a set (the mapped values of a map) by Augmentation. A monoid
+    // gives the aggregate Type, its identity() and combine(a, b) of a range a followed by a range b,
+    // which must be associative but need not be commutative
+    template<class T>
+    struct SumMonoid
+    {
+        using Type = T;
+
+        static T identity() { return T(); }
+        static T combine(const T& a, const T& b) { return a + b; }
+    };
+
+    template<class T>
+    struct MinMonoid
+    {
+        using Type = T;
+
+        static T identity() { return std::numeric_limits<T>::max(); }
+        static T combine(const T& a, const T& b) { return b < a ? b : a; }
+    };
+
+    template<class T>
+    struct MaxMonoid
+    {
+        using Type = T;
+
+        static T identity() { return std::numeric_limits<T>::lowest(); }
+        static T combine(const T& a, const T& b) { return a < b ? b : a; }
+    };
+
+    struct NoMonoid
+    {
+        using Type = void;
+    };
+
+    // Augmentations maintained by BasicNode::update(). Disabled ones are left out of the node
+    // and out of every update. AVLTree keeps the height regardless, its balancing depends on it.
+    // Tombstones switch erase to lazy deletion: erased nodes are only marked until a rebuild.
+    // A Monoid other than NoMonoid keeps its aggregate of every subtree, tombstones left out
+    template<bool Height, bool Size, bool Tombstones = false, class Monoid = NoMonoid>
+    struct Augmentation
+    {
+        static constexpr bool height = Height, size = Size, tombstones = Tombstones;
+        static constexpr bool aggregated = !std::is_same<Monoid, NoMonoid>::value;
+
+        using MonoidPolicy = Monoid;
+    };
+
+    using FullAugmentation = Augmentation<true, true>;
+    using NoAugmentation = Augmentation<false, false>;
+    using LazyAugmentation = Augmentation<true, true, true>;
+    template<class Monoid>
+    using AggregateAugmentation = Augmentation<true, true, false, Monoid>;
+
+    // Optional node fields
+    struct SizeField
+    {
+        uint32_t n;
+    };
+
+    struct PackedField
+    {
+        uint32_t h : 30, red : 1, dead : 1;   // height, the color bit of RBTree nodes and the tombstone bit
+    };
+
+    struct LiveField
+    {
+        uint32_t live;  // nodes in the subtree which are not tombstones
+    };
+
+    struct PriorityField
+    {
+        uint32_t prior;
+    };
+
+    struct RankDifferenceField
+    {
+        uint8_t ld : 1, rd : 1;     // set if the left (right) child is two ranks below, a missing child has rank -1
+    };
+
+    template<class Monoid>
+    struct AggregateField
+    {
+        typename Monoid::Type agg;  // of the subtree
+    };
+
+    template<int>
+    struct NoField {};
+
+    // Mapped value of a node. Trees storing plain keys use void, which takes no space
+    struct NoValue {};
+
+    template<class Value>
+    struct ValueField
+    {
+        Value value;
+
+        ValueField(const Value& value) : value(value) {}
+    };
+
+    template<>
+    struct ValueField<void>
+    {
+        ValueField(const NoValue&) {}
+    };
+
+    // Base class for all nodes. Nodes hold no drawing code (and so no vtable). Small fields come
+    // first (Extra holds the ones specific to an engine), so they share padding with the links
+    template<class Derived, class Key, class Value, class Augment, class Layout,
+             bool Colored = false, class Extra = NoField<2>>
+    class BasicNode
+        : public std::conditional_t<Augment::size, SizeField, NoField<0>>,
+          public std::conditional_t<Augment::height || Colored || Augment::tombstones, PackedField, NoField<1>>,
+          public std::conditional_t<Augment::size && Augment::tombstones, LiveField, NoField<3>>,
+          public Extra,
+          public std::conditional_t<Augment::aggregated, AggregateField<typename Augment::MonoidPolicy>, NoField<4>>,
+          public ValueField<Value>
     {
     public:
-        static sf::Font font;
-        static float diameter, spacing, outlineThickness;  // in canvas units
+        using KeyType = Key;
+        using MappedType = std::conditional_t<std::is_void<Value>::value, NoValue, Value>;
+        using Link = typename Layout::template Link<Derived>;
+        using AugmentPolicy = Augment;
+        using LayoutPolicy = Layout;
 
-        size_t h, n;
-        size_t elem;
-        Node* parent, * l, * r;
+        static constexpr bool augmented = Augment::height || Augment::size || Augment::aggregated;
+        static constexpr bool colored = Colored;
 
-        Node(size_t elem, Node* parent = nullptr, size_t h = 1, size_t n = 1, Node* l = nullptr, Node* r = nullptr);
+        Link parent, l, r;
+        Key elem;
 
-        virtual void draw(sf::RenderWindow* window, const scc::Canvas& canvas, 
-                          auxillary::vec2 coordinate, sf::FloatRect* outBoundary) const;
+        BasicNode(const Key& elem, const MappedType& value, Derived* parent = nullptr, bool red = false);
 
         void update();
+        void swapPayload(Derived* other);   // exchanges keys and mapped values
+        // Aggregate of the node alone: its key, or its mapped value in maps. Identity for tombstones
+        typename Augment::MonoidPolicy::Type ownAggregate() const;
+    };
+
+    template<class Key = size_t, class Value = void, class Augment = FullAugmentation,
+             class Layout = PointerLayout>
+    class Node : public BasicNode<Node<Key, Value, Augment, Layout>, Key, Value, Augment, Layout>
+    {
+    public:
+        using typename BasicNode<Node, Key, Value, Augment, Layout>::MappedType;
+
+        Node(const Key& elem, const MappedType& value, Node* parent = nullptr);
+    };
+
+    template<class Key = size_t, class Value = void, class Augment = FullAugmentation,
+             class Layout = PointerLayout>
+    class RBNode : public BasicNode<RBNode<Key, Value, Augment, Layout>, Key, Value, Augment, Layout, true>
+    {
+    public:
+        using typename BasicNode<RBNode, Key, Value, Augment, Layout, true>::MappedType;
+
+        RBNode(const Key& elem, const MappedType& value, RBNode* parent = nullptr, bool red = true);
+    };
+
+    template<class Key = size_t, class Value = void, class Augment = FullAugmentation,
+             class Layout = PointerLayout>
+    class TreapNode
+        : public BasicNode<TreapNode<Key, Value, Augment, Layout>, Key, Value, Augment, Layout, false, PriorityField>
+    {
+    public:
+        using typename BasicNode<TreapNode, Key, Value, Augment, Layout, false, PriorityField>::MappedType;
+
+        TreapNode(const Key& elem, const MappedType& value, uint32_t prior, TreapNode* parent = nullptr);
+    };
+
+    template<class Key = size_t, class Value = void, class Augment = FullAugmentation,
+             class Layout = PointerLayout>
+    class WAVLNode
+        : public BasicNode<WAVLNode<Key, Value, Augment, Layout>, Key, Value, Augment, Layout, false, RankDifferenceField>
+    {
+    public:
+        using typename BasicNode<WAVLNode, Key, Value, Augment, Layout, false, RankDifferenceField>::MappedType;
+
+        WAVLNode(const Key& elem, const MappedType& value, WAVLNode* parent = nullptr);
+    };
+
+    // Node of ImplicitTreap. Its position is the size of everything left of it and is never stored.
+    // Range updates are applied to the highest nodes they cover and kept there, pending for the children
+    template<class T>
+    struct ImplicitTreapNode
+    {
+        ImplicitTreapNode* parent, * l, * r;
+        T value, sum, min;
+        T add, assigned;    // pending for the children: assigned if assign is set, else add
+        size_t n;
+        uint32_t prior;
+        bool assign, reversed;
+
+        ImplicitTreapNode(const T& value, uint32_t prior);
+
+        void update();
+    };
+
+    // Nodes of BTree. Keys of a node fill KeyBytes, a whole number of cache lines, and are searched
+    // with AVX2 where available. Leaves hold all the keys and are chained in key order. Inner nodes hold
+    // separators: keys of children[i] are less than keys[i], which is not greater than keys of children[i + 1]
+    template<class Key, size_t KeyBytes>
+    struct alignas(64) BTreeNode
+    {
+        static constexpr uint32_t Capacity = (uint32_t)(std::max<size_t>(8, KeyBytes / sizeof(Key)) + 7) / 8 * 8;
+
+        Key keys[Capacity];
+        uint32_t count;     // keys in the node
+        uint32_t h;         // height, leaves have 1
+        size_t n;           // keys in the subtree
+    };
+
+    template<class Value, uint32_t Capacity>
+    struct BTreeValues
+    {
+        Value values[Capacity];
+    };
+
+    template<uint32_t Capacity>
+    struct BTreeValues<void, Capacity> {};
+
+    template<class Key, class Value, size_t KeyBytes>
+    struct BTreeLeaf : BTreeNode<Key, KeyBytes>, BTreeValues<Value, BTreeNode<Key, KeyBytes>::Capacity>
+    {
+        BTreeLeaf* prev, * next;
+    };
+
+    template<class Key, size_t KeyBytes>
+    struct BTreeInner : BTreeNode<Key, KeyBytes>
+    {
+        BTreeNode<Key, KeyBytes>* children[BTreeNode<Key, KeyBytes>::Capacity + 1];
+    };
+
+    // Nodes of ARTree. Inner nodes keep the key bytes of their children, sorted in Node4 and Node16 and
+    // as an index in Node48 and Node256, and the bytes shared by all keys below them (path compression)
+    struct ARTNode
+    {
+        enum class Type : uint8_t
+        {
+            Leaf, Node4, Node16, Node48, Node256
+        };
+
+        Type type;
+        uint8_t prefixLength;
+        uint16_t count;     // children
+        uint8_t prefix[8];
     };
 
-    // Class for storing displayed nodes
+    struct ARTNode4 : ARTNode
+    {
+        uint8_t keys[4];
+        ARTNode* children[4];
+    };
+
+    struct ARTNode16 : ARTNode
+    {
+        uint8_t keys[16];
+        ARTNode* children[16];
+    };
+
+    struct ARTNode48 : ARTNode
+    {
+        uint8_t index[256];     // slot of the child with a key byte plus one, 0 if there is none
+        ARTNode* children[48];
+    };
+
+    struct ARTNode256 : ARTNode
+    {
+        ARTNode* children[256];
+    };
+
+    template<class Key, class Value>
+    struct ARTLeaf : ARTNode, ValueField<Value>
+    {
+        using MappedType = std::conditional_t<std::is_void<Value>::value, NoValue, Value>;
+
+        Key key;
+
+        ARTLeaf(const Key& key, const MappedType& value);
+    };
+
+    // Node of the persistent trees. A node reachable from a kept version is never changed: updates copy
+    // the nodes on their path and share the rest. refs counts the links, versions and snapshots holding
+    // the node, which is released with the last of them. h is the height, the black height in colored nodes
+    template<class Key, class Value, bool Colored = false, class Extra = NoField<2>>
+    class PersistentNode : public SizeField, public PackedField, public Extra, public ValueField<Value>
+    {
+    public:
+        using KeyType = Key;
+        using MappedType = std::conditional_t<std::is_void<Value>::value, NoValue, Value>;
+
+        static constexpr bool colored = Colored;
+
+        PersistentNode* l, * r;
+        Key elem;
+        std::atomic<uint32_t> refs;
+
+        PersistentNode(const Key& elem, const MappedType& value);
+        PersistentNode(const PersistentNode& other);    // unlinked copy, held once
+    };
+
+    // Node of ConcurrentAVLTree. Everything but the key is an atomic, read without locks and changed under
+    // the node lock. version tells lookups a node was rotated down or unlinked meanwhile: its low bits
+    // mark both, the rest counts finished rotations. A node whose key was erased while it had two children
+    // stays in the tree as a routing node, not present, until it loses one
+    template<class Key>
+    struct ConcurrentNode
+    {
+        using KeyType = Key;
+
+        static constexpr uint64_t Unlinked = 1, Shrinking = 2, ShrinkCount = 4;
+
+        std::atomic<ConcurrentNode*> l, r, parent;
+        std::atomic<uint64_t> version;
+        std::atomic<int32_t> h;
+        std::atomic<bool> present;
+        auxillary::SpinLock lock;
+        ConcurrentNode* retiredNext;
+        const Key elem;
+
+        ConcurrentNode(const Key& elem, ConcurrentNode* parent, bool present = true);
+    };
+
+    // Class for storing displayed nodes, keeps everything needed to draw and describe a node
     struct CanvasNode
     {
-        const Node* const node;
-        const auxillary::BoundingBox box;
+        enum class Style
+        {
+            Plain, Red, Black, Prioritized, Cell     // Cell: a key of a multi-key node, drawn as a square
+        };
+
+        static sf::Font font;
+        static float diameter, spacing, outlineThickness;  // in canvas units
+
+        auxillary::BoundingBox box;
+        Style style;
+        size_t elem, prior, h, n;
+        bool hasL, hasR;
+        const void* node;   // the drawn tree node, binary engines take it back as a handle
 
-        CanvasNode(const Node* node, const auxillary::BoundingBox& box);
+        template<class Key, class Value, class Augment, class Layout>
+        CanvasNode(const Node<Key, Value, Augment, Layout>* node, const auxillary::BoundingBox& box);
+        template<class Key, class Value, class Augment, class Layout>
+        CanvasNode(const RBNode<Key, Value, Augment, Layout>* node, const auxillary::BoundingBox& box);
+        template<class Key, class Value, class Augment, class Layout>
+        CanvasNode(const TreapNode<Key, Value, Augment, Layout>* node, const auxillary::BoundingBox& box);
+        template<class Key, class Value, class Augment, class Layout>
+        CanvasNode(const WAVLNode<Key, Value, Augment, Layout>* node, const auxillary::BoundingBox& box);
+        template<class Key, size_t KeyBytes>
+        CanvasNode(const BTreeNode<Key, KeyBytes>* node, uint32_t slot, const auxillary::BoundingBox& box);
+        template<class Key, class Value>
+        CanvasNode(const ARTLeaf<Key, Value>* leaf, const auxillary::BoundingBox& box);
+        template<class Key, class Value, bool Colored>
+        CanvasNode(const PersistentNode<Key, Value, Colored>* node, const auxillary::BoundingBox& box);
+        template<class Key, class Value>
+        CanvasNode(const PersistentNode<Key, Value, false, PriorityField>* node, const auxillary::BoundingBox& box);
+        CanvasNode(const ARTNode* node, uint8_t byte, const auxillary::BoundingBox& box);     // cell of a child
+        CanvasNode() = default;     // slot of a layout filled in parallel
 
         bool contains(const auxillary::vec2& v) const;
+
+        void draw(sf::RenderWindow* window, const scc::Canvas& canvas, sf::FloatRect* outBoundary) const;
+    };
+
+    // Shape of a tree, and whether the invariants all binary engines keep hold: keys ascending, parent links
+    // matching their children and, with Augment::size, subtree sizes adding up
+    struct TreeStatistics
+    {
+        size_t nodes = 0, leaves = 0, height = 0;
+        bool valid = true;
     };
 
-    // Base class for all trees
+    // Base class for all trees. Engines pass themselves as Derived, so the base calls them
+    // (and they call the comparator) without virtual dispatch
+    template<class Derived, class NodeT, class Compare>
     class Tree
     {
     public:
-        using NodeType = Node;
+        using NodeType = NodeT;
+        using KeyType = typename NodeType::KeyType;
+        using MappedType = typename NodeType::MappedType;
     protected:
+        // Element of a sorted run given to buildFromSorted: the key for sets, a (key, value) pair for maps
+        using Entry = std::conditional_t<std::is_same<MappedType, NoValue>::value, KeyType, std::pair<KeyType, MappedType>>;
+
+        // insertRandom batches at least size() / MergeRatio keys long rebuild the tree, shorter ones are
+        // inserted one by one
+        static constexpr size_t MergeRatio = 16;
+        using Arena = typename NodeType::LayoutPolicy::template Arena<NodeType>;
+
+        // Trees cut from one another by split() share their arena, each of them owns its own nodes only
         NodeType* tree;
+        std::shared_ptr<Arena> pool;
+        Compare comp;
+        size_t count;
+        size_t dead;    // tombstones among the count nodes
+        double rebuildThreshold;
 
         static void leftRotate(NodeType*& node);
         static void rightRotate(NodeType*& node);
         static NodeType* findNearestLT(const NodeType* node);
         static NodeType* findNearestGT(const NodeType* node);
+        static NodeType* findNext(const NodeType* node);    // in-order successor
+        static NodeType* findPrev(const NodeType* node);    // in-order predecessor
+        template<class T>
+        static const KeyType& keyOf(const T& item);     // key of a KeyType or of an Entry
+        static size_t sizeOf(const NodeType* node);
+        size_t countNotGreater(const KeyType& key) const;
+        static void updateSubtree(NodeType* node);  // post-order update() of a whole subtree
+        static size_t countNodes(const NodeType* node);
+        static NodeType* detach(NodeType* node);    // clears the parent link of a subtree root
+        static NodeType* settleRoot(NodeType* node);    // makes a subtree root valid as a tree root
+        // Exchanges the places of a and b in the tree: links, colors, ranks and augmentations. Keys,
+        // mapped values and tombstone marks stay, so erases move nodes instead of payloads and handles hold
+        void exchange(NodeType* a, NodeType* b);
+        static bool isDead(const NodeType* node);
+
+        // Lazy deletion. markDead turns the node of key into a tombstone and rebuilds the tree once
+        // tombstones make up more than rebuildThreshold of it; revive brings a tombstone back
+        bool markDead(const KeyType& key);
+        bool markDead(NodeType* node);
+        const NodeType* revive(NodeType* node, const MappedType& value);
+        void recountDead();
+
+        template<class... Args>
+        NodeType* createNode(Args&&... args);
+        void destroyNode(NodeType* node);
+
+        // Node made of *it, a key for sets and a (key, value) pair for maps. Args go to the node
+        // constructor after the value
+        template<class Iterator, class... Args>
+        NodeType* createFrom(Iterator it, Args&&... args);
+        template<class Iterator, class... Args>
+        static NodeType* createIn(Arena& arena, Iterator it, Args&&... args);
+        // Perfectly balanced subtree of the next count elements of it, calls visit(node, depth) on each node.
+        // Random access runs are built by buildRange
+        template<class Iterator, class Visit>
+        NodeType* buildBalanced(Iterator& it, size_t count, uint32_t depth, Visit&& visit);
+        // Halves of at least the scheduler's grain are built in parallel, the second one in an arena of its own
+        // that is spliced into arena once both are done
+        template<class Iterator, class Visit>
+        static NodeType* buildRange(Arena& arena, Iterator begin, size_t count, uint32_t depth, Visit& visit);
+
+        // First node not less than (or, for upperBound, greater than) key. last is the last node visited
+        NodeType* lowerBound(const KeyType& key, NodeType*& last) const;
+        NodeType* upperBound(const KeyType& key, NodeType*& last) const;
+
+        // Join-based primitives, the engines supply joinNodes(l, mid, r) for keys of l < mid < r.
+        // splitNodes cuts a subtree into keys less and greater than key and returns the node equal to key
+        NodeType* splitNodes(NodeType* node, const KeyType& key, NodeType*& l, NodeType*& r) const;
+        static NodeType* splitLast(NodeType* node, NodeType*& last);
+        static NodeType* join2(NodeType* l, NodeType* r);
+
+        // Divide and conquer set operations on subtrees. Nodes left over go to garbage
+        NodeType* uniteNodes(NodeType* a, NodeType* b, std::vector<NodeType*>& garbage, uint32_t depth) const;
+        NodeType* intersectNodes(NodeType* a, NodeType* b, std::vector<NodeType*>& garbage, uint32_t depth) const;
+        NodeType* subtractNodes(NodeType* a, NodeType* b, std::vector<NodeType*>& garbage, uint32_t depth) const;
+        // Set operations fork while both inputs together hold at least the scheduler's grain of nodes
+        static bool forkable(const NodeType* a, const NodeType* b, uint32_t depth);
+        static void collect(NodeType* node, std::vector<NodeType*>& out);
+
+        // Moves the nodes of other into this tree's arena (splicing the arena, or copying the nodes if
+        // the arena is shared) and returns its root. other is left empty
+        NodeType* adopt(Tree& other);
+        NodeType* cloneSubtree(const NodeType* node);
+
+        // Statistics of the subtree of node, whose keys must lie between the bounds given
+        TreeStatistics subtreeStatistics(const NodeType* node, const NodeType* parent, const KeyType* lo,
+                                         const KeyType* hi) const;
+
+        void destroyAll();
+        std::vector<Entry> entries() const;  // in-order contents
+        // Sorted distinct random keys, none of them present in the sorted run skip
+        std::vector<KeyType> randomKeys(size_t n, const std::vector<Entry>& skip) const;
     public:
-        Tree(NodeType* tree = nullptr);
+        // Stable reference to a node, as returned by insert. It stays valid until its node is erased
+        // or the tree is rebuilt (buildFromSorted, a large insertRandom batch, purge)
+        class Handle
+        {
+            const NodeType* node;
+        public:
+            Handle(const NodeType* node = nullptr);
 
-        virtual const NodeType* insert(size_t val) = 0;
+            operator const NodeType*() const;
+            const NodeType* operator->() const;
+        };
+
+        // Bidirectional in-order iterator over the nodes. Steps follow the parent links, amortized O(1)
+        class iterator
+        {
+            friend class Tree;
+
+            const NodeType* node;
+            const Tree* owner;  // to step back from end()
+
+            iterator(const NodeType* node, const Tree* owner);
+        public:
+            using iterator_category = std::bidirectional_iterator_tag;
+            using value_type = NodeType;
+            using difference_type = std::ptrdiff_t;
+            using pointer = const NodeType*;
+            using reference = const NodeType&;
+
+            iterator();
+
+            reference operator*() const;
+            pointer operator->() const;
+
+            iterator& operator++();
+            iterator operator++(int);
+            iterator& operator--();
+            iterator operator--(int);
+
+            bool operator==(const iterator& other) const;
+            bool operator!=(const iterator& other) const;
+        };
+        using const_iterator = iterator;
+    protected:
+        iterator makeIterator(const NodeType* node) const;
+    public:
+        Tree(const Compare& comp = Compare());
+        Tree(const Tree&) = delete;
+        Tree(Tree&& other);
+        Tree& operator=(const Tree&) = delete;
+        Tree& operator=(Tree&& other);
+        ~Tree();
+
+        // Inserts n new random keys. The keys are generated, sorted and deduplicated in parallel, then
+        // the tree is bulk built from the merged run, or for small batches the keys are inserted in order
         void insertRandom(size_t n);
-        virtual bool erase(size_t val) = 0;
+        // Replaces the tree with the elements of [begin, end), which must be strictly ascending, in O(n)
+        template<class Iterator>
+        void buildFromSorted(Iterator begin, Iterator end);
+        void clear();
+
+        // With Augment::tombstones: rebuilds the tree without its tombstones, in O(n)
+        void purge();
+        void setRebuildThreshold(double threshold);
+
+        // Keys not less than key move to the returned tree in O(log n), which shares the arena of this one
+        Derived split(const KeyType& key);
+        // Tree of left, key and right, which must hold keys less and greater than key respectively
+        static Derived join(Derived&& left, const KeyType& key, Derived&& right, const MappedType& value = MappedType());
+
+        // Set operations, other is consumed. On equal keys the node of this tree is kept.
+        // Large inputs are processed on the workers of the current scheduler
+        void unite(Derived&& other);
+        void intersect(Derived&& other);
+        void subtract(Derived&& other);
+
+        // Erase through a handle: the engine unlinks the node where it is, without a search from the root
+        bool erase(Handle node);
+        // Gives node a new key. A key still between the neighbours of node is rewritten in place, otherwise
+        // the node is erased and the key inserted again, under the returned handle. Returns nullptr and
+        // leaves the tree as it was if another node has the key
+        const NodeType* updateKey(Handle node, const KeyType& key);
 
+        size_t size() const;
         const NodeType* rootPtr() const;
+        // Walks the whole tree, large subtrees in parallel
+        TreeStatistics statistics() const;
+
+        iterator begin() const;
+        iterator end() const;
+
+        iterator find(const KeyType& key) const;
+        bool contains(const KeyType& key) const;
+        iterator lower_bound(const KeyType& key) const;     // first node not less than key
+        iterator upper_bound(const KeyType& key) const;     // first node greater than key
+
+        // Order statistics in O(height), they need subtree sizes (Augment::size). Ranks start from 0
+        const NodeType* select(size_t k) const;     // k-th smallest node, nullptr if k >= size()
+        size_t rank(const KeyType& key) const;      // number of keys less than key
+        size_t countInRange(const KeyType& lo, const KeyType& hi) const;  // number of keys in [lo, hi]
+        const NodeType* percentile(double p) const; // nearest-rank percentile, p in [0, 1]
+
+        // Aggregate of the keys (mapped values) in [lo, hi] in O(height), it needs a Monoid in the augmentation
+        typename NodeType::AugmentPolicy::MonoidPolicy::Type aggregate(const KeyType& lo, const KeyType& hi) const;
     };
 
 
-    class AVLTree : public Tree
+    template<class Key = size_t, class Value = void, class Compare = std::less<Key>,
+             class Augment = FullAugmentation, class Layout = PointerLayout>
+    class AVLTree : public Tree<AVLTree<Key, Value, Compare, Augment, Layout>,
+                                Node<Key, Value, Augmentation<true, Augment::size, Augment::tombstones, typename Augment::MonoidPolicy>, Layout>, Compare>
     {
     public:
-        using NodeType = Node;
+        using NodeType = Node<Key, Value, Augmentation<true, Augment::size, Augment::tombstones, typename Augment::MonoidPolicy>, Layout>;
+        using typename Tree<AVLTree, NodeType, Compare>::MappedType;
     private:
+        using Base = Tree<AVLTree, NodeType, Compare>;
+        using Base::tree;
+        using Base::comp;
+
         enum class BalancingTypes
         {
             None, Left, Right, LargeLeft, LargeRight
         };
 
+        friend Base;
+
+        static long long height(const NodeType* node);
         static BalancingTypes checkBalance(const NodeType* node);
         static NodeType* balanceUp(NodeType*& node);
+        // mid is hung off the spine of the taller tree where the heights meet, then rebalanced up
+        static NodeType* joinNodes(NodeType* l, NodeType* mid, NodeType* r);
+        void eraseNode(NodeType* p);
+    public:
+        using Base::erase;
+
+        AVLTree(const Compare& comp = Compare());
+
+        const NodeType* insert(const Key& key, const MappedType& value = MappedType());
+        bool erase(const Key& key);
+    };
+
+    template<class Key = size_t, class Value = void, class Compare = std::less<Key>,
+             class Augment = FullAugmentation, class Layout = PointerLayout>
+    class RBTree : public Tree<RBTree<Key, Value, Compare, Augment, Layout>,
+                               RBNode<Key, Value, Augment, Layout>, Compare>
+    {
+    public:
+        using NodeType = RBNode<Key, Value, Augment, Layout>;
+        using typename Tree<RBTree, NodeType, Compare>::MappedType;
+    private:
+        using Base = Tree<RBTree, NodeType, Compare>;
+        using Base::tree;
+        using Base::comp;
+
+        static NodeType* grandparent(const NodeType* node);
+        static NodeType* uncle(const NodeType* node);
+
+        static NodeType* insertBalance(NodeType*& node);
+        // Bottom-up erase: node took the place of a removed black node under parent, node may be null
+        void eraseBalance(NodeType* node, NodeType* parent);
+        void eraseNode(NodeType* p);
+
+        // Top-down insert and erase helpers. lift rotates the right (or left) child of node above it,
+        // the child takes over the size of node. resize adjusts the size of a node on the search path
+        static bool isRed(const NodeType* node);
+        static NodeType* lift(NodeType* node, bool right);
+        static void resize(NodeType* node, int delta);
+
+        friend Base;
+
+        static size_t blackHeight(const NodeType* node);
+        // mid goes red into the spine of the tree with more black nodes, where the black heights meet
+        static NodeType* joinNodes(NodeType* l, NodeType* mid, NodeType* r);
+    public:
+        using Base::erase;
+
+        RBTree(const Compare& comp = Compare());
+
+        template<class Iterator>
+        void buildFromSorted(Iterator begin, Iterator end);
+
+        const NodeType* insert(const Key& key, const MappedType& value = MappedType());
+        bool erase(const Key& key);
+    };
+
+    template<class Key = size_t, class Value = void, class Compare = std::less<Key>,
+             class Augment = FullAugmentation, class Layout = PointerLayout>
+    class Treap : public Tree<Treap<Key, Value, Compare, Augment, Layout>,
+                              TreapNode<Key, Value, Augment, Layout>, Compare>
+    {
+    public:
+        using NodeType = TreapNode<Key, Value, Augment, Layout>;
+        using typename Tree<Treap, NodeType, Compare>::MappedType;
+    private:
+        using Base = Tree<Treap, NodeType, Compare>;
+        using Base::tree;
+        using Base::comp;
+
+        friend Base;
+
+        static thread_local std::mt19937 rng;   // per thread, so trees on different threads do not share it
+
+        static NodeType* merge(NodeType* l, NodeType* r);
+        static NodeType* joinNodes(NodeType* l, NodeType* mid, NodeType* r);
+        NodeType* splitNodes(NodeType* node, const Key& key, NodeType*& l, NodeType*& r) const;
+        // Keys less than key (or not greater, if inclusive) go to l, the rest to r
+        void split(NodeType* tree, const Key& key, NodeType*& l, NodeType*& r, bool inclusive = false) const;
+        // Cartesian tree of [begin, end) built with a stack of its right spine, prior() gives the priorities
+        template<class Iterator, class Priority>
+        void buildCartesian(Iterator begin, Iterator end, Priority&& prior);
+        void eraseNode(NodeType* p);
+    public:
+        using Base::split;
+        using Base::erase;
+
+        Treap(const Compare& comp = Compare());
+
+        template<class Iterator>
+        void buildFromSorted(Iterator begin, Iterator end);
+        // Takes the priorities of the nodes from priors, one per element
+        template<class Iterator, class PriorIterator>
+        void buildFromSorted(Iterator begin, Iterator end, PriorIterator priors);
+
+        const NodeType* insert(const Key& key, const MappedType& value = MappedType());
+        const NodeType* insert(const Key& key, const MappedType& value, uint32_t prior);
+        bool erase(const Key& key);
+    };
+
+    // Sequence on a treap ordered by position instead of keys. Inserting or erasing at an index, reversing
+    // a range and adding to or assigning over one take O(log n), as do sums and minimums of ranges.
+    // Ranges are half-open and clamped to the size, queries over empty ones give T()
+    template<class T = long long>
+    class ImplicitTreap
+    {
+    public:
+        using NodeType = ImplicitTreapNode<T>;
+    private:
+        NodeType* tree;
+        arena::NodeArena<NodeType> pool;
+
+        static thread_local std::mt19937 rng;
+
+        static size_t sizeOf(const NodeType* node);
+        static void applyReverse(NodeType* node);
+        static void applyAssign(NodeType* node, const T& value);
+        static void applyAdd(NodeType* node, const T& delta);
+        static void push(NodeType* node);
+        static NodeType* merge(NodeType* l, NodeType* r);
+        // The first k elements go to l, the rest to r
+        static void split(NodeType* tree, size_t k, NodeType*& l, NodeType*& r);
+        // Cuts [lo, hi) out, calls f with the root of its subtree and puts it back
+        template<class F>
+        void onRange(size_t lo, size_t hi, F&& f);
+    public:
+        ImplicitTreap();
+        ImplicitTreap(const ImplicitTreap&) = delete;
+        ImplicitTreap& operator=(const ImplicitTreap&) = delete;
+        ~ImplicitTreap();
+
+        // Cartesian tree of [begin, end) built in O(n) with a stack of its right spine
+        template<class Iterator>
+        void build(Iterator begin, Iterator end);
+        void clear();
+
+        size_t size() const;
+        bool empty() const;
+        const NodeType* rootPtr() const;
+
+        // Element at position i, none if i is out of range
+        std::optional<T> at(size_t i);
+        std::vector<T> values();
+
+        void insert(size_t i, const T& value);
+        void pushBack(const T& value);
+        bool erase(size_t i);
+        void erase(size_t lo, size_t hi);
+
+        void reverse(size_t lo, size_t hi);
+        void add(size_t lo, size_t hi, const T& delta);
+        void assign(size_t lo, size_t hi, const T& value);
+        T sum(size_t lo, size_t hi);
+        T min(size_t lo, size_t hi);
+    };
+
+    // Weak AVL tree. Nodes keep the rank differences to their children (1 or 2) in two bits. Without
+    // erases it is an AVL tree, an erase does at most two rotations
+    template<class Key = size_t, class Value = void, class Compare = std::less<Key>,
+             class Augment = FullAugmentation, class Layout = PointerLayout>
+    class WAVLTree : public Tree<WAVLTree<Key, Value, Compare, Augment, Layout>,
+                                 WAVLNode<Key, Value, Augment, Layout>, Compare>
+    {
+    public:
+        using NodeType = WAVLNode<Key, Value, Augment, Layout>;
+        using typename Tree<WAVLTree, NodeType, Compare>::MappedType;
+    private:
+        using Base = Tree<WAVLTree, NodeType, Compare>;
+        using Base::tree;
+        using Base::comp;
+
+        friend Base;
+
+        static bool twoBelow(const NodeType* node, bool right);    // rank difference bit of a child
+        static void setTwoBelow(NodeType* node, bool right, bool value);
+        static long long rankOf(const NodeType* node);
+        static NodeType* lift(NodeType* node, bool right);  // rotates the right (or left) child above node
+        static int assignRanks(NodeType* node);
+
+        // Rebalancing after node got the rank of its parent, or after the right (or left) child of node
+        // dropped three ranks below it. Both return the topmost node they touched
+        static NodeType* fixZeroChild(NodeType* node);
+        static NodeType* fixThreeChild(NodeType* node, bool right);
+
+        // mid hangs off the spine of the higher ranked tree where the ranks meet, then promotes up
+        static NodeType* joinNodes(NodeType* l, NodeType* mid, NodeType* r);
+        // Settles the root after rebalancing from node, updating its path when augmented
+        void settle(NodeType* node, NodeType* top);
+        void eraseNode(NodeType* y);
+    public:
+        using Base::erase;
+
+        WAVLTree(const Compare& comp = Compare());
+
+        template<class Iterator>
+        void buildFromSorted(Iterator begin, Iterator end);
+
+        const NodeType* insert(const Key& key, const MappedType& value = MappedType());
+        bool erase(const Key& key);
+    };
+
+    // Scapegoat tree. Nodes hold no balance data besides the subtree sizes (kept regardless of Augment),
+    // there are no rotations: a subtree found alpha-unbalanced is rebuilt perfectly balanced in linear time
+    template<class Key = size_t, class Value = void, class Compare = std::less<Key>,
+             class Augment = FullAugmentation, class Layout = PointerLayout>
+    class ScapegoatTree : public Tree<ScapegoatTree<Key, Value, Compare, Augment, Layout>,
+                                      Node<Key, Value, Augmentation<Augment::height, true, Augment::tombstones, typename Augment::MonoidPolicy>, Layout>, Compare>
+    {
+    public:
+        using NodeType = Node<Key, Value, Augmentation<Augment::height, true, Augment::tombstones, typename Augment::MonoidPolicy>, Layout>;
+        using typename Tree<ScapegoatTree, NodeType, Compare>::MappedType;
+    private:
+        using Base = Tree<ScapegoatTree, NodeType, Compare>;
+        using Base::tree;
+        using Base::comp;
+        using Base::count;
+
+        friend Base;
+
+        // Joins are static and have no alpha at hand, they balance to this one
+        static constexpr double JoinBalance = .75;
+
+        double balance;         // alpha
+        double depthFactor;     // 1 / log(1 / alpha)
+        size_t maxCount;        // largest count since the last full rebuild
+
+        static bool unbalanced(const NodeType* node, double alpha);
+        // Relinks the nodes of a subtree into a perfectly balanced one in place, returns its root
+        static NodeType* rebuild(NodeType* node);
+        static NodeType* linkBalanced(NodeType** nodes, size_t count);
+        // mid hangs off the spine of the larger tree where the sizes fit alpha, the topmost
+        // unbalanced node above it is rebuilt
+        static NodeType* joinNodes(NodeType* l, NodeType* mid, NodeType* r);
+        void eraseNode(NodeType* y);
     public:
-        AVLTree();
+        using Base::erase;
+
+        ScapegoatTree(const Compare& comp = Compare(), double alpha = .7);
+
+        // alpha in [0.5, 1): a child may hold at most alpha of its parent's subtree. Lower values
+        // keep the tree lower at the cost of more frequent rebuilds
+        void setAlpha(double alpha);
+        double alpha() const;
 
-        const NodeType* insert(size_t val) override;
-        bool erase(size_t val) override;
+        const NodeType* insert(const Key& key, const MappedType& value = MappedType());
+        bool erase(const Key& key);
+    };
+
+    // Restructuring done by SplayTree on access. BottomUp splays the accessed node with zig-zig and
+    // zig-zag steps along its parent links, TopDown splays while descending from the root, Semi
+    // lifts only the parent in zig-zig steps, which halves the depth of the path instead
+    enum class SplayMode
+    {
+        BottomUp, TopDown, Semi
     };
 
-    class RBTree : public Tree
+    template<class Key = size_t, class Value = void, class Compare = std::less<Key>,
+             class Augment = FullAugmentation, class Layout = PointerLayout>
+    class SplayTree : public Tree<SplayTree<Key, Value, Compare, Augment, Layout>,
+                                  Node<Key, Value, Augment, Layout>, Compare>
     {
+    public:
+        using NodeType = Node<Key, Value, Augment, Layout>;
+        using typename Tree<SplayTree, NodeType, Compare>::MappedType;
     private:
-        class RBNode : public Node
+        using Base = Tree<SplayTree, NodeType, Compare>;
+        using Base::tree;
+        using Base::comp;
+
+        friend Base;
+
+        static NodeType* joinNodes(NodeType* l, NodeType* mid, NodeType* r);
+
+        static thread_local std::mt19937 rng;
+
+        SplayMode mode;
+        double probability;
+
+        // Rotates node above its parent, updating the parent only. Splaying updates the node once at the end
+        static void rotateUp(NodeType* node);
+        // Bottom-up (or semi) splay of node to the root
+        NodeType* splay(NodeType* node);
+        // Top-down splay of the last node on the search path of key
+        NodeType* splayKey(const Key& key);
+        bool splayNow();
+        // First node not less than (or, if upper, greater than) key, splayed with the probability set
+        NodeType* bound(const Key& key, bool upper);
+        void eraseNode(NodeType* p);
+    public:
+        using typename Base::iterator;
+        using Base::find;
+        using Base::contains;
+        using Base::lower_bound;
+        using Base::upper_bound;
+        using Base::erase;
+
+        SplayTree(const Compare& comp = Compare());
+
+        // Lookups splay only with the given probability, inserts and erases always restructure
+        void setSplayMode(SplayMode mode, double probability = 1.);
+        SplayMode splayMode() const;
+
+        // Lookups on a non-const splay tree splay the node they reach
+        iterator find(const Key& key);
+        bool contains(const Key& key);
+        iterator lower_bound(const Key& key);
+        iterator upper_bound(const Key& key);
+
+        const NodeType* insert(const Key& key, const MappedType& value = MappedType());
+        bool erase(const Key& key);
+    };
+
+    // B+-tree. Not a Tree: nodes hold up to Capacity keys, so lookups take a cache miss or a few per
+    // level instead of one per key compared. Keys and mapped values must be default constructible
+    template<class Key = size_t, class Value = void, class Compare = std::less<Key>, size_t KeyBytes = 256>
+    class BTree
+    {
+    public:
+        using NodeType = BTreeNode<Key, KeyBytes>;
+        using LeafType = BTreeLeaf<Key, Value, KeyBytes>;
+        using InnerType = BTreeInner<Key, KeyBytes>;
+        using KeyType = Key;
+        using MappedType = std::conditional_t<std::is_void<Value>::value, NoValue, Value>;
+    private:
+        using Entry = std::conditional_t<std::is_void<Value>::value, Key, std::pair<Key, MappedType>>;
+
+        static constexpr uint32_t Capacity = NodeType::Capacity, MinCount = Capacity / 2;
+        static constexpr uint32_t MaxDepth = 48;    // fanout is at least MinCount + 1
+        // In-node search is vectorized for 32 and 64-bit integer keys in the natural order
+        static constexpr bool Vectorized = std::is_integral<Key>::value && (sizeof(Key) == 4 || sizeof(Key) == 8) &&
+                                           std::is_same<Compare, std::less<Key>>::value;
+
+        // Inner nodes passed on the way down and the child taken at each of them
+        struct Path
         {
+            InnerType* nodes[MaxDepth];
+            uint32_t slots[MaxDepth];
+            uint32_t depth;
+        };
+
+        NodeType* tree;
+        LeafType* head, * tail;     // ends of the leaf chain
+        arena::NodeArena<LeafType, 256> leafPool;
+        arena::NodeArena<InnerType, 64> innerPool;
+        Compare comp;
+
+        // Number of keys of node less than (or, with OrEqual, not greater than) key
+        template<bool OrEqual>
+        uint32_t search(const NodeType* node, const Key& key) const;
+        LeafType* descend(const Key& key, Path* path) const;    // leaf where key belongs, path may be null
+        template<bool OrEqual>
+        size_t countBelow(const Key& key) const;
+
+        LeafType* createLeaf();
+        InnerType* createInner(uint32_t h);
+        void destroySubtree(NodeType* node);
+        static size_t childrenSize(const InnerType* node);
+
+        static void insertAt(LeafType* leaf, uint32_t i, const Key& key, const MappedType& value);
+        static void moveEntries(LeafType* from, uint32_t i, LeafType* to, uint32_t j, uint32_t count);
+        LeafType* splitLeaf(LeafType* leaf);
+        // Inserts sep and the child right after it at slot of a full node, the upper half moves to the
+        // returned node and its first key to sep
+        InnerType* splitInner(InnerType* node, uint32_t slot, Key& sep, NodeType* child);
+        // Refills node, child slot of parent, from a sibling or merges it with one
+        void rebalance(InnerType* parent, uint32_t slot);
+
+        template<class T>
+        static const Key& keyOf(const T& item);
+    public:
+        // Bidirectional in-order iterator over the keys, steps along the leaf chain
+        class iterator
+        {
+            friend class BTree;
+
+            const LeafType* leaf;
+            uint32_t slot;
+            const BTree* owner;     // to step back from end()
+
+            iterator(const LeafType* leaf, uint32_t slot, const BTree* owner);
         public:
-            bool red;
+            using iterator_category = std::bidirectional_iterator_tag;
+            using value_type = Key;
+            using difference_type = std::ptrdiff_t;
+            using pointer = const Key*;
+            using reference = const Key&;
+
+            iterator();
 
-            RBNode(size_t elem, RBNode* parent = nullptr, bool red = true, size_t h = 1, size_t n = 1,
-                RBNode* l = nullptr, RBNode* r = nullptr);
+            reference operator*() const;
+            pointer operator->() const;
+            const MappedType& value() const;    // mapped value, for maps
 
-            void draw(sf::RenderWindow* window, const scc::Canvas& canvas,
-                      auxillary::vec2 coordinate, sf::FloatRect* outBoundary) const override;
+            iterator& operator++();
+            iterator operator++(int);
+            iterator& operator--();
+            iterator operator--(int);
+
+            bool operator==(const iterator& other) const;
+            bool operator!=(const iterator& other) const;
         };
+        using const_iterator = iterator;
+
+        BTree(const Compare& comp = Compare());
+        BTree(const BTree&) = delete;
+        BTree& operator=(const BTree&) = delete;
+        ~BTree();
+
+        void insertRandom(size_t n);
+        // Replaces the tree with the elements of [begin, end), which must be strictly ascending, in O(n)
+        template<class Iterator>
+        void buildFromSorted(Iterator begin, Iterator end);
+        void clear();
+
+        size_t size() const;
+        const NodeType* rootPtr() const;
+
+        iterator begin() const;
+        iterator end() const;
+
+        iterator find(const Key& key) const;
+        bool contains(const Key& key) const;
+        iterator lower_bound(const Key& key) const;
+        iterator upper_bound(const Key& key) const;
+
+        // Order statistics from the subtree sizes of the nodes. Ranks start from 0
+        iterator select(size_t k) const;
+        size_t rank(const Key& key) const;
+        size_t countInRange(const Key& lo, const Key& hi) const;
+        iterator percentile(double p) const;
+
+        bool insert(const Key& key, const MappedType& value = MappedType());
+        bool erase(const Key& key);
+    };
+
+    // Adaptive radix tree over the bytes of integer keys, most significant first. Lookups take at most
+    // sizeof(Key) steps regardless of the size. Leaves are created lazily, one child under a prefix needs
+    // no inner node. Without subtree sizes there are no order statistics
+    template<class Key = size_t, class Value = void>
+    class ARTree
+    {
+        static_assert(std::is_integral<Key>::value, "ARTree keys are integers");
     public:
-        using NodeType = RBNode;
+        using NodeType = ARTNode;
+        using LeafType = ARTLeaf<Key, Value>;
+        using KeyType = Key;
+        using MappedType = typename LeafType::MappedType;
     private:
-        static NodeType*& ptrCast(Tree::NodeType*& node);
-        static NodeType* grandparent(const Tree::NodeType* node);
-        static NodeType* uncle(const Tree::NodeType* node);
+        using Entry = std::conditional_t<std::is_void<Value>::value, Key, std::pair<Key, MappedType>>;
 
-        static NodeType* insertBalance(NodeType*& node);
-        static void deleteBlackLeaf(NodeType* node);
+        static constexpr uint32_t KeyLength = sizeof(Key);
+
+        ARTNode* tree;
+        size_t count;
+        arena::NodeArena<LeafType> leafPool;
+        arena::NodeArena<ARTNode4, 256> pool4;
+        arena::NodeArena<ARTNode16, 256> pool16;
+        arena::NodeArena<ARTNode48, 64> pool48;
+        arena::NodeArena<ARTNode256, 16> pool256;
+
+        static uint8_t byteAt(const Key& key, uint32_t depth);
+        static const LeafType* asLeaf(const ARTNode* node);
+        static ARTNode** findChild(ARTNode* node, uint8_t byte);
+        // First child with a key byte greater than byte (or the last one less than byte), byte may be
+        // -1 (or 256) to get the first (or the last) child
+        static ARTNode* childAfter(const ARTNode* node, int byte);
+        static ARTNode* childBefore(const ARTNode* node, int byte);
+        static const LeafType* minimum(const ARTNode* node);
+        static const LeafType* maximum(const ARTNode* node);
+        // First leaf with a key greater than (or, with orEqual, not less than) key, last one less than key
+        static const LeafType* above(const ARTNode* node, const Key& key, uint32_t depth, bool orEqual);
+        static const LeafType* below(const ARTNode* node, const Key& key, uint32_t depth);
 
-        static void updateTree(NodeType* node);
+        template<class NodeT>
+        NodeT* createInner(const ARTNode* header);  // node copying the prefix of header
+        void destroyInner(ARTNode* node);
+        void destroySubtree(ARTNode* node);
+        // Insert into (remove from) the inner node at ref, which is replaced by a larger (smaller) one as needed
+        void addChild(ARTNode*& ref, uint8_t byte, ARTNode* child);
+        void removeChild(ARTNode*& ref, uint8_t byte);
+
+        template<class T>
+        static const Key& keyOf(const T& item);
     public:
-        RBTree();
+        // Bidirectional in-order iterator over the leaves, steps search the successor from the root
+        class iterator
+        {
+            friend class ARTree;
+
+            const LeafType* leaf;
+            const ARTree* owner;
 
-        const NodeType* insert(size_t val) override;
-        bool erase(size_t val) override;
+            iterator(const LeafType* leaf, const ARTree* owner);
+        public:
+            using iterator_category = std::bidirectional_iterator_tag;
+            using value_type = Key;
+            using difference_type = std::ptrdiff_t;
+            using pointer = const Key*;
+            using reference = const Key&;
+
+            iterator();
+
+            reference operator*() const;
+            pointer operator->() const;
+            const MappedType& value() const;    // mapped value, for maps
+
+            iterator& operator++();
+            iterator operator++(int);
+            iterator& operator--();
+            iterator operator--(int);
+
+            bool operator==(const iterator& other) const;
+            bool operator!=(const iterator& other) const;
+        };
+        using const_iterator = iterator;
+
+        ARTree();
+        ARTree(const ARTree&) = delete;
+        ARTree& operator=(const ARTree&) = delete;
+        ~ARTree();
+
+        // Calls f(byte, child) for the children of an inner node in key order
+        template<class F>
+        static void forEachChild(const ARTNode* node, F&& f);
+
+        void insertRandom(size_t n);
+        template<class Iterator>
+        void buildFromSorted(Iterator begin, Iterator end);
+        void clear();
+
+        size_t size() const;
+        const NodeType* rootPtr() const;
+
+        iterator begin() const;
+        iterator end() const;
+
+        iterator find(const Key& key) const;
+        bool contains(const Key& key) const;
+        iterator lower_bound(const Key& key) const;
+        iterator upper_bound(const Key& key) const;
+
+        bool insert(const Key& key, const MappedType& value = MappedType());
+        bool erase(const Key& key);
     };
 
-    class Treap : public Tree
+    // Base class for the persistent trees. Every insert or erase makes a new version in O(log n) time
+    // and space by path copying, through the split and join of the engines. Versions form a linear
+    // history to step through; a new operation after undo drops the versions ahead. Nodes held only
+    // once are updated in place, so with no history kept the trees work like ephemeral ones
+    template<class Derived, class NodeT, class Compare>
+    class PersistentTree
     {
-    private:
-        static std::mt19937 rng;
+    public:
+        using NodeType = NodeT;
+        using KeyType = typename NodeType::KeyType;
+        using MappedType = typename NodeType::MappedType;
+    protected:
+        // Nodes are released by whichever thread drops their last reference, the arena is locked for it
+        struct Pool
+        {
+            arena::NodeArena<NodeType> arena;
+            std::mutex mutex;
+        };
+
+        std::shared_ptr<Pool> pool;     // snapshots keep it alive
+        Compare comp;
+        std::deque<NodeType*> history;  // roots of the versions, each holding a reference
+        size_t current;
+        size_t historyLimit;
+
+        static uint32_t sizeOf(const NodeType* node);
+        static uint32_t height(const NodeType* node);
+        static NodeType* acquire(NodeType* node);
+        static void release(Pool& pool, NodeType* node);
+
+        template<class... Args>
+        NodeType* createNode(Args&&... args);
+        // Takes a reference to node and gives back a node held by the caller alone: node itself if it
+        // was, otherwise a copy of it (whose children gain a reference)
+        NodeType* open(NodeType* node);
+        // Rotates the right (or left) child of node, which must be held alone, above it
+        NodeType* lift(NodeType* node, bool right);
+
+        // Split and join. They take over the references passed to them and return the ones they make;
+        // mid must be held alone and is not copied. Engines supply joinNodes(l, mid, r) for l < mid < r
+        NodeType* splitNodes(NodeType* node, const KeyType& key, NodeType*& l, NodeType*& r);
+        NodeType* splitLast(NodeType* node, NodeType*& last);
+        NodeType* join2(NodeType* l, NodeType* r);
+        NodeType* settleRoot(NodeType* node);
 
-        class TreapNode : public Node
+        const NodeType* findNode(const NodeType* node, const KeyType& key) const;
+        // Inserts into (erases from) the tree of root, taking over the reference to it. inserted is
+        // the new node, nullptr if the key was present
+        NodeType* insertNode(NodeType* root, const KeyType& key, const MappedType& value, NodeType*& inserted);
+        NodeType* eraseNode(NodeType* root, const KeyType& key, bool& erased);
+        NodeType* take();               // reference to the root of the shown version, to update it
+        void commit(NodeType* root);    // makes root the next version
+    public:
+        // Counted reference to a version. It keeps the nodes of the version alive and unchanged, and may be
+        // read (and dropped) on any thread while the tree goes on
+        class Snapshot
         {
-        public:
-            size_t prior;
+            friend class PersistentTree;
+
+            std::shared_ptr<Pool> pool;
+            NodeType* root;
+            Compare comp;
 
-            TreapNode(size_t elem, size_t prior = -1, TreapNode* parent = nullptr, size_t h = 1, 
-                size_t n = 1, TreapNode* l = nullptr, TreapNode* r = nullptr);
+            Snapshot(const std::shared_ptr<Pool>& pool, NodeType* root, const Compare& comp);
+        public:
+            Snapshot();
+            Snapshot(const Snapshot& other);
+            Snapshot& operator=(Snapshot other);
+            ~Snapshot();
 
-            void draw(sf::RenderWindow* window, const scc::Canvas& canvas,
-                      auxillary::vec2 coordinate, sf::FloatRect* outBoundary) const override;
+            size_t size() const;
+            const NodeType* rootPtr() const;
+            const NodeType* find(const KeyType& key) const;
         };
+
+        PersistentTree(const Compare& comp = Compare());
+        PersistentTree(const PersistentTree&) = delete;
+        PersistentTree& operator=(const PersistentTree&) = delete;
+        ~PersistentTree();
+
+        // Each of them makes one version. insert returns the new node, nullptr if key was present
+        const NodeType* insert(const KeyType& key, const MappedType& value = MappedType());
+        bool erase(const KeyType& key);
+        void insertRandom(size_t n);
+        void clear();
+
+        // History. Versions are numbered from the oldest kept one, version() is the one shown
+        bool undo();
+        bool redo();
+        void checkout(size_t version);
+        size_t version() const;
+        size_t versions() const;
+        // Versions older than the last limit ones are released. 0 keeps no history: nodes are then
+        // held once and updated in place
+        void setHistoryLimit(size_t limit);
+
+        Snapshot snapshot() const;
+
+        size_t size() const;
+        const NodeType* rootPtr() const;
+        const NodeType* find(const KeyType& key) const;
+        bool contains(const KeyType& key) const;
+        const NodeType* select(size_t k) const;     // k-th smallest node, nullptr if k >= size()
+    };
+
+    template<class Key = size_t, class Value = void, class Compare = std::less<Key>>
+    class PersistentAVLTree : public PersistentTree<PersistentAVLTree<Key, Value, Compare>,
+                                                    PersistentNode<Key, Value>, Compare>
+    {
     public:
-        using NodeType = TreapNode;
+        using NodeType = PersistentNode<Key, Value>;
+        using typename PersistentTree<PersistentAVLTree, NodeType, Compare>::MappedType;
     private:
-        static NodeType* merge(NodeType* l, NodeType* r);
-        static void split(NodeType* tree, size_t key, NodeType*& l, NodeType*& r);
+        using Base = PersistentTree<PersistentAVLTree, NodeType, Compare>;
+        using Base::height;
+
+        friend Base;
+
+        static void update(NodeType* node);
+        NodeType* createLeaf(const Key& key, const MappedType& value);
+        // node is held alone, the heights of its children differ by two at most
+        NodeType* balance(NodeType* node);
+        NodeType* joinNodes(NodeType* l, NodeType* mid, NodeType* r);
+    public:
+        PersistentAVLTree(const Compare& comp = Compare());
+    };
+
+    template<class Key = size_t, class Value = void, class Compare = std::less<Key>>
+    class PersistentRBTree : public PersistentTree<PersistentRBTree<Key, Value, Compare>,
+                                                   PersistentNode<Key, Value, true>, Compare>
+    {
     public:
-        Treap();
+        using NodeType = PersistentNode<Key, Value, true>;
+        using typename PersistentTree<PersistentRBTree, NodeType, Compare>::MappedType;
+    private:
+        using Base = PersistentTree<PersistentRBTree, NodeType, Compare>;
+        using Base::height;
 
-        const NodeType* insert(size_t val) override;
-        const NodeType* insert(size_t val, size_t prior);
-        bool erase(size_t val) override;
+        friend Base;
+
+        static bool isRed(const NodeType* node);
+        static void update(NodeType* node);
+        NodeType* createLeaf(const Key& key, const MappedType& value);
+        NodeType* blacken(NodeType* node);
+        // Hangs low, with a black root and a lower black height, off the right (or left) spine of high
+        NodeType* joinSpine(NodeType* high, NodeType* mid, NodeType* low, bool right);
+        NodeType* joinNodes(NodeType* l, NodeType* mid, NodeType* r);
+        NodeType* settleRoot(NodeType* node);
+    public:
+        PersistentRBTree(const Compare& comp = Compare());
     };
 
-    class SplayTree : public Tree
+    template<class Key = size_t, class Value = void, class Compare = std::less<Key>>
+    class PersistentTreap : public PersistentTree<PersistentTreap<Key, Value, Compare>,
+                                                  PersistentNode<Key, Value, false, PriorityField>, Compare>
     {
+    public:
+        using NodeType = PersistentNode<Key, Value, false, PriorityField>;
+        using typename PersistentTree<PersistentTreap, NodeType, Compare>::MappedType;
     private:
-        static NodeType* splay(NodeType*& node);
-        static void zig(NodeType*& node);
-        static void zigzig(NodeType*& node);
-        static void zigzag(NodeType*& node);
+        using Base = PersistentTree<PersistentTreap, NodeType, Compare>;
+        using Base::height;
+
+        friend Base;
+
+        static thread_local std::mt19937 rng;
+
+        static void update(NodeType* node);
+        NodeType* createLeaf(const Key& key, const MappedType& value);
+        NodeType* merge(NodeType* l, NodeType* r);
+        NodeType* joinNodes(NodeType* l, NodeType* mid, NodeType* r);
     public:
-        using NodeType = Node;
+        PersistentTreap(const Compare& comp = Compare());
+    };
 
-        SplayTree();
+    // Thread-safe AVL set after Bronson et al., "A Practical Concurrent Binary Search Tree". Lookups take
+    // no locks: they descend hand over hand and check that neither node of the step was rotated meanwhile,
+    // retrying the step if it was. Updates lock only the nodes they link or rotate, parents first, and the
+    // balance is restored by local steps that may lag behind the updates. Unlinked nodes are kept until
+    // collect() or clear(), which must not run concurrently with any other operation
+    template<class Key = size_t, class Compare = std::less<Key>>
+    class ConcurrentAVLTree
+    {
+    public:
+        using NodeType = ConcurrentNode<Key>;
+        using KeyType = Key;
+    private:
+        enum class Outcome { Retry, Absent, Present };
+        // nodeCondition results, heights are positive
+        static constexpr int32_t UnlinkRequired = -1, RebalanceRequired = -2, NothingRequired = -3;
+
+        NodeType holder;    // sentinel, the root is its right child
+        Compare comp;
+        std::atomic<NodeType*> retired;
+
+        int compare(const Key& key, const NodeType* node) const;
+        static std::atomic<NodeType*>& side(NodeType* node, bool left);
+        static const NodeType* childOf(const NodeType* node, int dir);
+        static int32_t height(const NodeType* node);
+        static bool canUnlink(const NodeType* node);
+        static void waitUntilNotChanging(const NodeType* node);
+        void retire(NodeType* node);
+        static void destroy(NodeType* node);
+
+        // Descents from node, the child of its parent in direction dir, as validated at version nodeV
+        Outcome attemptFind(const Key& key, const NodeType* node, int dir, uint64_t nodeV) const;
+        Outcome attemptInsert(const Key& key, NodeType* node, int dir, uint64_t nodeV);
+        Outcome attemptErase(const Key& key, NodeType* node, int dir, uint64_t nodeV);
+        Outcome attemptLink(const Key& key, NodeType* node, int dir, uint64_t nodeV);
+        Outcome attemptRevive(NodeType* node);
+        Outcome attemptRemove(NodeType* parent, NodeType* node);
+
+        // Relaxed balancing. The steps below expect the locks of their node and its parent held and return the
+        // next node to fix, nullptr when done
+        static int32_t nodeCondition(const NodeType* node);
+        void fixHeightAndRebalance(NodeType* node);
+        bool unlink(NodeType* parent, NodeType* node);
+        NodeType* rebalance(NodeType* parent, NodeType* node, std::vector<NodeType*>& resume);
+        // heavy is the left (or right) child of node, taller than its sibling of height hLight by more than one.
+        // Rotations push their parent to resume, to fix its height once the nodes they leave off balance are
+        NodeType* rebalanceToSide(NodeType* parent, NodeType* node, NodeType* heavy, int32_t hLight, bool left,
+                                  std::vector<NodeType*>& resume);
+        NodeType* rotate(NodeType* parent, NodeType* node, NodeType* heavy, int32_t hLight, int32_t hOuter,
+                         NodeType* inner, int32_t hInner, bool left, std::vector<NodeType*>& resume);
+        NodeType* rotateDouble(NodeType* parent, NodeType* node, NodeType* heavy, int32_t hLight, int32_t hOuter,
+                               NodeType* inner, int32_t hInnerOuter, bool left, std::vector<NodeType*>& resume);
+    public:
+        ConcurrentAVLTree(const Compare& comp = Compare());
+        ConcurrentAVLTree(const ConcurrentAVLTree&) = delete;
+        ConcurrentAVLTree& operator=(const ConcurrentAVLTree&) = delete;
+        ~ConcurrentAVLTree();
 
-        const NodeType* insert(size_t val) override;
-        bool erase(size_t val) override;
+        bool insert(const Key& key);
+        bool erase(const Key& key);
+        bool contains(const Key& key) const;
+        // Inserts n new random keys, on the workers of the current scheduler
+        void insertRandom(size_t n);
+
+        // Quiescent operations
+        void clear();
+        void collect();     // frees the unlinked nodes
+        size_t size() const;    // in O(n)
+        const NodeType* rootPtr() const;
+    };
+
+    // One of the trees above behind a readers-writer lock, so that lookups run in parallel. Not for SplayTree,
+    // whose lookups restructure it. The baseline ConcurrentAVLTree is measured against
+    template<class TreeType>
+    class LockedTree
+    {
+    public:
+        using KeyType = typename TreeType::KeyType;
+    private:
+        TreeType tree;
+        mutable std::shared_mutex mutex;
+    public:
+        bool insert(const KeyType& key);
+        bool erase(const KeyType& key);
+        bool contains(const KeyType& key) const;
+        void insertRandom(size_t n);
+        void clear();
+        size_t size() const;
+    };
+
+    // Forest of trees (AVLTree, RBTree, Treap or SplayTree) over contiguous key ranges, each shard with a worker
+    // thread of its own. Updates are routed by key to the queue of their shard and applied by its worker in
+    // batches, so ingest from several threads scales with the shards while the trees stay single-threaded.
+    // Queries see every update queued before them. Once a shard outgrows the others, the boundaries move to
+    // even them out, and the keys crossing a boundary move by split and unite
+    template<class TreeType, class Compare = std::less<typename TreeType::KeyType>>
+    class ShardedTree
+    {
+    public:
+        using NodeType = typename TreeType::NodeType;
+        using KeyType = typename TreeType::KeyType;
+    private:
+        // A shard is skewed when it holds more than SkewFactor times the average, and at least MinSkewedSize keys
+        static constexpr double SkewFactor = 1.5;
+        static constexpr size_t MinSkewedSize = 64;
+
+        struct Request
+        {
+            KeyType key;
+            bool erase;
+            std::atomic<size_t>* added = nullptr;   // counts the inserts that found the key absent
+        };
+
+        struct Shard
+        {
+            TreeType tree;
+            std::mutex treeMutex;   // held while a batch is applied or the tree is read
+            std::mutex queueMutex;
+            std::condition_variable ready, drained;
+            std::vector<Request> queue;
+            size_t queued = 0, applied = 0;     // requests routed here so far, and applied
+            size_t queuedInserts = 0;
+            std::atomic<size_t> estimate{0};    // upper bound of the tree size once the queue is applied
+            bool stopping = false;
+            std::thread worker;
+        };
+
+        std::vector<std::unique_ptr<Shard>> shards;
+        // First key of every shard but the first. Until the first rebalance there may be fewer, and the shards
+        // past them stay empty
+        std::vector<KeyType> bounds;
+        mutable std::shared_mutex boundsMutex;  // held shared to route and query, exclusively to move the bounds
+        Compare comp;
+
+        size_t route(const KeyType& key) const;
+        static size_t sizeOf(const Shard& shard);   // from the subtree size of the root
+        void run(Shard& shard);
+        void post(Shard& shard, const Request& request);
+        void post(Shard& shard, std::vector<Request>& requests);
+        // Routes the keys of [begin, end) in one pass and queues them with one lock per shard
+        template<class Iterator>
+        void postAll(Iterator begin, Iterator end, std::atomic<size_t>* added);
+        void wait(Shard& shard) const;  // until the requests queued to shard so far are applied
+        bool skewed() const;
+        void rebalanceIfSkewed();
+        // Moves the bounds to even ranks of the forest and rebuilds the shards. Expects boundsMutex held exclusively
+        // and the queues drained
+        void evenOut();
+    public:
+        explicit ShardedTree(size_t shardCount = 4, const Compare& comp = Compare());
+        ShardedTree(const ShardedTree&) = delete;
+        ShardedTree& operator=(const ShardedTree&) = delete;
+        ~ShardedTree();
+
+        // Updates are queued and return at once
+        void insert(const KeyType& key);
+        void erase(const KeyType& key);
+        template<class Iterator>
+        void insert(Iterator begin, Iterator end);
+        // Inserts n new random keys. Each batch is deduplicated and waited for, and keys the shards already held
+        // are made up for by the next one
+        void insertRandom(size_t n);
+        void clear();
+        void rebalance();   // evens the shards out now
+        void flush() const; // waits until the updates queued so far are applied
+
+        // Keys are returned by value, as a shard may change its nodes once the lock is released
+        std::optional<KeyType> find(const KeyType& key) const;
+        bool contains(const KeyType& key) const;
+        size_t size() const;
+
+        // Order statistics across the shards, which count in whole the shards before the one the answer is in
+        std::optional<KeyType> select(size_t k) const;
+        size_t rank(const KeyType& key) const;
+        size_t countInRange(const KeyType& lo, const KeyType& hi) const;
+
+        size_t shardCount() const;
+        // Statistics of the tree of the given shard, valid only if its keys are also routed to it
+        TreeStatistics statistics(size_t shard) const;
+        // Calls f with the tree of the given shard, which does not change meanwhile
+        template<class F>
+        void visit(size_t shard, F&& f) const;
     };
 }
+
+#include "trees.inl"
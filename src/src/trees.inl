@@ -0,0 +1,6085 @@
+// Template definitions of trees.h
+
+
+namespace trees
+{
+	#pragma region Node
+	template<class Derived, class Key, class Value, class Augment, class Layout, bool Colored, class Extra>
+	BasicNode<Derived, Key, Value, Augment, Layout, Colored, Extra>::BasicNode(
+		const Key& elem, const MappedType& value, Derived* parent, bool red
+	)
+		: ValueField<Value>(value), parent(parent), l(nullptr), r(nullptr), elem(elem)
+	{
+		if constexpr (Augment::size)
+			this->n = 1;
+		if constexpr (Augment::height || Colored || Augment::tombstones)
+			this->h = 1, this->red = red, this->dead = false;
+		if constexpr (Augment::size && Augment::tombstones)
+			this->live = 1;
+		if constexpr (Augment::aggregated)
+			this->agg = ownAggregate();
+	}
+
+	template<class Derived, class Key, class Value, class Augment, class Layout, bool Colored, class Extra>
+	void BasicNode<Derived, Key, Value, Augment, Layout, Colored, Extra>::update()
+	{
+		const Derived* l = this->l, * r = this->r;
+		if constexpr (Augment::height)
+			this->h = std::max<uint32_t>(l == nullptr ? 0 : l->h, r == nullptr ? 0 : r->h) + 1;
+		if constexpr (Augment::size)
+			this->n = (l == nullptr ? 0 : l->n) + (r == nullptr ? 0 : r->n) + 1;
+		if constexpr (Augment::size && Augment::tombstones)
+			this->live = (l == nullptr ? 0 : l->live) + (r == nullptr ? 0 : r->live) + !this->dead;
+		if constexpr (Augment::aggregated)
+		{
+			using Monoid = typename Augment::MonoidPolicy;
+			this->agg = ownAggregate();
+			if (l != nullptr)
+				this->agg = Monoid::combine(l->agg, this->agg);
+			if (r != nullptr)
+				this->agg = Monoid::combine(this->agg, r->agg);
+		}
+	}
+
+	template<class Derived, class Key, class Value, class Augment, class Layout, bool Colored, class Extra>
+	typename Augment::MonoidPolicy::Type BasicNode<Derived, Key, Value, Augment, Layout, Colored, Extra>::ownAggregate() const
+	{
+		using Monoid = typename Augment::MonoidPolicy;
+		if constexpr (Augment::tombstones)
+		{
+			if (this->dead)
+				return Monoid::identity();
+		}
+		if constexpr (std::is_void<Value>::value)
+			return (typename Monoid::Type)elem;
+		else
+			return (typename Monoid::Type)this->value;
+	}
+
+	template<class Derived, class Key, class Value, class Augment, class Layout, bool Colored, class Extra>
+	void BasicNode<Derived, Key, Value, Augment, Layout, Colored, Extra>::swapPayload(Derived* other)
+	{
+		std::swap(elem, other->elem);
+		if constexpr (!std::is_void<Value>::value)
+			std::swap(this->value, other->value);
+	}
+
+	template<class Key, class Value, class Augment, class Layout>
+	Node<Key, Value, Augment, Layout>::Node(const Key& elem, const MappedType& value, Node* parent)
+		: BasicNode<Node, Key, Value, Augment, Layout>(elem, value, parent) {}
+
+	template<class Key, class Value, class Augment, class Layout>
+	RBNode<Key, Value, Augment, Layout>::RBNode(const Key& elem, const MappedType& value, RBNode* parent, bool red)
+		: BasicNode<RBNode, Key, Value, Augment, Layout, true>(elem, value, parent, red) {}
+
+	template<class Key, class Value, class Augment, class Layout>
+	TreapNode<Key, Value, Augment, Layout>::TreapNode(
+		const Key& elem, const MappedType& value, uint32_t prior, TreapNode* parent
+	)
+		: BasicNode<TreapNode, Key, Value, Augment, Layout, false, PriorityField>(elem, value, parent)
+	{
+		this->prior = prior;
+	}
+
+	template<class Key, class Value, class Augment, class Layout>
+	WAVLNode<Key, Value, Augment, Layout>::WAVLNode(const Key& elem, const MappedType& value, WAVLNode* parent)
+		: BasicNode<WAVLNode, Key, Value, Augment, Layout, false, RankDifferenceField>(elem, value, parent)
+	{
+		this->ld = this->rd = 0;
+	}
+
+	template<class Key, class Value, bool Colored, class Extra>
+	PersistentNode<Key, Value, Colored, Extra>::PersistentNode(const Key& elem, const MappedType& value)
+		: SizeField(), PackedField(), Extra(), ValueField<Value>(value), l(nullptr), r(nullptr), elem(elem), refs(1) {}
+
+	template<class Key, class Value, bool Colored, class Extra>
+	PersistentNode<Key, Value, Colored, Extra>::PersistentNode(const PersistentNode& other)
+		: SizeField(other), PackedField(other), Extra(other), ValueField<Value>(other), l(other.l), r(other.r),
+		elem(other.elem), refs(1) {}
+	#pragma endregion
+
+	#pragma region CanvasNode
+	template<class Key, class Value, class Augment, class Layout>
+	CanvasNode::CanvasNode(const Node<Key, Value, Augment, Layout>* node, const auxillary::BoundingBox& box)
+		: box(box), style(Style::Plain), elem(node->elem), prior(0), h(node->h), n(node->n),
+		hasL(node->l != nullptr), hasR(node->r != nullptr), node(node) {}
+
+	template<class Key, class Value, class Augment, class Layout>
+	CanvasNode::CanvasNode(const RBNode<Key, Value, Augment, Layout>* node, const auxillary::BoundingBox& box)
+		: box(box), style(node->red ? Style::Red : Style::Black), elem(node->elem), prior(0), h(node->h),
+		n(node->n), hasL(node->l != nullptr), hasR(node->r != nullptr), node(node) {}
+
+	template<class Key, class Value, class Augment, class Layout>
+	CanvasNode::CanvasNode(const TreapNode<Key, Value, Augment, Layout>* node, const auxillary::BoundingBox& box)
+		: box(box), style(Style::Prioritized), elem(node->elem), prior(node->prior), h(node->h), n(node->n),
+		hasL(node->l != nullptr), hasR(node->r != nullptr), node(node) {}
+
+	template<class Key, class Value, class Augment, class Layout>
+	CanvasNode::CanvasNode(const WAVLNode<Key, Value, Augment, Layout>* node, const auxillary::BoundingBox& box)
+		: box(box), style(Style::Plain), elem(node->elem), prior(0), h(node->h), n(node->n),
+		hasL(node->l != nullptr), hasR(node->r != nullptr), node(node) {}
+
+	template<class Key, size_t KeyBytes>
+	CanvasNode::CanvasNode(const BTreeNode<Key, KeyBytes>* node, uint32_t slot, const auxillary::BoundingBox& box)
+		: box(box), style(Style::Cell), elem(node->keys[slot]), prior(0), h(node->h), n(node->n),
+		hasL(false), hasR(false), node(node) {}
+
+	template<class Key, class Value>
+	CanvasNode::CanvasNode(const ARTLeaf<Key, Value>* leaf, const auxillary::BoundingBox& box)
+		: box(box), style(Style::Plain), elem((size_t)leaf->key), prior(0), h(1), n(1), hasL(false), hasR(false),
+		node(leaf) {}
+
+	template<class Key, class Value, bool Colored>
+	CanvasNode::CanvasNode(const PersistentNode<Key, Value, Colored>* node, const auxillary::BoundingBox& box)
+		: box(box), style(!Colored ? Style::Plain : node->red ? Style::Red : Style::Black), elem(node->elem), prior(0),
+		h(node->h), n(node->n), hasL(node->l != nullptr), hasR(node->r != nullptr), node(node) {}
+
+	template<class Key, class Value>
+	CanvasNode::CanvasNode(const PersistentNode<Key, Value, false, PriorityField>* node, const auxillary::BoundingBox& box)
+		: box(box), style(Style::Prioritized), elem(node->elem), prior(node->prior), h(node->h), n(node->n),
+		hasL(node->l != nullptr), hasR(node->r != nullptr), node(node) {}
+	#pragma endregion
+
+	#pragma region Tree
+	template<class Derived, class NodeType, class Compare>
+	Tree<Derived, NodeType, Compare>::Tree(const Compare& comp)
+		: tree(nullptr), pool(std::make_shared<Arena>()), comp(comp), count(0), dead(0), rebuildThreshold(.25) {}
+
+	template<class Derived, class NodeType, class Compare>
+	Tree<Derived, NodeType, Compare>::Tree(Tree&& other)
+		: tree(other.tree), pool(std::move(other.pool)), comp(other.comp), count(other.count), dead(other.dead),
+		rebuildThreshold(other.rebuildThreshold)
+	{
+		other.tree = nullptr, other.count = other.dead = 0;
+		other.pool = std::make_shared<Arena>();
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	Tree<Derived, NodeType, Compare>& Tree<Derived, NodeType, Compare>::operator=(Tree&& other)
+	{
+		if (this == &other)
+			return *this;
+		clear();
+		tree = other.tree, pool.swap(other.pool), comp = other.comp, count = other.count, dead = other.dead;
+		rebuildThreshold = other.rebuildThreshold;
+		other.tree = nullptr, other.count = other.dead = 0;
+		return *this;
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	Tree<Derived, NodeType, Compare>::~Tree()
+	{
+		clear();
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	template<class... Args>
+	NodeType* Tree<Derived, NodeType, Compare>::createNode(Args&&... args)
+	{
+		++count;
+		return pool->create(std::forward<Args>(args)...);
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	void Tree<Derived, NodeType, Compare>::destroyNode(NodeType* node)
+	{
+		if (node != nullptr)
+			pool->destroy(node), --count;
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	void Tree<Derived, NodeType, Compare>::leftRotate(NodeType*& node)
+	{
+		NodeType* p = node, * q = node->l;
+		p->l = q->r;
+		if (q->r != nullptr)
+			p->l->parent = p;
+		if ((q->parent = p->parent) != nullptr)
+			(p->parent->l == p ? p->parent->l = q : p->parent->r = q);
+		q->r = p, p->parent = q;
+		p->update();
+		q->update();
+		if (q->parent != nullptr)
+			q->parent->update();
+		node = q;
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	void Tree<Derived, NodeType, Compare>::rightRotate(NodeType*& node)
+	{
+		NodeType* p = node, * q = node->r;
+		p->r = q->l;
+		if (q->l != nullptr)
+			p->r->parent = p;
+		if ((q->parent = p->parent) != nullptr)
+			(p->parent->l == p ? p->parent->l = q : p->parent->r = q);
+		q->l = p, p->parent = q;
+		p->update();
+		q->update();
+		if (q->parent != nullptr)
+			q->parent->update();
+		node = q;
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	NodeType* Tree<Derived, NodeType, Compare>::findNearestLT(const NodeType* node)
+	{
+		NodeType* p = node->l;
+		while (p != nullptr && p->r != nullptr)
+			p = p->r;
+		return p;
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	NodeType* Tree<Derived, NodeType, Compare>::findNearestGT(const NodeType* node)
+	{
+		NodeType* p = node->r;
+		while (p != nullptr && p->l != nullptr)
+			p = p->l;
+		return p;
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	void Tree<Derived, NodeType, Compare>::updateSubtree(NodeType* node)
+	{
+		if (node == nullptr)
+			return;
+		NodeType* stop = node->parent, * prev = stop, * p = node, * next;
+		while (p != stop)
+		{
+			if (prev == p->parent)
+				next = (p->l != nullptr ? p->l : p->r != nullptr ? p->r : p->parent);
+			else if (prev == p->l && p->r != nullptr)
+				next = p->r;
+			else
+				next = p->parent;
+			if (next == p->parent)
+				p->update();
+			prev = p, p = next;
+		}
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	template<class Iterator, class... Args>
+	NodeType* Tree<Derived, NodeType, Compare>::createFrom(Iterator it, Args&&... args)
+	{
+		++count;
+		return createIn(*pool, it, std::forward<Args>(args)...);
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	template<class Iterator, class... Args>
+	NodeType* Tree<Derived, NodeType, Compare>::createIn(Arena& arena, Iterator it, Args&&... args)
+	{
+		if constexpr (std::is_same<MappedType, NoValue>::value)
+			return arena.create(*it, NoValue(), std::forward<Args>(args)...);
+		else
+			return arena.create(it->first, it->second, std::forward<Args>(args)...);
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	template<class Iterator, class Visit>
+	NodeType* Tree<Derived, NodeType, Compare>::buildBalanced(Iterator& it, size_t count, uint32_t depth, Visit&& visit)
+	{
+		using Category = typename std::iterator_traits<Iterator>::iterator_category;
+		if constexpr (std::is_base_of<std::random_access_iterator_tag, Category>::value)
+		{
+			NodeType* node = buildRange(*pool, it, count, depth, visit);
+			it += count, this->count += count;
+			return node;
+		}
+		else
+		{
+			if (count == 0)
+				return nullptr;
+			NodeType* l = buildBalanced(it, count / 2, depth + 1, visit), * node = createFrom(it);
+			++it;
+			NodeType* r = buildBalanced(it, count - count / 2 - 1, depth + 1, visit);
+			if ((node->l = l) != nullptr)
+				l->parent = node;
+			if ((node->r = r) != nullptr)
+				r->parent = node;
+			node->update();
+			visit(node, depth);
+			return node;
+		}
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	template<class Iterator, class Visit>
+	NodeType* Tree<Derived, NodeType, Compare>::buildRange(
+		Arena& arena, Iterator begin, size_t count, uint32_t depth, Visit& visit
+	)
+	{
+		if (count == 0)
+			return nullptr;
+		Iterator mid = begin + (count / 2);
+		NodeType* l, * node, * r;
+		auto left = [&]() { l = buildRange(arena, begin, count / 2, depth + 1, visit), node = createIn(arena, mid); };
+		auto right = [&](Arena& into) { r = buildRange(into, mid + 1, count - count / 2 - 1, depth + 1, visit); };
+		if (auxillary::forkable(count))
+		{
+			Arena forked;
+			auxillary::parallelInvoke(true, left, [&]() { right(forked); });
+			arena.splice(forked);
+		}
+		else
+		{
+			left(), right(arena);
+		}
+		if ((node->l = l) != nullptr)
+			l->parent = node;
+		if ((node->r = r) != nullptr)
+			r->parent = node;
+		node->update();
+		visit(node, depth);
+		return node;
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	void Tree<Derived, NodeType, Compare>::destroyAll()
+	{
+		NodeType* p = tree;
+		while (p != nullptr)
+		{
+			if (p->l != nullptr)
+				p = p->l;
+			else if (p->r != nullptr)
+				p = p->r;
+			else
+			{
+				NodeType* q = p->parent;
+				if (q != nullptr)
+					(q->l == p ? q->l = nullptr : q->r = nullptr);
+				destroyNode(p), p = q;
+			}
+		}
+		tree = nullptr;
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	NodeType* Tree<Derived, NodeType, Compare>::findNext(const NodeType* node)
+	{
+		if (node->r != nullptr)
+			return findNearestGT(node);
+		while (node->parent != nullptr && node == node->parent->r)
+			node = node->parent;
+		return node->parent;
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	NodeType* Tree<Derived, NodeType, Compare>::findPrev(const NodeType* node)
+	{
+		if (node->l != nullptr)
+			return findNearestLT(node);
+		while (node->parent != nullptr && node == node->parent->l)
+			node = node->parent;
+		return node->parent;
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	NodeType* Tree<Derived, NodeType, Compare>::lowerBound(const KeyType& key, NodeType*& last) const
+	{
+		NodeType* p = tree, * ret = nullptr;
+		last = nullptr;
+		while (p != nullptr)
+		{
+			last = p;
+			if (comp(p->elem, key))
+				p = p->r;
+			else
+				ret = p, p = p->l;
+		}
+		while (ret != nullptr && isDead(ret))
+			ret = findNext(ret);
+		return ret;
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	NodeType* Tree<Derived, NodeType, Compare>::upperBound(const KeyType& key, NodeType*& last) const
+	{
+		NodeType* p = tree, * ret = nullptr;
+		last = nullptr;
+		while (p != nullptr)
+		{
+			last = p;
+			if (comp(key, p->elem))
+				ret = p, p = p->l;
+			else
+				p = p->r;
+		}
+		while (ret != nullptr && isDead(ret))
+			ret = findNext(ret);
+		return ret;
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	template<class T>
+	const typename Tree<Derived, NodeType, Compare>::KeyType& Tree<Derived, NodeType, Compare>::keyOf(const T& item)
+	{
+		if constexpr (std::is_same<T, KeyType>::value)
+			return item;
+		else
+			return item.first;
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	std::vector<typename Tree<Derived, NodeType, Compare>::Entry> Tree<Derived, NodeType, Compare>::entries() const
+	{
+		std::vector<Entry> out;
+		out.reserve(size());
+		const NodeType* p = tree;
+		while (p != nullptr && p->l != nullptr)
+			p = p->l;
+		for (; p != nullptr; p = findNext(p))
+		{
+			if (isDead(p))
+				continue;
+			if constexpr (std::is_same<MappedType, NoValue>::value)
+				out.push_back(p->elem);
+			else
+				out.emplace_back(p->elem, p->value);
+		}
+		return out;
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	std::vector<typename Tree<Derived, NodeType, Compare>::KeyType>
+	Tree<Derived, NodeType, Compare>::randomKeys(size_t n, const std::vector<Entry>& skip) const
+	{
+		thread_local std::mt19937 rng(auxillary::threadSeed());
+		auto less = [this](const auto& a, const auto& b) { return comp(keyOf(a), keyOf(b)); };
+		std::vector<KeyType> keys, fresh, merged;
+		while (keys.size() < n)
+		{
+			unsigned seed = (unsigned)rng();
+			fresh.resize(n - keys.size());
+			auxillary::parallelFor(fresh.size(), [&fresh, seed](size_t l, size_t r)
+			{
+				std::mt19937 gen(seed + (unsigned)l);
+				for (size_t i = l; i < r; ++i)
+					fresh[i] = (KeyType)gen();
+			});
+			auxillary::parallelSort(fresh.begin(), fresh.end(), comp);
+			fresh.erase(std::unique(fresh.begin(), fresh.end(), [this](const KeyType& a, const KeyType& b)
+			{
+				return !comp(a, b) && !comp(b, a);
+			}), fresh.end());
+			merged.clear();
+			std::set_difference(fresh.begin(), fresh.end(), skip.begin(), skip.end(), std::back_inserter(merged), less);
+			fresh.swap(merged), merged.clear();
+			std::set_union(keys.begin(), keys.end(), fresh.begin(), fresh.end(), std::back_inserter(merged), comp);
+			keys.swap(merged);
+		}
+		return keys;
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	void Tree<Derived, NodeType, Compare>::insertRandom(size_t n)
+	{
+		Derived* self = static_cast<Derived*>(this);
+		if (tree != nullptr && n < size() / MergeRatio)
+		{
+			std::vector<KeyType> keys;
+			while (n)
+			{
+				keys = randomKeys(n, {});
+				for (const KeyType& key : keys)
+				{
+					if (self->insert(key) != nullptr)
+						--n;
+				}
+			}
+			return;
+		}
+		std::vector<Entry> present = entries(), merged;
+		std::vector<KeyType> keys = randomKeys(n, present);
+		merged.reserve(present.size() + keys.size());
+		auto p = present.begin();
+		for (const KeyType& key : keys)
+		{
+			for (; p != present.end() && comp(keyOf(*p), key); ++p)
+				merged.push_back(std::move(*p));
+			if constexpr (std::is_same<MappedType, NoValue>::value)
+				merged.push_back(key);
+			else
+				merged.emplace_back(key, MappedType());
+		}
+		std::move(p, present.end(), std::back_inserter(merged));
+		self->buildFromSorted(merged.begin(), merged.end());
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	template<class Iterator>
+	void Tree<Derived, NodeType, Compare>::buildFromSorted(Iterator begin, Iterator end)
+	{
+		clear();
+		tree = buildBalanced(begin, (size_t)std::distance(begin, end), 0, [](NodeType*, uint32_t) {});
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	void Tree<Derived, NodeType, Compare>::clear()
+	{
+		// A shared arena holds nodes of other trees too, so the nodes are freed one by one
+		if (pool.use_count() > 1 || !std::is_trivially_destructible<NodeType>::value)
+			destroyAll();
+		if (pool.use_count() == 1)
+			pool->clear();
+		tree = nullptr, count = dead = 0;
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	bool Tree<Derived, NodeType, Compare>::isDead(const NodeType* node)
+	{
+		if constexpr (NodeType::AugmentPolicy::tombstones)
+			return node->dead;
+		else
+			return false;
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	bool Tree<Derived, NodeType, Compare>::markDead(const KeyType& key)
+	{
+		NodeType* p = tree;
+		while (p != nullptr && (comp(key, p->elem) || comp(p->elem, key)))
+			p = (comp(p->elem, key) ? p->r : p->l);
+		return p != nullptr && markDead(p);
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	bool Tree<Derived, NodeType, Compare>::markDead(NodeType* p)
+	{
+		if (p->dead)
+			return false;
+		p->dead = true, ++dead;
+		if constexpr (NodeType::AugmentPolicy::size || NodeType::AugmentPolicy::aggregated)
+		{
+			for (; p != nullptr; p = p->parent)
+				p->update();
+		}
+		if (dead > rebuildThreshold * count)
+			purge();
+		return true;
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	const NodeType* Tree<Derived, NodeType, Compare>::revive(NodeType* node, const MappedType& value)
+	{
+		if constexpr (NodeType::AugmentPolicy::tombstones)
+		{
+			if (!node->dead)
+				return nullptr;
+			node->dead = false, --dead;
+			if constexpr (!std::is_same<MappedType, NoValue>::value)
+				node->value = value;
+			if constexpr (NodeType::AugmentPolicy::size || NodeType::AugmentPolicy::aggregated)
+			{
+				for (NodeType* p = node; p != nullptr; p = p->parent)
+					p->update();
+			}
+			return node;
+		}
+		else
+			return nullptr;
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	void Tree<Derived, NodeType, Compare>::recountDead()
+	{
+		if constexpr (!NodeType::AugmentPolicy::tombstones)
+			return;
+		else if constexpr (NodeType::AugmentPolicy::size)
+			dead = countNodes(tree) - sizeOf(tree);
+		else
+		{
+			std::vector<NodeType*> nodes;
+			collect(tree, nodes);
+			dead = (size_t)std::count_if(nodes.begin(), nodes.end(), [](const NodeType* node) { return node->dead; });
+		}
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	void Tree<Derived, NodeType, Compare>::purge()
+	{
+		// Rebuilding from the live entries drops the tombstones together with the old nodes
+		std::vector<Entry> live = entries();
+		static_cast<Derived*>(this)->buildFromSorted(live.begin(), live.end());
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	void Tree<Derived, NodeType, Compare>::setRebuildThreshold(double threshold)
+	{
+		rebuildThreshold = auxillary::clamp(threshold, 0., 1.);
+		if (dead > rebuildThreshold * count)
+			purge();
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	size_t Tree<Derived, NodeType, Compare>::size() const
+	{
+		return count - dead;
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	const NodeType* Tree<Derived, NodeType, Compare>::rootPtr() const
+	{
+		return tree;
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	TreeStatistics Tree<Derived, NodeType, Compare>::statistics() const
+	{
+		return subtreeStatistics(tree, nullptr, nullptr, nullptr);
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	TreeStatistics Tree<Derived, NodeType, Compare>::subtreeStatistics(
+		const NodeType* node, const NodeType* parent, const KeyType* lo, const KeyType* hi
+	) const
+	{
+		TreeStatistics stats, l, r;
+		if (node == nullptr)
+			return stats;
+		bool fork = false;
+		if constexpr (NodeType::AugmentPolicy::size)
+			fork = auxillary::forkable(node->n);
+		auxillary::parallelInvoke(fork,
+			[&]() { l = subtreeStatistics(node->l, node, lo, &node->elem); },
+			[&]() { r = subtreeStatistics(node->r, node, &node->elem, hi); });
+		stats.nodes = l.nodes + r.nodes + 1;
+		stats.leaves = (stats.nodes == 1 ? 1 : l.leaves + r.leaves);
+		stats.height = std::max(l.height, r.height) + 1;
+		stats.valid = l.valid && r.valid && node->parent == parent &&
+			(lo == nullptr || comp(*lo, node->elem)) && (hi == nullptr || comp(node->elem, *hi));
+		if constexpr (NodeType::AugmentPolicy::size)
+			stats.valid = stats.valid && node->n == stats.nodes;
+		return stats;
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	typename Tree<Derived, NodeType, Compare>::iterator Tree<Derived, NodeType, Compare>::makeIterator(
+		const NodeType* node
+	) const
+	{
+		return iterator(node, this);
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	typename Tree<Derived, NodeType, Compare>::iterator Tree<Derived, NodeType, Compare>::begin() const
+	{
+		const NodeType* p = tree;
+		while (p != nullptr && p->l != nullptr)
+			p = p->l;
+		while (p != nullptr && isDead(p))
+			p = findNext(p);
+		return iterator(p, this);
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	typename Tree<Derived, NodeType, Compare>::iterator Tree<Derived, NodeType, Compare>::end() const
+	{
+		return iterator(nullptr, this);
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	typename Tree<Derived, NodeType, Compare>::iterator Tree<Derived, NodeType, Compare>::find(const KeyType& key) const
+	{
+		NodeType* last, * p = lowerBound(key, last);
+		return iterator(p != nullptr && !comp(key, p->elem) ? p : nullptr, this);
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	bool Tree<Derived, NodeType, Compare>::contains(const KeyType& key) const
+	{
+		return find(key) != end();
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	typename Tree<Derived, NodeType, Compare>::iterator Tree<Derived, NodeType, Compare>::lower_bound(
+		const KeyType& key
+	) const
+	{
+		NodeType* last;
+		return iterator(lowerBound(key, last), this);
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	typename Tree<Derived, NodeType, Compare>::iterator Tree<Derived, NodeType, Compare>::upper_bound(
+		const KeyType& key
+	) const
+	{
+		NodeType* last;
+		return iterator(upperBound(key, last), this);
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	size_t Tree<Derived, NodeType, Compare>::sizeOf(const NodeType* node)
+	{
+		static_assert(NodeType::AugmentPolicy::size, "order statistics need subtree sizes");
+		if constexpr (NodeType::AugmentPolicy::tombstones)
+			return node == nullptr ? 0 : node->live;
+		else
+			return node == nullptr ? 0 : node->n;
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	const NodeType* Tree<Derived, NodeType, Compare>::select(size_t k) const
+	{
+		const NodeType* p = tree;
+		while (p != nullptr)
+		{
+			size_t ln = sizeOf(p->l);
+			if (k == ln && !isDead(p))
+				return p;
+			if (k < ln)
+				p = p->l;
+			else
+				k -= ln + !isDead(p), p = p->r;
+		}
+		return nullptr;
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	size_t Tree<Derived, NodeType, Compare>::rank(const KeyType& key) const
+	{
+		size_t r = 0;
+		for (const NodeType* p = tree; p != nullptr;)
+		{
+			if (comp(p->elem, key))
+				r += sizeOf(p->l) + !isDead(p), p = p->r;
+			else
+				p = p->l;
+		}
+		return r;
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	size_t Tree<Derived, NodeType, Compare>::countNotGreater(const KeyType& key) const
+	{
+		size_t r = 0;
+		for (const NodeType* p = tree; p != nullptr;)
+		{
+			if (!comp(key, p->elem))
+				r += sizeOf(p->l) + !isDead(p), p = p->r;
+			else
+				p = p->l;
+		}
+		return r;
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	size_t Tree<Derived, NodeType, Compare>::countInRange(const KeyType& lo, const KeyType& hi) const
+	{
+		if (comp(hi, lo))
+			return 0;
+		return countNotGreater(hi) - rank(lo);
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	const NodeType* Tree<Derived, NodeType, Compare>::percentile(double p) const
+	{
+		size_t n = sizeOf(tree);
+		if (n == 0)
+			return nullptr;
+		size_t k = (size_t)std::ceil(auxillary::clamp(p, 0., 1.) * n);
+		return select(k == 0 ? 0 : k - 1);
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	typename NodeType::AugmentPolicy::MonoidPolicy::Type Tree<Derived, NodeType, Compare>::aggregate(
+		const KeyType& lo, const KeyType& hi
+	) const
+	{
+		static_assert(NodeType::AugmentPolicy::aggregated, "range aggregates need a monoid");
+		using Monoid = typename NodeType::AugmentPolicy::MonoidPolicy;
+		// Below the first node in [lo, hi], its left subtree gives the keys not less than lo as whole
+		// right subtrees, nearest first, and its right subtree the keys not greater than hi likewise
+		const NodeType* p = tree;
+		while (p != nullptr && (comp(p->elem, lo) || comp(hi, p->elem)))
+			p = (comp(p->elem, lo) ? p->r : p->l);
+		if (p == nullptr)
+			return Monoid::identity();
+		typename Monoid::Type left = Monoid::identity(), right = Monoid::identity();
+		for (const NodeType* q = p->l; q != nullptr;)
+		{
+			if (comp(q->elem, lo))
+				q = q->r;
+			else
+			{
+				typename Monoid::Type part = q->ownAggregate();
+				if (q->r != nullptr)
+					part = Monoid::combine(part, q->r->agg);
+				left = Monoid::combine(part, left), q = q->l;
+			}
+		}
+		for (const NodeType* q = p->r; q != nullptr;)
+		{
+			if (comp(hi, q->elem))
+				q = q->l;
+			else
+			{
+				typename Monoid::Type part = q->ownAggregate();
+				if (q->l != nullptr)
+					part = Monoid::combine(q->l->agg, part);
+				right = Monoid::combine(right, part), q = q->r;
+			}
+		}
+		return Monoid::combine(Monoid::combine(left, p->ownAggregate()), right);
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	void Tree<Derived, NodeType, Compare>::exchange(NodeType* a, NodeType* b)
+	{
+		NodeType* pa = a->parent, * pb = b->parent;
+		bool aLeft = (pa != nullptr && pa->l == a), bLeft = (pb != nullptr && pb->l == b);
+		std::swap(*a, *b);
+		a->swapPayload(b);
+		if constexpr (NodeType::AugmentPolicy::tombstones)
+		{
+			bool d = a->dead;
+			a->dead = b->dead, b->dead = d;
+		}
+		// Links between a and b now point to the node itself
+		for (NodeType* x : { a, b })
+		{
+			NodeType* y = (x == a ? b : a);
+			if (x->parent == x)
+				x->parent = y;
+			if (x->l == x)
+				x->l = y;
+			if (x->r == x)
+				x->r = y;
+			if (x->l != nullptr)
+				x->l->parent = x;
+			if (x->r != nullptr)
+				x->r->parent = x;
+		}
+		if (pa == nullptr)
+			tree = b;
+		else if (pa != b)
+			(aLeft ? pa->l : pa->r) = b;
+		if (pb == nullptr)
+			tree = a;
+		else if (pb != a)
+			(bLeft ? pb->l : pb->r) = a;
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	bool Tree<Derived, NodeType, Compare>::erase(Handle node)
+	{
+		NodeType* p = const_cast<NodeType*>((const NodeType*)node);
+		if (p == nullptr)
+			return false;
+		if constexpr (NodeType::AugmentPolicy::tombstones)
+			return markDead(p);
+		static_cast<Derived*>(this)->eraseNode(p);
+		return true;
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	const NodeType* Tree<Derived, NodeType, Compare>::updateKey(Handle node, const KeyType& key)
+	{
+		NodeType* p = const_cast<NodeType*>((const NodeType*)node);
+		if (p == nullptr || isDead(p))
+			return nullptr;
+		if (!comp(key, p->elem) && !comp(p->elem, key))
+			return p;
+		NodeType* prev = findPrev(p), * next = findNext(p);
+		if ((prev == nullptr || comp(prev->elem, key)) && (next == nullptr || comp(key, next->elem)))
+		{
+			p->elem = key;
+			if constexpr (NodeType::AugmentPolicy::aggregated && std::is_same<MappedType, NoValue>::value)
+			{
+				for (NodeType* q = p; q != nullptr; q = q->parent)
+					q->update();
+			}
+			return p;
+		}
+		if (contains(key))
+			return nullptr;
+		MappedType value = MappedType();
+		if constexpr (!std::is_same<MappedType, NoValue>::value)
+			value = p->value;
+		erase(node);
+		return static_cast<Derived*>(this)->insert(key, value);
+	}
+	#pragma endregion
+
+	#pragma region Tree split & join
+	template<class Derived, class NodeType, class Compare>
+	size_t Tree<Derived, NodeType, Compare>::countNodes(const NodeType* node)
+	{
+		if constexpr (NodeType::AugmentPolicy::size)
+			return node == nullptr ? 0 : node->n;
+		else
+		{
+			size_t n = 0;
+			std::vector<const NodeType*> stack;
+			if (node != nullptr)
+				stack.push_back(node);
+			while (!stack.empty())
+			{
+				const NodeType* p = stack.back();
+				stack.pop_back(), ++n;
+				if (p->l != nullptr)
+					stack.push_back(p->l);
+				if (p->r != nullptr)
+					stack.push_back(p->r);
+			}
+			return n;
+		}
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	NodeType* Tree<Derived, NodeType, Compare>::detach(NodeType* node)
+	{
+		if (node != nullptr)
+			node->parent = nullptr;
+		return node;
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	NodeType* Tree<Derived, NodeType, Compare>::settleRoot(NodeType* node)
+	{
+		if constexpr (NodeType::colored)
+		{
+			if (node != nullptr)
+				node->red = false;
+		}
+		return node;
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	NodeType* Tree<Derived, NodeType, Compare>::splitNodes(
+		NodeType* node, const KeyType& key, NodeType*& l, NodeType*& r
+	) const
+	{
+		if (node == nullptr)
+		{
+			l = r = nullptr;
+			return nullptr;
+		}
+		NodeType* nl = detach(node->l), * nr = detach(node->r), * m;
+		if (comp(node->elem, key))
+		{
+			m = static_cast<const Derived*>(this)->splitNodes(nr, key, nr, r);
+			l = Derived::joinNodes(nl, node, nr);
+			return m;
+		}
+		if (comp(key, node->elem))
+		{
+			m = static_cast<const Derived*>(this)->splitNodes(nl, key, l, nl);
+			r = Derived::joinNodes(nl, node, nr);
+			return m;
+		}
+		l = nl, r = nr;
+		node->l = node->r = nullptr, node->parent = nullptr;
+		node->update();
+		return node;
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	NodeType* Tree<Derived, NodeType, Compare>::splitLast(NodeType* node, NodeType*& last)
+	{
+		NodeType* nl = detach(node->l), * nr = detach(node->r);
+		if (nr == nullptr)
+		{
+			last = node;
+			node->l = nullptr, node->parent = nullptr;
+			node->update();
+			return nl;
+		}
+		nr = splitLast(nr, last);
+		return Derived::joinNodes(nl, node, nr);
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	NodeType* Tree<Derived, NodeType, Compare>::join2(NodeType* l, NodeType* r)
+	{
+		if (l == nullptr || r == nullptr)
+			return l == nullptr ? r : l;
+		NodeType* last;
+		l = splitLast(l, last);
+		return Derived::joinNodes(l, last, r);
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	bool Tree<Derived, NodeType, Compare>::forkable(const NodeType* a, const NodeType* b, uint32_t depth)
+	{
+		if constexpr (NodeType::AugmentPolicy::size)
+			return auxillary::forkable(countNodes(a) + countNodes(b));
+		else
+		{
+			// Without sizes only the top levels fork, one task per worker
+			auxillary::Scheduler* scheduler = auxillary::Scheduler::current();
+			return scheduler != nullptr && ((size_t)1 << depth) <= scheduler->workers();
+		}
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	void Tree<Derived, NodeType, Compare>::collect(NodeType* node, std::vector<NodeType*>& out)
+	{
+		size_t from = out.size();
+		if (node != nullptr)
+			out.push_back(node);
+		for (size_t i = from; i < out.size(); ++i)
+		{
+			if (out[i]->l != nullptr)
+				out.push_back(out[i]->l);
+			if (out[i]->r != nullptr)
+				out.push_back(out[i]->r);
+		}
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	NodeType* Tree<Derived, NodeType, Compare>::uniteNodes(
+		NodeType* a, NodeType* b, std::vector<NodeType*>& garbage, uint32_t depth
+	) const
+	{
+		if (a == nullptr || b == nullptr)
+			return a == nullptr ? b : a;
+		NodeType* al = detach(a->l), * ar = detach(a->r), * bl, * br;
+		NodeType* m = static_cast<const Derived*>(this)->splitNodes(b, a->elem, bl, br);
+		if (m != nullptr)
+		{
+			// A tombstone of this tree takes the live entry of other
+			if constexpr (NodeType::AugmentPolicy::tombstones)
+			{
+				if (a->dead && !m->dead)
+					a->swapPayload(m), a->dead = false;
+			}
+			garbage.push_back(m);
+		}
+		std::vector<NodeType*> forked;
+		auxillary::parallelInvoke(forkable(a, b, depth),
+			[&]() { al = uniteNodes(al, bl, forked, depth + 1); },
+			[&]() { ar = uniteNodes(ar, br, garbage, depth + 1); });
+		garbage.insert(garbage.end(), forked.begin(), forked.end());
+		return Derived::joinNodes(al, a, ar);
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	NodeType* Tree<Derived, NodeType, Compare>::intersectNodes(
+		NodeType* a, NodeType* b, std::vector<NodeType*>& garbage, uint32_t depth
+	) const
+	{
+		if (a == nullptr || b == nullptr)
+		{
+			collect(a, garbage), collect(b, garbage);
+			return nullptr;
+		}
+		NodeType* al = detach(a->l), * ar = detach(a->r), * bl, * br;
+		NodeType* m = static_cast<const Derived*>(this)->splitNodes(b, a->elem, bl, br);
+		std::vector<NodeType*> forked;
+		auxillary::parallelInvoke(forkable(a, b, depth),
+			[&]() { al = intersectNodes(al, bl, forked, depth + 1); },
+			[&]() { ar = intersectNodes(ar, br, garbage, depth + 1); });
+		garbage.insert(garbage.end(), forked.begin(), forked.end());
+		if (m != nullptr)
+		{
+			if constexpr (NodeType::AugmentPolicy::tombstones)
+				a->dead = a->dead || m->dead;
+			garbage.push_back(m);
+			return Derived::joinNodes(al, a, ar);
+		}
+		garbage.push_back(a);
+		return join2(al, ar);
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	NodeType* Tree<Derived, NodeType, Compare>::subtractNodes(
+		NodeType* a, NodeType* b, std::vector<NodeType*>& garbage, uint32_t depth
+	) const
+	{
+		if (a == nullptr || b == nullptr)
+		{
+			collect(b, garbage);
+			return a;
+		}
+		NodeType* bl = detach(b->l), * br = detach(b->r), * al, * ar;
+		NodeType* m = static_cast<const Derived*>(this)->splitNodes(a, b->elem, al, ar);
+		garbage.push_back(b);
+		// A tombstone of other removes nothing
+		if (m != nullptr && !isDead(b))
+			garbage.push_back(m), m = nullptr;
+		std::vector<NodeType*> forked;
+		auxillary::parallelInvoke(forkable(al, bl, depth),
+			[&]() { al = subtractNodes(al, bl, forked, depth + 1); },
+			[&]() { ar = subtractNodes(ar, br, garbage, depth + 1); });
+		garbage.insert(garbage.end(), forked.begin(), forked.end());
+		return m != nullptr ? Derived::joinNodes(al, m, ar) : join2(al, ar);
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	NodeType* Tree<Derived, NodeType, Compare>::cloneSubtree(const NodeType* node)
+	{
+		if (node == nullptr)
+			return nullptr;
+		NodeType* copy = pool->create(*node), * l = cloneSubtree(node->l), * r = cloneSubtree(node->r);
+		copy->parent = nullptr;
+		if ((copy->l = l) != nullptr)
+			l->parent = copy;
+		if ((copy->r = r) != nullptr)
+			r->parent = copy;
+		return copy;
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	NodeType* Tree<Derived, NodeType, Compare>::adopt(Tree& other)
+	{
+		NodeType* root = other.tree;
+		if (other.pool != pool)
+		{
+			if (other.pool.use_count() == 1)
+				pool->splice(*other.pool);
+			else
+				root = cloneSubtree(root), other.clear();
+		}
+		other.tree = nullptr, other.count = other.dead = 0;
+		return root;
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	Derived Tree<Derived, NodeType, Compare>::split(const KeyType& key)
+	{
+		Derived right(comp);
+		Tree& r = right;
+		NodeType* m = static_cast<Derived*>(this)->splitNodes(tree, key, tree, r.tree);
+		if (m != nullptr)
+			r.tree = Derived::joinNodes(nullptr, m, r.tree);
+		settleRoot(tree), settleRoot(r.tree);
+		r.pool = pool, r.rebuildThreshold = rebuildThreshold;
+		r.count = countNodes(r.tree), count -= r.count;
+		recountDead(), r.recountDead();
+		return right;
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	Derived Tree<Derived, NodeType, Compare>::join(
+		Derived&& left, const KeyType& key, Derived&& right, const MappedType& value
+	)
+	{
+		Derived result(std::move(left));
+		Tree& res = result, & r = right;
+		size_t rightCount = r.count;
+		NodeType* rr = res.adopt(r), * mid;
+		if constexpr (std::is_base_of<PriorityField, NodeType>::value)
+			mid = res.createNode(key, value, (uint32_t)Derived::rng());
+		else
+			mid = res.createNode(key, value);
+		res.tree = Derived::joinNodes(res.tree, mid, rr);
+		res.count += rightCount;
+		res.recountDead();
+		return result;
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	void Tree<Derived, NodeType, Compare>::unite(Derived&& other)
+	{
+		Tree& o = other;
+		std::vector<NodeType*> garbage;
+		count += o.count;
+		tree = settleRoot(uniteNodes(tree, adopt(o), garbage, 0));
+		for (NodeType* node : garbage)
+			destroyNode(node);
+		recountDead();
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	void Tree<Derived, NodeType, Compare>::intersect(Derived&& other)
+	{
+		Tree& o = other;
+		std::vector<NodeType*> garbage;
+		count += o.count;
+		tree = settleRoot(intersectNodes(tree, adopt(o), garbage, 0));
+		for (NodeType* node : garbage)
+			destroyNode(node);
+		recountDead();
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	void Tree<Derived, NodeType, Compare>::subtract(Derived&& other)
+	{
+		Tree& o = other;
+		std::vector<NodeType*> garbage;
+		count += o.count;
+		tree = settleRoot(subtractNodes(tree, adopt(o), garbage, 0));
+		for (NodeType* node : garbage)
+			destroyNode(node);
+		recountDead();
+	}
+	#pragma endregion
+
+	#pragma region Tree::Handle
+	template<class Derived, class NodeType, class Compare>
+	Tree<Derived, NodeType, Compare>::Handle::Handle(const NodeType* node) : node(node) {}
+
+	template<class Derived, class NodeType, class Compare>
+	Tree<Derived, NodeType, Compare>::Handle::operator const NodeType*() const
+	{
+		return node;
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	const NodeType* Tree<Derived, NodeType, Compare>::Handle::operator->() const
+	{
+		return node;
+	}
+	#pragma endregion
+
+	#pragma region Tree::iterator
+	template<class Derived, class NodeType, class Compare>
+	Tree<Derived, NodeType, Compare>::iterator::iterator(const NodeType* node, const Tree* owner)
+		: node(node), owner(owner) {}
+
+	template<class Derived, class NodeType, class Compare>
+	Tree<Derived, NodeType, Compare>::iterator::iterator() : node(nullptr), owner(nullptr) {}
+
+	template<class Derived, class NodeType, class Compare>
+	const NodeType& Tree<Derived, NodeType, Compare>::iterator::operator*() const
+	{
+		return *node;
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	const NodeType* Tree<Derived, NodeType, Compare>::iterator::operator->() const
+	{
+		return node;
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	typename Tree<Derived, NodeType, Compare>::iterator& Tree<Derived, NodeType, Compare>::iterator::operator++()
+	{
+		do
+			node = findNext(node);
+		while (node != nullptr && isDead(node));
+		return *this;
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	typename Tree<Derived, NodeType, Compare>::iterator Tree<Derived, NodeType, Compare>::iterator::operator++(int)
+	{
+		iterator ret = *this;
+		return ++*this, ret;
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	typename Tree<Derived, NodeType, Compare>::iterator& Tree<Derived, NodeType, Compare>::iterator::operator--()
+	{
+		if (node != nullptr)
+			node = findPrev(node);
+		else
+		{
+			node = owner->tree;
+			while (node != nullptr && node->r != nullptr)
+				node = node->r;
+		}
+		while (node != nullptr && isDead(node))
+			node = findPrev(node);
+		return *this;
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	typename Tree<Derived, NodeType, Compare>::iterator Tree<Derived, NodeType, Compare>::iterator::operator--(int)
+	{
+		iterator ret = *this;
+		return --*this, ret;
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	bool Tree<Derived, NodeType, Compare>::iterator::operator==(const iterator& other) const
+	{
+		return node == other.node;
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	bool Tree<Derived, NodeType, Compare>::iterator::operator!=(const iterator& other) const
+	{
+		return node != other.node;
+	}
+	#pragma endregion
+
+	#pragma region AVL
+	template<class Key, class Value, class Compare, class Augment, class Layout>
+	AVLTree<Key, Value, Compare, Augment, Layout>::AVLTree(const Compare& comp) : Base(comp) {}
+
+	template<class Key, class Value, class Compare, class Augment, class Layout>
+	long long AVLTree<Key, Value, Compare, Augment, Layout>::height(const NodeType* node)
+	{
+		return node == nullptr ? 0 : node->h;
+	}
+
+	template<class Key, class Value, class Compare, class Augment, class Layout>
+	typename AVLTree<Key, Value, Compare, Augment, Layout>::NodeType*
+	AVLTree<Key, Value, Compare, Augment, Layout>::joinNodes(NodeType* l, NodeType* mid, NodeType* r)
+	{
+		long long hl = height(l), hr = height(r);
+		NodeType* p = nullptr, * c;
+		if (hl > hr + 1)
+		{
+			for (c = l; height(c) > hr + 1; c = c->r)
+				p = c;
+			p->r = mid, l = c;
+		}
+		else if (hr > hl + 1)
+		{
+			for (c = r; height(c) > hl + 1; c = c->l)
+				p = c;
+			p->l = mid, r = c;
+		}
+		mid->parent = p;
+		if ((mid->l = l) != nullptr)
+			l->parent = mid;
+		if ((mid->r = r) != nullptr)
+			r->parent = mid;
+		mid->update();
+		return p == nullptr ? mid : balanceUp(p);
+	}
+
+	template<class Key, class Value, class Compare, class Augment, class Layout>
+	typename AVLTree<Key, Value, Compare, Augment, Layout>::BalancingTypes
+	AVLTree<Key, Value, Compare, Augment, Layout>::checkBalance(const NodeType* node)
+	{
+		static auto h = [](const NodeType* node) { return (long long)(node == nullptr ? 0 : node->h); };
+		if (h(node->l) - h(node->r) > 1)
+		{
+			if (h(node->l->r) <= h(node->l->l))
+				return BalancingTypes::Left;
+			return BalancingTypes::LargeLeft;
+		}
+		else if (h(node->l) - h(node->r) < -1)
+		{
+			if (h(node->r->l) <= h(node->r->r))
+				return BalancingTypes::Right;
+			return BalancingTypes::LargeRight;
+		}
+		return BalancingTypes::None;
+	}
+
+	template<class Key, class Value, class Compare, class Augment, class Layout>
+	typename AVLTree<Key, Value, Compare, Augment, Layout>::NodeType*
+	AVLTree<Key, Value, Compare, Augment, Layout>::balanceUp(NodeType*& node)
+	{
+		NodeType* p = node;
+		while (p != nullptr)
+		{
+			p->update();
+			BalancingTypes balanceType = checkBalance(p);
+			if (balanceType == BalancingTypes::Left)
+				Base::leftRotate(p);
+			else if (balanceType == BalancingTypes::Right)
+				Base::rightRotate(p);
+			else if (balanceType == BalancingTypes::LargeLeft)
+			{
+				NodeType* q = p->l;
+				Base::rightRotate(q), Base::leftRotate(p);
+			}
+			else if (balanceType == BalancingTypes::LargeRight)
+			{
+				NodeType* q = p->r;
+				Base::leftRotate(q), Base::rightRotate(p);
+			}
+			node = p, p = p->parent;
+		}
+		return node;
+	}
+
+	template<class Key, class Value, class Compare, class Augment, class Layout>
+	const typename AVLTree<Key, Value, Compare, Augment, Layout>::NodeType*
+	AVLTree<Key, Value, Compare, Augment, Layout>::insert(const Key& key, const MappedType& value)
+	{
+		if (tree == nullptr)
+		{
+			tree = Base::createNode(key, value);
+			return tree;
+		}
+		NodeType* p = tree, * ret;
+		bool left;
+		while (true)
+		{
+			if (left = comp(key, p->elem))
+			{
+				if (p->l == nullptr)
+					break;
+				p = p->l;
+			}
+			else if (comp(p->elem, key))
+			{
+				if (p->r == nullptr)
+					break;
+				p = p->r;
+			}
+			else
+				return Base::revive(p, value);
+		}
+		ret = (left ? p->l = Base::createNode(key, value, p) : p->r = Base::createNode(key, value, p));
+		tree = balanceUp(p);
+		return ret;
+	}
+
+	template<class Key, class Value, class Compare, class Augment, class Layout>
+	bool AVLTree<Key, Value, Compare, Augment, Layout>::erase(const Key& key)
+	{
+		if constexpr (NodeType::AugmentPolicy::tombstones)
+			return Base::markDead(key);
+		NodeType* p = tree;
+		while (p != nullptr && (comp(key, p->elem) || comp(p->elem, key)))
+			p = (comp(p->elem, key) ? p->r : p->l);
+		if (p == nullptr)
+			return false;
+		eraseNode(p);
+		return true;
+	}
+
+	template<class Key, class Value, class Compare, class Augment, class Layout>
+	void AVLTree<Key, Value, Compare, Augment, Layout>::eraseNode(NodeType* p)
+	{
+		static auto h = [](const NodeType* node) { return (long long)(node == nullptr ? 0 : node->h); };
+		// The node sinks to a leaf, trading places with its nearest key from the taller side
+		while (p->l != nullptr || p->r != nullptr)
+			Base::exchange(p, h(p->l) > h(p->r) ? Base::findNearestLT(p) : Base::findNearestGT(p));
+		if (p->parent == nullptr)
+		{
+			Base::destroyNode(tree), tree = nullptr;
+			return;
+		}
+		bool leftSon = (p->parent->l == p);
+		p = p->parent;
+		if (leftSon)
+			Base::destroyNode(p->l), p->l = nullptr;
+		else
+			Base::destroyNode(p->r), p->r = nullptr;
+		tree = balanceUp(p);
+	}
+	#pragma endregion
+
+	#pragma region RB
+	template<class Key, class Value, class Compare, class Augment, class Layout>
+	RBTree<Key, Value, Compare, Augment, Layout>::RBTree(const Compare& comp) : Base(comp) {}
+
+	template<class Key, class Value, class Compare, class Augment, class Layout>
+	typename RBTree<Key, Value, Compare, Augment, Layout>::NodeType*
+	RBTree<Key, Value, Compare, Augment, Layout>::grandparent(const NodeType* node)
+	{
+		if (node->parent != nullptr)
+			return node->parent->parent;
+		return nullptr;
+	}
+
+	template<class Key, class Value, class Compare, class Augment, class Layout>
+	typename RBTree<Key, Value, Compare, Augment, Layout>::NodeType*
+	RBTree<Key, Value, Compare, Augment, Layout>::uncle(const NodeType* node)
+	{
+		NodeType* gp = grandparent(node);
+		if (gp != nullptr)
+			return (node->parent == gp->l ? gp->r : gp->l);
+		return nullptr;
+	}
+
+	template<class Key, class Value, class Compare, class Augment, class Layout>
+	typename RBTree<Key, Value, Compare, Augment, Layout>::NodeType*
+	RBTree<Key, Value, Compare, Augment, Layout>::insertBalance(NodeType*& node)
+	{
+		NodeType* gp = grandparent(node), * u = uncle(node);
+		node->update();
+		if (node->parent == nullptr)
+		{
+			node->red = false;
+			return node;
+		}
+		else if (!node->parent->red)
+		{
+			return node;
+		}
+		else if (u != nullptr && u->red)
+		{
+			node->parent->red = false, u->red = false;
+			gp->red = true;
+			return insertBalance(gp), gp;
+		}
+		else if (node == node->parent->l && node->parent == gp->r ||
+			node == node->parent->r && node->parent == gp->l)
+		{
+			if (node == node->parent->l)
+			{
+				node = node->parent;
+				Base::leftRotate(node);
+				node = node->r;
+			}
+			else
+			{
+				node = node->parent;
+				Base::rightRotate(node);
+				node = node->l;
+			}
+		}
+		node->parent->red = false;
+		gp->red = true;
+		if (node == node->parent->l && node->parent == gp->l)
+			Base::leftRotate(gp);
+		else
+			Base::rightRotate(gp);
+		return node;
+	}
+
+	template<class Key, class Value, class Compare, class Augment, class Layout>
+	bool RBTree<Key, Value, Compare, Augment, Layout>::isRed(const NodeType* node)
+	{
+		return node != nullptr && node->red;
+	}
+
+	template<class Key, class Value, class Compare, class Augment, class Layout>
+	typename RBTree<Key, Value, Compare, Augment, Layout>::NodeType*
+	RBTree<Key, Value, Compare, Augment, Layout>::lift(NodeType* node, bool right)
+	{
+		NodeType* q = (right ? node->r : node->l), * parent = node->parent;
+		if (right)
+		{
+			if ((node->r = q->l) != nullptr)
+				node->r->parent = node;
+			q->l = node;
+		}
+		else
+		{
+			if ((node->l = q->r) != nullptr)
+				node->l->parent = node;
+			q->r = node;
+		}
+		node->parent = q, q->parent = parent;
+		if (parent != nullptr)
+			(parent->l == node ? parent->l = q : parent->r = q);
+		if constexpr (NodeType::AugmentPolicy::size)
+			q->n = node->n;
+		if constexpr (NodeType::AugmentPolicy::size && NodeType::AugmentPolicy::tombstones)
+			q->live = node->live;
+		node->update();
+		return q;
+	}
+
+	template<class Key, class Value, class Compare, class Augment, class Layout>
+	void RBTree<Key, Value, Compare, Augment, Layout>::resize(NodeType* node, int delta)
+	{
+		if constexpr (NodeType::AugmentPolicy::size)
+			node->n += delta;
+		if constexpr (NodeType::AugmentPolicy::size && NodeType::AugmentPolicy::tombstones)
+			node->live += delta;
+	}
+
+	template<class Key, class Value, class Compare, class Augment, class Layout>
+	size_t RBTree<Key, Value, Compare, Augment, Layout>::blackHeight(const NodeType* node)
+	{
+		size_t h = 0;
+		for (; node != nullptr; node = node->l)
+			h += !node->red;
+		return h;
+	}
+
+	template<class Key, class Value, class Compare, class Augment, class Layout>
+	typename RBTree<Key, Value, Compare, Augment, Layout>::NodeType*
+	RBTree<Key, Value, Compare, Augment, Layout>::joinNodes(NodeType* l, NodeType* mid, NodeType* r)
+	{
+		if (l != nullptr)
+			l->red = false;
+		if (r != nullptr)
+			r->red = false;
+		size_t bl = blackHeight(l), br = blackHeight(r), h;
+		NodeType* p = nullptr, * c;
+		if (bl > br)
+		{
+			for (c = l, h = bl; c != nullptr && (c->red || h != br); c = c->r)
+				p = c, h -= !c->red;
+			p->r = mid, l = c;
+		}
+		else if (br > bl)
+		{
+			for (c = r, h = br; c != nullptr && (c->red || h != bl); c = c->l)
+				p = c, h -= !c->red;
+			p->l = mid, r = c;
+		}
+		mid->parent = p;
+		if ((mid->l = l) != nullptr)
+			l->parent = mid;
+		if ((mid->r = r) != nullptr)
+			r->parent = mid;
+		mid->red = (p != nullptr);
+		mid->update();
+		if (p == nullptr)
+			return mid;
+		NodeType* q = mid;
+		insertBalance(q);
+		for (q = mid; q->parent != nullptr; q = q->parent)
+			q->update();
+		q->update();
+		q->red = false;
+		return q;
+	}
+
+	template<class Key, class Value, class Compare, class Augment, class Layout>
+	template<class Iterator>
+	void RBTree<Key, Value, Compare, Augment, Layout>::buildFromSorted(Iterator begin, Iterator end)
+	{
+		// All levels of a balanced tree but the last one are full. Coloring the last one red
+		// (if it is incomplete) leaves the same number of black nodes on every path
+		size_t count = (size_t)std::distance(begin, end);
+		uint32_t redDepth = 0;
+		while (((size_t)2 << redDepth) <= count + 1)
+			++redDepth;
+		Base::clear();
+		tree = Base::buildBalanced(begin, count, 0, [redDepth](NodeType* node, uint32_t depth)
+		{
+			node->red = (depth == redDepth);
+		});
+	}
+
+	template<class Key, class Value, class Compare, class Augment, class Layout>
+	const typename RBTree<Key, Value, Compare, Augment, Layout>::NodeType*
+	RBTree<Key, Value, Compare, Augment, Layout>::insert(const Key& key, const MappedType& value)
+	{
+		if (tree == nullptr)
+		{
+			tree = Base::createNode(key, value, nullptr, false);
+			return tree;
+		}
+		// Black nodes with two red children are split on the way down, so a red parent of the next node
+		// always has a black sibling and one rotation (or two) at the grandparent settles it.
+		// Sizes count the new key as soon as a node is passed, a duplicate key recounts its path
+		NodeType* x = tree, * p = nullptr, * ret = nullptr;
+		bool right = false;
+		while (true)
+		{
+			if (x == nullptr)
+			{
+				x = ret = Base::createNode(key, value, p);
+				(right ? p->r = x : p->l = x);
+			}
+			else
+			{
+				resize(x, 1);
+				if (isRed(x->l) && isRed(x->r))
+					x->red = (x != tree), x->l->red = x->r->red = false;
+			}
+			if (x->red && isRed(p))
+			{
+				NodeType* g = p->parent, * top;
+				bool pRight = (g->r == p);
+				if (pRight == (p->r == x))
+					top = lift(g, pRight), p->red = false;
+				else
+					lift(p, !pRight), top = lift(g, pRight), x->red = false;
+				g->red = true;
+				if (top->parent == nullptr)
+					tree = top;
+			}
+			if (ret != nullptr)
+				break;
+			if (!comp(key, x->elem) && !comp(x->elem, key))
+			{
+				ret = const_cast<NodeType*>(Base::revive(x, value));
+				for (; x != nullptr; x = x->parent)
+					x->update();
+				return ret;
+			}
+			p = x, right = comp(x->elem, key), x = (right ? x->r : x->l);
+		}
+		// Heights and aggregates are only known once the leaf is in place
+		if constexpr (NodeType::AugmentPolicy::height || NodeType::AugmentPolicy::aggregated)
+		{
+			for (x = ret; x != nullptr; x = x->parent)
+				x->update();
+		}
+		return ret;
+	}
+
+	template<class Key, class Value, class Compare, class Augment, class Layout>
+	bool RBTree<Key, Value, Compare, Augment, Layout>::erase(const Key& key)
+	{
+		if constexpr (NodeType::AugmentPolicy::tombstones)
+			return Base::markDead(key);
+		// A red node is pushed down the search path, which continues past the key to its predecessor.
+		// The last node of the path is red (or has a red child), so unlinking it keeps the black heights.
+		// Sizes drop as nodes are passed, a missing key recounts its path
+		NodeType* q = nullptr, * p = nullptr, * found = nullptr, * next = tree;
+		bool dir = true, last;
+		while (next != nullptr)
+		{
+			last = dir, p = q, q = next;
+			resize(q, -1);
+			dir = comp(q->elem, key);
+			if (!dir && !comp(key, q->elem))
+				found = q;
+			if (!q->red && !isRed(dir ? q->r : q->l))
+			{
+				if (isRed(dir ? q->l : q->r))
+				{
+					p = lift(q, !dir), q->red = true, p->red = false;
+					resize(q, -1);
+					if (p->parent == nullptr)
+						tree = p;
+				}
+				else if (p != nullptr && (last ? p->l : p->r) != nullptr)
+				{
+					NodeType* s = (last ? p->l : p->r);
+					if (!isRed(s->l) && !isRed(s->r))
+						p->red = false, s->red = q->red = true;
+					else
+					{
+						NodeType* top;
+						if (isRed(last ? s->r : s->l))
+							lift(s, last), top = lift(p, !last);
+						else
+							top = lift(p, !last);
+						q->red = top->red = true;
+						top->l->red = top->r->red = false;
+						if (top->parent == nullptr)
+							tree = top;
+					}
+				}
+			}
+			next = (dir ? q->r : q->l);
+		}
+		if (found == nullptr)
+		{
+			for (; q != nullptr; q = q->parent)
+				q->update();
+			if (tree != nullptr)
+				tree->red = false;
+			return false;
+		}
+		if (found != q)
+			Base::exchange(found, q), q = found;
+		NodeType* child = (q->l != nullptr ? q->l : q->r);
+		p = q->parent;
+		if (p == nullptr)
+			tree = child;
+		else
+			(p->l == q ? p->l = child : p->r = child);
+		if (child != nullptr)
+			child->parent = p;
+		Base::destroyNode(q);
+		if constexpr (NodeType::AugmentPolicy::height || NodeType::AugmentPolicy::aggregated)
+		{
+			for (; p != nullptr; p = p->parent)
+				p->update();
+		}
+		if (tree != nullptr)
+			tree->red = false;
+		return true;
+	}
+
+	template<class Key, class Value, class Compare, class Augment, class Layout>
+	void RBTree<Key, Value, Compare, Augment, Layout>::eraseBalance(NodeType* node, NodeType* parent)
+	{
+		while (node != tree && !isRed(node))
+		{
+			bool left = (parent->l == node);
+			NodeType* s = (left ? parent->r : parent->l);
+			if (s->red)
+			{
+				s->red = false, parent->red = true;
+				if (lift(parent, left)->parent == nullptr)
+					tree = s;
+				s = (left ? parent->r : parent->l);
+			}
+			if (!isRed(s->l) && !isRed(s->r))
+			{
+				s->red = true;
+				node = parent, parent = node->parent;
+				continue;
+			}
+			if (!isRed(left ? s->r : s->l))
+			{
+				s->red = true;
+				s = lift(s, !left);
+				s->red = false;
+			}
+			s->red = parent->red, parent->red = false;
+			(left ? s->r : s->l)->red = false;
+			if (lift(parent, left)->parent == nullptr)
+				tree = s;
+			break;
+		}
+		if (node != nullptr)
+			node->red = false;
+	}
+
+	template<class Key, class Value, class Compare, class Augment, class Layout>
+	void RBTree<Key, Value, Compare, Augment, Layout>::eraseNode(NodeType* p)
+	{
+		// Bottom-up: a node with two children trades places with its successor, which has one child at most
+		if (p->l != nullptr && p->r != nullptr)
+			Base::exchange(p, Base::findNearestGT(p));
+		NodeType* child = (p->l != nullptr ? p->l : p->r), * parent = p->parent;
+		if (parent == nullptr)
+			tree = child;
+		else
+			(parent->l == p ? parent->l = child : parent->r = child);
+		if (child != nullptr)
+			child->parent = parent;
+		bool black = !p->red;
+		Base::destroyNode(p);
+		if (black)
+			eraseBalance(child, parent);
+		// lift leaves the augmentations above the rotations stale, one pass from the old parent fixes the path
+		if constexpr (NodeType::augmented)
+		{
+			for (; parent != nullptr; parent = parent->parent)
+				parent->update();
+		}
+		if (tree != nullptr)
+			tree->red = false;
+	}
+	#pragma endregion
+
+	#pragma region Treap
+	template<class Key, class Value, class Compare, class Augment, class Layout>
+	thread_local std::mt19937 Treap<Key, Value, Compare, Augment, Layout>::rng(auxillary::threadSeed());
+
+	template<class Key, class Value, class Compare, class Augment, class Layout>
+	Treap<Key, Value, Compare, Augment, Layout>::Treap(const Compare& comp) : Base(comp) {}
+
+	template<class Key, class Value, class Compare, class Augment, class Layout>
+	typename Treap<Key, Value, Compare, Augment, Layout>::NodeType*
+	Treap<Key, Value, Compare, Augment, Layout>::merge(NodeType* l, NodeType* r)
+	{
+		if (l == nullptr || r == nullptr)
+			return l == nullptr ? r : l;
+		// Walks down the right spine of l and the left spine of r, hanging the node of higher
+		// priority under the previous one. The rest of the other spine goes where the walk ends
+		NodeType* root = nullptr, * p = nullptr, * q;
+		bool left = false;  // the next node hangs to the left of p
+		while (l != nullptr || r != nullptr)
+		{
+			bool fromRight = (l == nullptr || r != nullptr && !(l->prior > r->prior));
+			q = (fromRight ? r : l);
+			if (p == nullptr)
+				root = q;
+			else
+				(left ? p->l = q : p->r = q);
+			q->parent = p;
+			if (l == nullptr || r == nullptr)
+				break;
+			p = q, left = fromRight;
+			(fromRight ? r = r->l : l = l->r);
+		}
+		if constexpr (NodeType::augmented)
+		{
+			for (; p != nullptr; p = p->parent)
+				p->update();
+		}
+		return root;
+	}
+
+	template<class Key, class Value, class Compare, class Augment, class Layout>
+	typename Treap<Key, Value, Compare, Augment, Layout>::NodeType*
+	Treap<Key, Value, Compare, Augment, Layout>::joinNodes(NodeType* l, NodeType* mid, NodeType* r)
+	{
+		mid->l = mid->r = nullptr, mid->parent = nullptr;
+		mid->update();
+		return merge(merge(l, mid), r);
+	}
+
+	template<class Key, class Value, class Compare, class Augment, class Layout>
+	typename Treap<Key, Value, Compare, Augment, Layout>::NodeType*
+	Treap<Key, Value, Compare, Augment, Layout>::splitNodes(NodeType* node, const Key& key, NodeType*& l, NodeType*& r) const
+	{
+		NodeType* m;
+		split(node, key, l, r);
+		split(r, key, m, r, true);
+		return m;
+	}
+
+	template<class Key, class Value, class Compare, class Augment, class Layout>
+	void Treap<Key, Value, Compare, Augment, Layout>::split(
+		NodeType* tree, const Key& key, NodeType*& l, NodeType*& r, bool inclusive
+	) const
+	{
+		// lp and rp are the last nodes given to l and r, the next ones hang to the right of lp
+		// and to the left of rp
+		NodeType* lp = nullptr, * rp = nullptr;
+		l = r = nullptr;
+		while (tree != nullptr)
+		{
+			NodeType* p = tree;
+			if (comp(p->elem, key) || inclusive && !comp(key, p->elem))
+			{
+				if (lp == nullptr)
+					l = p;
+				else
+					lp->r = p;
+				p->parent = lp, lp = p, tree = p->r;
+			}
+			else
+			{
+				if (rp == nullptr)
+					r = p;
+				else
+					rp->l = p;
+				p->parent = rp, rp = p, tree = p->l;
+			}
+		}
+		if (lp != nullptr)
+			lp->r = nullptr;
+		if (rp != nullptr)
+			rp->l = nullptr;
+		if constexpr (NodeType::augmented)
+		{
+			for (; lp != nullptr; lp = lp->parent)
+				lp->update();
+			for (; rp != nullptr; rp = rp->parent)
+				rp->update();
+		}
+	}
+
+	template<class Key, class Value, class Compare, class Augment, class Layout>
+	template<class Iterator, class Priority>
+	void Treap<Key, Value, Compare, Augment, Layout>::buildCartesian(Iterator begin, Iterator end, Priority&& prior)
+	{
+		std::vector<NodeType*> spine;
+		Base::clear();
+		for (; begin != end; ++begin)
+		{
+			NodeType* node = Base::createFrom(begin, (uint32_t)prior()), * last = nullptr;
+			while (!spine.empty() && spine.back()->prior < node->prior)
+				last = spine.back(), spine.pop_back();
+			if ((node->l = last) != nullptr)
+				last->parent = node;
+			if (!spine.empty())
+				spine.back()->r = node, node->parent = spine.back();
+			spine.push_back(node);
+		}
+		tree = (spine.empty() ? nullptr : spine.front());
+		Base::updateSubtree(tree);
+	}
+
+	template<class Key, class Value, class Compare, class Augment, class Layout>
+	template<class Iterator>
+	void Treap<Key, Value, Compare, Augment, Layout>::buildFromSorted(Iterator begin, Iterator end)
+	{
+		buildCartesian(begin, end, []() { return (uint32_t)rng(); });
+	}
+
+	template<class Key, class Value, class Compare, class Augment, class Layout>
+	template<class Iterator, class PriorIterator>
+	void Treap<Key, Value, Compare, Augment, Layout>::buildFromSorted(Iterator begin, Iterator end, PriorIterator priors)
+	{
+		buildCartesian(begin, end, [&priors]() { return *priors++; });
+	}
+
+	template<class Key, class Value, class Compare, class Augment, class Layout>
+	const typename Treap<Key, Value, Compare, Augment, Layout>::NodeType*
+	Treap<Key, Value, Compare, Augment, Layout>::insert(const Key& key, const MappedType& value, uint32_t prior)
+	{
+		// The new node takes the place of the first node of lower priority on the search path,
+		// only the subtree below it is split
+		NodeType* parent = nullptr, * p = tree, * node, * l, * r;
+		for (; p != nullptr && p->prior >= prior; p = (comp(key, p->elem) ? p->l : p->r))
+		{
+			if (!comp(key, p->elem) && !comp(p->elem, key))
+				return Base::revive(p, value);
+			parent = p;
+		}
+		for (NodeType* q = p; q != nullptr; q = (comp(key, q->elem) ? q->l : q->r))
+		{
+			if (!comp(key, q->elem) && !comp(q->elem, key))
+				return Base::revive(q, value);
+		}
+		node = Base::createNode(key, value, prior, parent);
+		if (parent == nullptr)
+			tree = node;
+		else
+			(comp(key, parent->elem) ? parent->l = node : parent->r = node);
+		split(p, key, l, r);
+		if ((node->l = l) != nullptr)
+			l->parent = node;
+		if ((node->r = r) != nullptr)
+			r->parent = node;
+		if constexpr (NodeType::augmented)
+		{
+			for (p = node; p != nullptr; p = p->parent)
+				p->update();
+		}
+		return node;
+	}
+
+	template<class Key, class Value, class Compare, class Augment, class Layout>
+	const typename Treap<Key, Value, Compare, Augment, Layout>::NodeType*
+	Treap<Key, Value, Compare, Augment, Layout>::insert(const Key& key, const MappedType& value)
+	{
+		return insert(key, value, (uint32_t)rng());
+	}
+
+	template<class Key, class Value, class Compare, class Augment, class Layout>
+	bool Treap<Key, Value, Compare, Augment, Layout>::erase(const Key& key)
+	{
+		if constexpr (NodeType::AugmentPolicy::tombstones)
+			return Base::markDead(key);
+		NodeType* p = tree;
+		while (p != nullptr && (comp(key, p->elem) || comp(p->elem, key)))
+			p = (comp(p->elem, key) ? p->r : p->l);
+		if (p == nullptr)
+			return false;
+		eraseNode(p);
+		return true;
+	}
+
+	template<class Key, class Value, class Compare, class Augment, class Layout>
+	void Treap<Key, Value, Compare, Augment, Layout>::eraseNode(NodeType* p)
+	{
+		NodeType* parent = p->parent, * q = merge(Base::detach(p->l), Base::detach(p->r));
+		if (parent == nullptr)
+			tree = q;
+		else
+			(parent->l == p ? parent->l = q : parent->r = q);
+		if (q != nullptr)
+			q->parent = parent;
+		Base::destroyNode(p);
+		if constexpr (NodeType::augmented)
+		{
+			for (; parent != nullptr; parent = parent->parent)
+				parent->update();
+		}
+	}
+	#pragma endregion
+
+	#pragma region Implicit treap
+	template<class T>
+	ImplicitTreapNode<T>::ImplicitTreapNode(const T& value, uint32_t prior)
+		: parent(nullptr), l(nullptr), r(nullptr), value(value), sum(value), min(value), add(), assigned(), n(1),
+		prior(prior), assign(false), reversed(false) {}
+
+	template<class T>
+	void ImplicitTreapNode<T>::update()
+	{
+		n = 1, sum = min = value;
+		if (l != nullptr)
+			n += l->n, sum = l->sum + sum, min = std::min(l->min, min);
+		if (r != nullptr)
+			n += r->n, sum = sum + r->sum, min = std::min(min, r->min);
+	}
+
+	template<class T>
+	thread_local std::mt19937 ImplicitTreap<T>::rng(auxillary::threadSeed());
+
+	template<class T>
+	ImplicitTreap<T>::ImplicitTreap() : tree(nullptr) {}
+
+	template<class T>
+	ImplicitTreap<T>::~ImplicitTreap()
+	{
+		clear();
+	}
+
+	template<class T>
+	size_t ImplicitTreap<T>::sizeOf(const NodeType* node)
+	{
+		return node == nullptr ? 0 : node->n;
+	}
+
+	template<class T>
+	void ImplicitTreap<T>::applyReverse(NodeType* node)
+	{
+		if (node != nullptr)
+			std::swap(node->l, node->r), node->reversed = !node->reversed;
+	}
+
+	template<class T>
+	void ImplicitTreap<T>::applyAssign(NodeType* node, const T& value)
+	{
+		if (node == nullptr)
+			return;
+		node->value = node->min = value, node->sum = value * (T)node->n;
+		node->assign = true, node->assigned = value, node->add = T();
+	}
+
+	template<class T>
+	void ImplicitTreap<T>::applyAdd(NodeType* node, const T& delta)
+	{
+		if (node == nullptr)
+			return;
+		node->value = node->value + delta, node->min = node->min + delta, node->sum = node->sum + delta * (T)node->n;
+		if (node->assign)
+			node->assigned = node->assigned + delta;
+		else
+			node->add = node->add + delta;
+	}
+
+	template<class T>
+	void ImplicitTreap<T>::push(NodeType* node)
+	{
+		if (node->reversed)
+			applyReverse(node->l), applyReverse(node->r), node->reversed = false;
+		if (node->assign)
+			applyAssign(node->l, node->assigned), applyAssign(node->r, node->assigned), node->assign = false;
+		else if (node->add != T())
+			applyAdd(node->l, node->add), applyAdd(node->r, node->add);
+		node->add = T();
+	}
+
+	template<class T>
+	typename ImplicitTreap<T>::NodeType* ImplicitTreap<T>::merge(NodeType* l, NodeType* r)
+	{
+		if (l == nullptr || r == nullptr)
+			return l == nullptr ? r : l;
+		// As in Treap::merge, with pending updates pushed off every spine node before its children are read
+		NodeType* root = nullptr, * p = nullptr, * q;
+		bool left = false;
+		while (l != nullptr || r != nullptr)
+		{
+			bool fromRight = (l == nullptr || r != nullptr && !(l->prior > r->prior));
+			q = (fromRight ? r : l);
+			if (p == nullptr)
+				root = q;
+			else
+				(left ? p->l = q : p->r = q);
+			q->parent = p;
+			if (l == nullptr || r == nullptr)
+				break;
+			push(q);
+			p = q, left = fromRight;
+			(fromRight ? r = r->l : l = l->r);
+		}
+		for (; p != nullptr; p = p->parent)
+			p->update();
+		return root;
+	}
+
+	template<class T>
+	void ImplicitTreap<T>::split(NodeType* tree, size_t k, NodeType*& l, NodeType*& r)
+	{
+		NodeType* lp = nullptr, * rp = nullptr;
+		l = r = nullptr;
+		while (tree != nullptr)
+		{
+			NodeType* p = tree;
+			push(p);
+			if (sizeOf(p->l) < k)
+			{
+				k -= sizeOf(p->l) + 1;
+				if (lp == nullptr)
+					l = p;
+				else
+					lp->r = p;
+				p->parent = lp, lp = p, tree = p->r;
+			}
+			else
+			{
+				if (rp == nullptr)
+					r = p;
+				else
+					rp->l = p;
+				p->parent = rp, rp = p, tree = p->l;
+			}
+		}
+		if (lp != nullptr)
+			lp->r = nullptr;
+		if (rp != nullptr)
+			rp->l = nullptr;
+		for (; lp != nullptr; lp = lp->parent)
+			lp->update();
+		for (; rp != nullptr; rp = rp->parent)
+			rp->update();
+	}
+
+	template<class T>
+	template<class F>
+	void ImplicitTreap<T>::onRange(size_t lo, size_t hi, F&& f)
+	{
+		hi = std::min(hi, size());
+		if (lo >= hi)
+			return;
+		NodeType* l, * m, * r;
+		split(tree, lo, l, r);
+		split(r, hi - lo, m, r);
+		f(m);
+		tree = merge(merge(l, m), r);
+	}
+
+	template<class T>
+	template<class Iterator>
+	void ImplicitTreap<T>::build(Iterator begin, Iterator end)
+	{
+		std::vector<NodeType*> spine;
+		clear();
+		for (; begin != end; ++begin)
+		{
+			NodeType* node = pool.create(*begin, (uint32_t)rng()), * last = nullptr;
+			while (!spine.empty() && spine.back()->prior < node->prior)
+				last = spine.back(), spine.pop_back();
+			if ((node->l = last) != nullptr)
+				last->parent = node;
+			if (!spine.empty())
+				spine.back()->r = node, node->parent = spine.back();
+			spine.push_back(node);
+		}
+		tree = (spine.empty() ? nullptr : spine.front());
+		// Children come before their parents in reverse preorder
+		std::vector<NodeType*> order;
+		order.reserve(pool.size());
+		if (tree != nullptr)
+			order.push_back(tree);
+		for (size_t i = 0; i < order.size(); ++i)
+		{
+			if (order[i]->l != nullptr)
+				order.push_back(order[i]->l);
+			if (order[i]->r != nullptr)
+				order.push_back(order[i]->r);
+		}
+		for (size_t i = order.size(); i-- > 0;)
+			order[i]->update();
+	}
+
+	template<class T>
+	void ImplicitTreap<T>::clear()
+	{
+		if constexpr (!std::is_trivially_destructible<T>::value)
+		{
+			std::vector<NodeType*> stack;
+			if (tree != nullptr)
+				stack.push_back(tree);
+			while (!stack.empty())
+			{
+				NodeType* p = stack.back();
+				stack.pop_back();
+				if (p->l != nullptr)
+					stack.push_back(p->l);
+				if (p->r != nullptr)
+					stack.push_back(p->r);
+				pool.destroy(p);
+			}
+		}
+		pool.clear();
+		tree = nullptr;
+	}
+
+	template<class T>
+	size_t ImplicitTreap<T>::size() const
+	{
+		return sizeOf(tree);
+	}
+
+	template<class T>
+	bool ImplicitTreap<T>::empty() const
+	{
+		return tree == nullptr;
+	}
+
+	template<class T>
+	const typename ImplicitTreap<T>::NodeType* ImplicitTreap<T>::rootPtr() const
+	{
+		return tree;
+	}
+
+	template<class T>
+	std::optional<T> ImplicitTreap<T>::at(size_t i)
+	{
+		if (i >= size())
+			return std::nullopt;
+		NodeType* p = tree;
+		while (true)
+		{
+			push(p);
+			if (i == sizeOf(p->l))
+				return p->value;
+			if (i < sizeOf(p->l))
+				p = p->l;
+			else
+				i -= sizeOf(p->l) + 1, p = p->r;
+		}
+	}
+
+	template<class T>
+	std::vector<T> ImplicitTreap<T>::values()
+	{
+		std::vector<T> res;
+		res.reserve(size());
+		std::vector<NodeType*> stack;
+		for (NodeType* p = tree; p != nullptr || !stack.empty();)
+		{
+			for (; p != nullptr; p = p->l)
+				push(p), stack.push_back(p);
+			p = stack.back(), stack.pop_back();
+			res.push_back(p->value);
+			p = p->r;
+		}
+		return res;
+	}
+
+	template<class T>
+	void ImplicitTreap<T>::insert(size_t i, const T& value)
+	{
+		NodeType* l, * r;
+		split(tree, std::min(i, size()), l, r);
+		tree = merge(merge(l, pool.create(value, (uint32_t)rng())), r);
+	}
+
+	template<class T>
+	void ImplicitTreap<T>::pushBack(const T& value)
+	{
+		tree = merge(tree, pool.create(value, (uint32_t)rng()));
+	}
+
+	template<class T>
+	bool ImplicitTreap<T>::erase(size_t i)
+	{
+		if (i >= size())
+			return false;
+		return erase(i, i + 1), true;
+	}
+
+	template<class T>
+	void ImplicitTreap<T>::erase(size_t lo, size_t hi)
+	{
+		hi = std::min(hi, size());
+		if (lo >= hi)
+			return;
+		NodeType* l, * m, * r;
+		split(tree, lo, l, r);
+		split(r, hi - lo, m, r);
+		std::vector<NodeType*> stack = { m };
+		while (!stack.empty())
+		{
+			NodeType* p = stack.back();
+			stack.pop_back();
+			if (p->l != nullptr)
+				stack.push_back(p->l);
+			if (p->r != nullptr)
+				stack.push_back(p->r);
+			pool.destroy(p);
+		}
+		tree = merge(l, r);
+	}
+
+	template<class T>
+	void ImplicitTreap<T>::reverse(size_t lo, size_t hi)
+	{
+		onRange(lo, hi, [](NodeType* m) { applyReverse(m); });
+	}
+
+	template<class T>
+	void ImplicitTreap<T>::add(size_t lo, size_t hi, const T& delta)
+	{
+		onRange(lo, hi, [&delta](NodeType* m) { applyAdd(m, delta); });
+	}
+
+	template<class T>
+	void ImplicitTreap<T>::assign(size_t lo, size_t hi, const T& value)
+	{
+		onRange(lo, hi, [&value](NodeType* m) { applyAssign(m, value); });
+	}
+
+	template<class T>
+	T ImplicitTreap<T>::sum(size_t lo, size_t hi)
+	{
+		T res = T();
+		onRange(lo, hi, [&res](NodeType* m) { res = m->sum; });
+		return res;
+	}
+
+	template<class T>
+	T ImplicitTreap<T>::min(size_t lo, size_t hi)
+	{
+		T res = T();
+		onRange(lo, hi, [&res](NodeType* m) { res = m->min; });
+		return res;
+	}
+	#pragma endregion
+
+	#pragma region WAVL
+	template<class Key, class Value, class Compare, class Augment, class Layout>
+	WAVLTree<Key, Value, Compare, Augment, Layout>::WAVLTree(const Compare& comp) : Base(comp) {}
+
+	template<class Key, class Value, class Compare, class Augment, class Layout>
+	bool WAVLTree<Key, Value, Compare, Augment, Layout>::twoBelow(const NodeType* node, bool right)
+	{
+		return right ? node->rd : node->ld;
+	}
+
+	template<class Key, class Value, class Compare, class Augment, class Layout>
+	void WAVLTree<Key, Value, Compare, Augment, Layout>::setTwoBelow(NodeType* node, bool right, bool value)
+	{
+		(right ? node->rd = value : node->ld = value);
+	}
+
+	template<class Key, class Value, class Compare, class Augment, class Layout>
+	long long WAVLTree<Key, Value, Compare, Augment, Layout>::rankOf(const NodeType* node)
+	{
+		long long r = -1;
+		for (; node != nullptr; node = node->l)
+			r += 1 + node->ld;
+		return r;
+	}
+
+	template<class Key, class Value, class Compare, class Augment, class Layout>
+	typename WAVLTree<Key, Value, Compare, Augment, Layout>::NodeType*
+	WAVLTree<Key, Value, Compare, Augment, Layout>::lift(NodeType* node, bool right)
+	{
+		if (right)
+			Base::rightRotate(node);
+		else
+			Base::leftRotate(node);
+		return node;
+	}
+
+	template<class Key, class Value, class Compare, class Augment, class Layout>
+	int WAVLTree<Key, Value, Compare, Augment, Layout>::assignRanks(NodeType* node)
+	{
+		if (node == nullptr)
+			return -1;
+		int rl = assignRanks(node->l), rr = assignRanks(node->r), r = std::max(rl, rr) + 1;
+		node->ld = (r - rl == 2), node->rd = (r - rr == 2);
+		return r;
+	}
+
+	template<class Key, class Value, class Compare, class Augment, class Layout>
+	typename WAVLTree<Key, Value, Compare, Augment, Layout>::NodeType*
+	WAVLTree<Key, Value, Compare, Augment, Layout>::fixZeroChild(NodeType* x)
+	{
+		while (true)
+		{
+			NodeType* p = x->parent, * g;
+			bool right = (p->r == x);
+			if (!twoBelow(p, !right))
+			{
+				// 0,1 node: promote it, which moves the violation a level up
+				setTwoBelow(p, !right, true);
+				if ((g = p->parent) == nullptr)
+					return p;
+				bool pRight = (g->r == p);
+				if (twoBelow(g, pRight))
+					return setTwoBelow(g, pRight, false), p;
+				x = p;
+				continue;
+			}
+			// 0,2 node: rotations end it, unless x is a 1,1 node (which only joins produce)
+			NodeType* z = (right ? x->l : x->r);
+			bool inner = twoBelow(x, !right), outer = twoBelow(x, right);
+			if (inner)
+			{
+				lift(p, right);
+				setTwoBelow(p, false, false), setTwoBelow(p, true, false);
+				setTwoBelow(x, !right, false);
+				return x;
+			}
+			if (!outer)
+			{
+				lift(p, right);
+				setTwoBelow(p, right, false);
+				setTwoBelow(x, !right, false), setTwoBelow(x, right, true);
+				if ((g = x->parent) == nullptr)
+					return x;
+				bool xRight = (g->r == x);
+				if (twoBelow(g, xRight))
+					return setTwoBelow(g, xRight, false), x;
+				continue;
+			}
+			bool zSame = twoBelow(z, right), zOther = twoBelow(z, !right);
+			lift(x, !right), lift(p, right);
+			setTwoBelow(x, right, false), setTwoBelow(x, !right, zSame);
+			setTwoBelow(p, !right, false), setTwoBelow(p, right, zOther);
+			setTwoBelow(z, false, false), setTwoBelow(z, true, false);
+			return z;
+		}
+	}
+
+	template<class Key, class Value, class Compare, class Augment, class Layout>
+	typename WAVLTree<Key, Value, Compare, Augment, Layout>::NodeType*
+	WAVLTree<Key, Value, Compare, Augment, Layout>::fixThreeChild(NodeType* p, bool right)
+	{
+		while (true)
+		{
+			NodeType* y = (right ? p->l : p->r), * g;
+			bool demote = twoBelow(p, !right);
+			if (!demote)
+			{
+				bool inner = twoBelow(y, right), outer = twoBelow(y, !right);
+				if (inner && outer)
+				{
+					// Demoting both p and its 2,2 sibling
+					setTwoBelow(y, false, false), setTwoBelow(y, true, false);
+					demote = true;
+				}
+				else if (!outer)
+				{
+					lift(p, !right);
+					setTwoBelow(p, right, true), setTwoBelow(p, !right, inner);
+					bool leaf = (p->l == nullptr && p->r == nullptr);
+					if (leaf)
+						setTwoBelow(p, false, false), setTwoBelow(p, true, false);
+					setTwoBelow(y, right, leaf), setTwoBelow(y, !right, true);
+					return y;
+				}
+				else
+				{
+					NodeType* v = (right ? y->r : y->l);
+					bool vSame = twoBelow(v, right), vOther = twoBelow(v, !right);
+					lift(y, right), lift(p, !right);
+					setTwoBelow(p, right, false), setTwoBelow(p, !right, vSame);
+					setTwoBelow(y, right, vOther), setTwoBelow(y, !right, false);
+					setTwoBelow(v, false, true), setTwoBelow(v, true, true);
+					return v;
+				}
+			}
+			else
+				setTwoBelow(p, !right, false);
+			// p lost a rank, its own rank difference grows by one
+			if ((g = p->parent) == nullptr)
+				return p;
+			bool pRight = (g->r == p);
+			if (!twoBelow(g, pRight))
+				return setTwoBelow(g, pRight, true), p;
+			p = g, right = pRight;
+		}
+	}
+
+	template<class Key, class Value, class Compare, class Augment, class Layout>
+	typename WAVLTree<Key, Value, Compare, Augment, Layout>::NodeType*
+	WAVLTree<Key, Value, Compare, Augment, Layout>::joinNodes(NodeType* l, NodeType* mid, NodeType* r)
+	{
+		long long rl = rankOf(l), rr = rankOf(r), rc;
+		NodeType* p = nullptr, * c;
+		if (rl > rr + 1)
+		{
+			for (c = l, rc = rl; rc > rr + 1; c = c->r)
+				p = c, rc -= 1 + c->rd;
+			p->r = mid, l = c, rl = rc;
+		}
+		else if (rr > rl + 1)
+		{
+			for (c = r, rc = rr; rc > rl + 1; c = c->l)
+				p = c, rc -= 1 + c->ld;
+			p->l = mid, r = c, rr = rc;
+		}
+		mid->parent = p;
+		if ((mid->l = l) != nullptr)
+			l->parent = mid;
+		if ((mid->r = r) != nullptr)
+			r->parent = mid;
+		long long rm = std::max(rl, rr) + 1;
+		mid->ld = (rm - rl == 2), mid->rd = (rm - rr == 2);
+		mid->update();
+		if (p != nullptr)
+		{
+			bool right = (p->r == mid);
+			if (twoBelow(p, right))
+				setTwoBelow(p, right, false);
+			else
+				fixZeroChild(mid);
+		}
+		NodeType* q = mid;
+		for (; q->parent != nullptr; q = q->parent)
+			q->update();
+		q->update();
+		return q;
+	}
+
+	template<class Key, class Value, class Compare, class Augment, class Layout>
+	void WAVLTree<Key, Value, Compare, Augment, Layout>::settle(NodeType* node, NodeType* top)
+	{
+		if constexpr (NodeType::augmented)
+		{
+			for (; node != nullptr; node = node->parent)
+				node->update(), top = node;
+		}
+		if (top != nullptr && top->parent == nullptr)
+			tree = top;
+	}
+
+	template<class Key, class Value, class Compare, class Augment, class Layout>
+	template<class Iterator>
+	void WAVLTree<Key, Value, Compare, Augment, Layout>::buildFromSorted(Iterator begin, Iterator end)
+	{
+		Base::clear();
+		tree = Base::buildBalanced(begin, (size_t)std::distance(begin, end), 0, [](NodeType*, uint32_t) {});
+		assignRanks(tree);
+	}
+
+	template<class Key, class Value, class Compare, class Augment, class Layout>
+	const typename WAVLTree<Key, Value, Compare, Augment, Layout>::NodeType*
+	WAVLTree<Key, Value, Compare, Augment, Layout>::insert(const Key& key, const MappedType& value)
+	{
+		if (tree == nullptr)
+		{
+			tree = Base::createNode(key, value);
+			return tree;
+		}
+		NodeType* p = tree, * ret;
+		bool left;
+		while (true)
+		{
+			if (left = comp(key, p->elem))
+			{
+				if (p->l == nullptr)
+					break;
+				p = p->l;
+			}
+			else if (comp(p->elem, key))
+			{
+				if (p->r == nullptr)
+					break;
+				p = p->r;
+			}
+			else
+				return Base::revive(p, value);
+		}
+		ret = (left ? p->l = Base::createNode(key, value, p) : p->r = Base::createNode(key, value, p));
+		// The leaf is a 1-child of a unary parent, or a 0-child of a leaf
+		NodeType* top = p;
+		if (twoBelow(p, !left))
+			setTwoBelow(p, !left, false);
+		else
+			top = fixZeroChild(ret);
+		settle(ret, top);
+		return ret;
+	}
+
+	template<class Key, class Value, class Compare, class Augment, class Layout>
+	bool WAVLTree<Key, Value, Compare, Augment, Layout>::erase(const Key& key)
+	{
+		if constexpr (NodeType::AugmentPolicy::tombstones)
+			return Base::markDead(key);
+		NodeType* y = tree;
+		while (y != nullptr && (comp(key, y->elem) || comp(y->elem, key)))
+			y = (comp(y->elem, key) ? y->r : y->l);
+		if (y == nullptr)
+			return false;
+		eraseNode(y);
+		return true;
+	}
+
+	template<class Key, class Value, class Compare, class Augment, class Layout>
+	void WAVLTree<Key, Value, Compare, Augment, Layout>::eraseNode(NodeType* y)
+	{
+		if (y->l != nullptr && y->r != nullptr)
+			Base::exchange(y, Base::findNearestGT(y));
+		NodeType* x = (y->l != nullptr ? y->l : y->r), * p = y->parent, * top;
+		if (x != nullptr)
+			x->parent = p;
+		if (p == nullptr)
+		{
+			Base::destroyNode(y), tree = x;
+			return;
+		}
+		bool right = (p->r == y);
+		(right ? p->r = x : p->l = x);
+		Base::destroyNode(y);
+		// x is a rank lower than y was
+		top = p;
+		if (twoBelow(p, right))
+			top = fixThreeChild(p, right);
+		else
+		{
+			setTwoBelow(p, right, true);
+			if (p->l == nullptr && p->r == nullptr && twoBelow(p, !right))
+			{
+				// 2,2 leaf
+				setTwoBelow(p, false, false), setTwoBelow(p, true, false);
+				NodeType* g = p->parent;
+				if (g != nullptr)
+				{
+					bool pRight = (g->r == p);
+					if (twoBelow(g, pRight))
+						top = fixThreeChild(g, pRight);
+					else
+						setTwoBelow(g, pRight, true);
+				}
+			}
+		}
+		settle(p, top);
+	}
+	#pragma endregion
+
+	#pragma region Scapegoat
+	template<class Key, class Value, class Compare, class Augment, class Layout>
+	ScapegoatTree<Key, Value, Compare, Augment, Layout>::ScapegoatTree(const Compare& comp, double alpha)
+		: Base(comp), balance(0.), depthFactor(0.), maxCount(0)
+	{
+		setAlpha(alpha);
+	}
+
+	template<class Key, class Value, class Compare, class Augment, class Layout>
+	void ScapegoatTree<Key, Value, Compare, Augment, Layout>::setAlpha(double alpha)
+	{
+		balance = auxillary::clamp(alpha, .5, .99);
+		depthFactor = -1. / std::log(balance);
+	}
+
+	template<class Key, class Value, class Compare, class Augment, class Layout>
+	double ScapegoatTree<Key, Value, Compare, Augment, Layout>::alpha() const
+	{
+		return balance;
+	}
+
+	template<class Key, class Value, class Compare, class Augment, class Layout>
+	bool ScapegoatTree<Key, Value, Compare, Augment, Layout>::unbalanced(const NodeType* node, double alpha)
+	{
+		return (double)std::max(Base::countNodes(node->l), Base::countNodes(node->r)) > alpha * node->n;
+	}
+
+	template<class Key, class Value, class Compare, class Augment, class Layout>
+	typename ScapegoatTree<Key, Value, Compare, Augment, Layout>::NodeType*
+	ScapegoatTree<Key, Value, Compare, Augment, Layout>::linkBalanced(NodeType** nodes, size_t count)
+	{
+		if (count == 0)
+			return nullptr;
+		NodeType* node = nodes[count / 2],
+			* l = linkBalanced(nodes, count / 2), * r = linkBalanced(nodes + count / 2 + 1, count - count / 2 - 1);
+		if ((node->l = l) != nullptr)
+			l->parent = node;
+		if ((node->r = r) != nullptr)
+			r->parent = node;
+		node->update();
+		return node;
+	}
+
+	template<class Key, class Value, class Compare, class Augment, class Layout>
+	typename ScapegoatTree<Key, Value, Compare, Augment, Layout>::NodeType*
+	ScapegoatTree<Key, Value, Compare, Augment, Layout>::rebuild(NodeType* node)
+	{
+		NodeType* parent = node->parent, * p = node;
+		bool right = (parent != nullptr && parent->r == node);
+		std::vector<NodeType*> nodes(node->n);
+		while (p->l != nullptr)
+			p = p->l;
+		for (NodeType*& slot : nodes)
+			slot = p, p = Base::findNext(p);
+		node = linkBalanced(nodes.data(), nodes.size());
+		node->parent = parent;
+		if (parent != nullptr)
+			(right ? parent->r = node : parent->l = node);
+		return node;
+	}
+
+	template<class Key, class Value, class Compare, class Augment, class Layout>
+	typename ScapegoatTree<Key, Value, Compare, Augment, Layout>::NodeType*
+	ScapegoatTree<Key, Value, Compare, Augment, Layout>::joinNodes(NodeType* l, NodeType* mid, NodeType* r)
+	{
+		size_t nl = Base::countNodes(l), nr = Base::countNodes(r);
+		NodeType* p = nullptr, * c;
+		if (nl > nr)
+		{
+			for (c = l; c != nullptr && c->n > JoinBalance * (c->n + nr + 1); c = c->r)
+				p = c;
+			if (p != nullptr)
+				p->r = mid, l = c;
+		}
+		else
+		{
+			for (c = r; c != nullptr && c->n > JoinBalance * (c->n + nl + 1); c = c->l)
+				p = c;
+			if (p != nullptr)
+				p->l = mid, r = c;
+		}
+		mid->parent = p;
+		if ((mid->l = l) != nullptr)
+			l->parent = mid;
+		if ((mid->r = r) != nullptr)
+			r->parent = mid;
+		NodeType* root = mid, * top = nullptr;
+		for (p = mid; p != nullptr; root = p, p = p->parent)
+		{
+			p->update();
+			if (unbalanced(p, JoinBalance))
+				top = p;
+		}
+		if (top != nullptr)
+		{
+			// Sizes above the rebuilt subtree stay the same, heights may drop
+			top = rebuild(top);
+			if (top->parent == nullptr)
+				root = top;
+			else if constexpr (NodeType::AugmentPolicy::height)
+			{
+				for (p = top->parent; p != nullptr; p = p->parent)
+					p->update();
+			}
+		}
+		return root;
+	}
+
+	template<class Key, class Value, class Compare, class Augment, class Layout>
+	const typename ScapegoatTree<Key, Value, Compare, Augment, Layout>::NodeType*
+	ScapegoatTree<Key, Value, Compare, Augment, Layout>::insert(const Key& key, const MappedType& value)
+	{
+		if (tree == nullptr)
+		{
+			tree = Base::createNode(key, value);
+			maxCount = std::max(maxCount, count);
+			return tree;
+		}
+		NodeType* p = tree, * ret;
+		size_t depth = 1;
+		bool left;
+		for (;; ++depth)
+		{
+			if (left = comp(key, p->elem))
+			{
+				if (p->l == nullptr)
+					break;
+				p = p->l;
+			}
+			else if (comp(p->elem, key))
+			{
+				if (p->r == nullptr)
+					break;
+				p = p->r;
+			}
+			else
+				return Base::revive(p, value);
+		}
+		ret = (left ? p->l = Base::createNode(key, value, p) : p->r = Base::createNode(key, value, p));
+		maxCount = std::max(maxCount, count);
+		// A node deeper than log(count) in base 1 / alpha has an unbalanced ancestor, the lowest one is rebuilt
+		bool deep = depth > depthFactor * std::log((double)count);
+		NodeType* scapegoat = nullptr;
+		for (; p != nullptr; p = p->parent)
+		{
+			p->update();
+			if (deep && scapegoat == nullptr && unbalanced(p, balance))
+				scapegoat = p;
+		}
+		if (scapegoat != nullptr)
+		{
+			scapegoat = rebuild(scapegoat);
+			if (scapegoat->parent == nullptr)
+				tree = scapegoat;
+			else if constexpr (NodeType::AugmentPolicy::height)
+			{
+				for (p = scapegoat->parent; p != nullptr; p = p->parent)
+					p->update();
+			}
+		}
+		return ret;
+	}
+
+	template<class Key, class Value, class Compare, class Augment, class Layout>
+	bool ScapegoatTree<Key, Value, Compare, Augment, Layout>::erase(const Key& key)
+	{
+		if constexpr (NodeType::AugmentPolicy::tombstones)
+			return Base::markDead(key);
+		NodeType* y = tree;
+		while (y != nullptr && (comp(key, y->elem) || comp(y->elem, key)))
+			y = (comp(y->elem, key) ? y->r : y->l);
+		if (y == nullptr)
+			return false;
+		eraseNode(y);
+		return true;
+	}
+
+	template<class Key, class Value, class Compare, class Augment, class Layout>
+	void ScapegoatTree<Key, Value, Compare, Augment, Layout>::eraseNode(NodeType* y)
+	{
+		if (y->l != nullptr && y->r != nullptr)
+			Base::exchange(y, Base::findNearestGT(y));
+		maxCount = std::max(maxCount, count);
+		NodeType* x = (y->l != nullptr ? y->l : y->r), * p = y->parent;
+		if (x != nullptr)
+			x->parent = p;
+		if (p == nullptr)
+			tree = x;
+		else
+			(p->r == y ? p->r = x : p->l = x);
+		Base::destroyNode(y);
+		for (; p != nullptr; p = p->parent)
+			p->update();
+		if (count < balance * maxCount)
+		{
+			// The whole tree is relinked perfectly balanced, its nodes stay where they are for the handles
+			if (tree != nullptr)
+				tree = rebuild(tree);
+			maxCount = count;
+		}
+	}
+	#pragma endregion
+
+	#pragma region Splay
+	template<class Key, class Value, class Compare, class Augment, class Layout>
+	thread_local std::mt19937 SplayTree<Key, Value, Compare, Augment, Layout>::rng(auxillary::threadSeed());
+
+	template<class Key, class Value, class Compare, class Augment, class Layout>
+	SplayTree<Key, Value, Compare, Augment, Layout>::SplayTree(const Compare& comp)
+		: Base(comp), mode(SplayMode::TopDown), probability(1.) {}
+
+	template<class Key, class Value, class Compare, class Augment, class Layout>
+	void SplayTree<Key, Value, Compare, Augment, Layout>::setSplayMode(SplayMode mode, double probability)
+	{
+		this->mode = mode, this->probability = auxillary::clamp(probability, 0., 1.);
+	}
+
+	template<class Key, class Value, class Compare, class Augment, class Layout>
+	SplayMode SplayTree<Key, Value, Compare, Augment, Layout>::splayMode() const
+	{
+		return mode;
+	}
+
+	template<class Key, class Value, class Compare, class Augment, class Layout>
+	typename SplayTree<Key, Value, Compare, Augment, Layout>::NodeType*
+	SplayTree<Key, Value, Compare, Augment, Layout>::joinNodes(NodeType* l, NodeType* mid, NodeType* r)
+	{
+		mid->parent = nullptr;
+		if ((mid->l = l) != nullptr)
+			l->parent = mid;
+		if ((mid->r = r) != nullptr)
+			r->parent = mid;
+		mid->update();
+		return mid;
+	}
+
+	template<class Key, class Value, class Compare, class Augment, class Layout>
+	void SplayTree<Key, Value, Compare, Augment, Layout>::rotateUp(NodeType* node)
+	{
+		NodeType* p = node->parent, * g = p->parent;
+		if (p->l == node)
+		{
+			if ((p->l = node->r) != nullptr)
+				p->l->parent = p;
+			node->r = p;
+		}
+		else
+		{
+			if ((p->r = node->l) != nullptr)
+				p->r->parent = p;
+			node->l = p;
+		}
+		p->parent = node, node->parent = g;
+		if (g != nullptr)
+			(g->l == p ? g->l = node : g->r = node);
+		p->update();
+	}
+
+	template<class Key, class Value, class Compare, class Augment, class Layout>
+	typename SplayTree<Key, Value, Compare, Augment, Layout>::NodeType*
+	SplayTree<Key, Value, Compare, Augment, Layout>::splay(NodeType* node)
+	{
+		// Only the node being lifted is out of date between the steps
+		while (node->parent != nullptr)
+		{
+			NodeType* p = node->parent, * g = p->parent;
+			if (g == nullptr)
+				rotateUp(node);
+			else if ((g->l == p) != (p->l == node))
+				rotateUp(node), rotateUp(node);
+			else if (mode == SplayMode::Semi)
+				node->update(), rotateUp(p), node = p;
+			else
+				rotateUp(p), rotateUp(node);
+		}
+		node->update();
+		return tree = node;
+	}
+
+	template<class Key, class Value, class Compare, class Augment, class Layout>
+	typename SplayTree<Key, Value, Compare, Augment, Layout>::NodeType*
+	SplayTree<Key, Value, Compare, Augment, Layout>::splayKey(const Key& key)
+	{
+		// Nodes passed on the way down are hung on the right spine of the left tree (keys less than key)
+		// or the left spine of the right tree, which become the subtrees of the last node reached
+		NodeType* t = tree, * lRoot = nullptr, * lLast = nullptr, * rRoot = nullptr, * rLast = nullptr, * y;
+		if (t == nullptr)
+			return nullptr;
+		while (true)
+		{
+			if (comp(key, t->elem))
+			{
+				if ((y = t->l) == nullptr)
+					break;
+				if (comp(key, y->elem))
+				{
+					if ((t->l = y->r) != nullptr)
+						t->l->parent = t;
+					y->r = t, t->parent = y;
+					t->update();
+					if ((t = y)->l == nullptr)
+						break;
+				}
+				if (rLast == nullptr)
+					rRoot = t;
+				else
+					rLast->l = t;
+				t->parent = rLast, rLast = t, t = t->l;
+			}
+			else if (comp(t->elem, key))
+			{
+				if ((y = t->r) == nullptr)
+					break;
+				if (comp(y->elem, key))
+				{
+					if ((t->r = y->l) != nullptr)
+						t->r->parent = t;
+					y->l = t, t->parent = y;
+					t->update();
+					if ((t = y)->r == nullptr)
+						break;
+				}
+				if (lLast == nullptr)
+					lRoot = t;
+				else
+					lLast->r = t;
+				t->parent = lLast, lLast = t, t = t->r;
+			}
+			else
+				break;
+		}
+		if (lLast != nullptr)
+		{
+			if ((lLast->r = t->l) != nullptr)
+				lLast->r->parent = lLast;
+			t->l = lRoot, lRoot->parent = t;
+		}
+		if (rLast != nullptr)
+		{
+			if ((rLast->l = t->r) != nullptr)
+				rLast->l->parent = rLast;
+			t->r = rRoot, rRoot->parent = t;
+		}
+		t->parent = nullptr;
+		if constexpr (NodeType::augmented)
+		{
+			for (; lLast != nullptr && lLast != t; lLast = lLast->parent)
+				lLast->update();
+			for (; rLast != nullptr && rLast != t; rLast = rLast->parent)
+				rLast->update();
+			t->update();
+		}
+		return tree = t;
+	}
+
+	template<class Key, class Value, class Compare, class Augment, class Layout>
+	bool SplayTree<Key, Value, Compare, Augment, Layout>::splayNow()
+	{
+		return probability >= 1. || std::uniform_real_distribution<double>()(rng) < probability;
+	}
+
+	template<class Key, class Value, class Compare, class Augment, class Layout>
+	typename SplayTree<Key, Value, Compare, Augment, Layout>::NodeType*
+	SplayTree<Key, Value, Compare, Augment, Layout>::bound(const Key& key, bool upper)
+	{
+		bool restructure = splayNow();
+		NodeType* p, * last;
+		if (restructure && mode == SplayMode::TopDown)
+		{
+			// The root is now the last node of the search path, the bound is the root or its successor
+			p = splayKey(key);
+			if (p != nullptr && (upper ? !comp(key, p->elem) : comp(p->elem, key)))
+				p = Base::findNext(p);
+			while (p != nullptr && Base::isDead(p))
+				p = Base::findNext(p);
+			return p;
+		}
+		p = (upper ? Base::upperBound(key, last) : Base::lowerBound(key, last));
+		if (restructure && (p != nullptr || last != nullptr))
+			splay(p != nullptr ? p : last);
+		return p;
+	}
+
+	template<class Key, class Value, class Compare, class Augment, class Layout>
+	typename SplayTree<Key, Value, Compare, Augment, Layout>::iterator
+	SplayTree<Key, Value, Compare, Augment, Layout>::find(const Key& key)
+	{
+		NodeType* p = bound(key, false);
+		return Base::makeIterator(p != nullptr && !comp(key, p->elem) ? p : nullptr);
+	}
+
+	template<class Key, class Value, class Compare, class Augment, class Layout>
+	bool SplayTree<Key, Value, Compare, Augment, Layout>::contains(const Key& key)
+	{
+		return find(key) != Base::end();
+	}
+
+	template<class Key, class Value, class Compare, class Augment, class Layout>
+	typename SplayTree<Key, Value, Compare, Augment, Layout>::iterator
+	SplayTree<Key, Value, Compare, Augment, Layout>::lower_bound(const Key& key)
+	{
+		return Base::makeIterator(bound(key, false));
+	}
+
+	template<class Key, class Value, class Compare, class Augment, class Layout>
+	typename SplayTree<Key, Value, Compare, Augment, Layout>::iterator
+	SplayTree<Key, Value, Compare, Augment, Layout>::upper_bound(const Key& key)
+	{
+		return Base::makeIterator(bound(key, true));
+	}
+
+	template<class Key, class Value, class Compare, class Augment, class Layout>
+	const typename SplayTree<Key, Value, Compare, Augment, Layout>::NodeType*
+	SplayTree<Key, Value, Compare, Augment, Layout>::insert(const Key& key, const MappedType& value)
+	{
+		if (tree == nullptr)
+		{
+			tree = Base::createNode(key, value);
+			return tree;
+		}
+		NodeType* p = tree;
+		if (mode == SplayMode::TopDown)
+		{
+			// The new node becomes the root, splitting the splayed tree around key
+			p = splayKey(key);
+			if (!comp(key, p->elem) && !comp(p->elem, key))
+				return Base::revive(p, value);
+			NodeType* node = Base::createNode(key, value);
+			if (comp(key, p->elem))
+			{
+				if ((node->l = p->l) != nullptr)
+					node->l->parent = node;
+				p->l = nullptr, node->r = p;
+			}
+			else
+			{
+				if ((node->r = p->r) != nullptr)
+					node->r->parent = node;
+				p->r = nullptr, node->l = p;
+			}
+			p->parent = node;
+			p->update(), node->update();
+			return tree = node;
+		}
+		bool left;
+		while (true)
+		{
+			if (left = comp(key, p->elem))
+			{
+				if (p->l == nullptr)
+					break;
+				p = p->l;
+			}
+			else if (comp(p->elem, key))
+			{
+				if (p->r == nullptr)
+					break;
+				p = p->r;
+			}
+			else
+				return Base::revive(p, value);
+		}
+		if (left)
+			p = p->l = Base::createNode(key, value, p);
+		else
+			p = p->r = Base::createNode(key, value, p);
+		splay(p);
+		return p;
+	}
+
+	template<class Key, class Value, class Compare, class Augment, class Layout>
+	bool SplayTree<Key, Value, Compare, Augment, Layout>::erase(const Key& key)
+	{
+		if constexpr (NodeType::AugmentPolicy::tombstones)
+			return Base::markDead(key);
+		if (tree == nullptr)
+			return false;
+		NodeType* p = tree;
+		if (mode == SplayMode::TopDown)
+		{
+			// The splayed root is replaced by its left subtree with the maximum splayed up, which has no right child
+			p = splayKey(key);
+			if (comp(key, p->elem) || comp(p->elem, key))
+				return false;
+			NodeType* l = Base::detach(p->l), * r = Base::detach(p->r);
+			Base::destroyNode(p);
+			if ((tree = l) == nullptr)
+				tree = r;
+			else
+			{
+				splayKey(key);
+				if ((tree->r = r) != nullptr)
+					r->parent = tree;
+				tree->update();
+			}
+			return true;
+		}
+		while (p != nullptr && (comp(key, p->elem) || comp(p->elem, key)))
+			p = (comp(p->elem, key) ? p->r : p->l);
+		if (p == nullptr)
+			return false;
+		eraseNode(p);
+		return true;
+	}
+
+	template<class Key, class Value, class Compare, class Augment, class Layout>
+	void SplayTree<Key, Value, Compare, Augment, Layout>::eraseNode(NodeType* p)
+	{
+		static auto n = [](const NodeType* node)
+		{
+			if constexpr (NodeType::AugmentPolicy::size)
+				return (long long)(node == nullptr ? 0 : node->n);
+			else
+				return (long long)(node != nullptr);
+		};
+		// Handles are erased bottom-up in every mode: the node sinks to a leaf and its parent is splayed
+		while (p->l != nullptr || p->r != nullptr)
+			Base::exchange(p, n(p->l) > n(p->r) ? Base::findNearestLT(p) : Base::findNearestGT(p));
+		if (p->parent == nullptr)
+		{
+			Base::destroyNode(tree), tree = nullptr;
+			return;
+		}
+		bool leftSon = (p->parent->l == p);
+		p = p->parent;
+		if (leftSon)
+			Base::destroyNode(p->l), p->l = nullptr;
+		else
+			Base::destroyNode(p->r), p->r = nullptr;
+		splay(p);
+	}
+	#pragma endregion
+
+	#pragma region BTree
+	template<class Key, class Value, class Compare, size_t KeyBytes>
+	BTree<Key, Value, Compare, KeyBytes>::BTree(const Compare& comp) : tree(nullptr), head(nullptr), tail(nullptr), comp(comp) {}
+
+	template<class Key, class Value, class Compare, size_t KeyBytes>
+	BTree<Key, Value, Compare, KeyBytes>::~BTree()
+	{
+		clear();
+	}
+
+	template<class Key, class Value, class Compare, size_t KeyBytes>
+	template<bool OrEqual>
+	uint32_t BTree<Key, Value, Compare, KeyBytes>::search(const NodeType* node, const Key& key) const
+	{
+		#if defined(__AVX2__)
+		if constexpr (Vectorized)
+		{
+			// Sorted keys compare true on a prefix of the lanes, the first vector not true in full ends the scan.
+			// Unsigned keys are compared as signed ones with the sign bit flipped
+			constexpr uint32_t Lanes = 32 / sizeof(Key), Full = (1u << Lanes) - 1;
+			__m256i flip, k;
+			if constexpr (sizeof(Key) == 8)
+				flip = _mm256_set1_epi64x(std::is_signed<Key>::value ? 0 : INT64_MIN), k = _mm256_set1_epi64x((long long)key);
+			else
+				flip = _mm256_set1_epi32(std::is_signed<Key>::value ? 0 : INT32_MIN), k = _mm256_set1_epi32((int)key);
+			k = _mm256_xor_si256(k, flip);
+			uint32_t found = 0;
+			for (uint32_t i = 0; i < node->count; i += Lanes)
+			{
+				__m256i v = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(node->keys + i)), flip);
+				uint32_t mask;
+				if constexpr (sizeof(Key) == 8)
+					mask = (uint32_t)_mm256_movemask_pd(_mm256_castsi256_pd(OrEqual ? _mm256_cmpgt_epi64(v, k) : _mm256_cmpgt_epi64(k, v)));
+				else
+					mask = (uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(OrEqual ? _mm256_cmpgt_epi32(v, k) : _mm256_cmpgt_epi32(k, v)));
+				if constexpr (OrEqual)
+					mask ^= Full;
+				if (node->count - i < Lanes)
+					mask &= (1u << (node->count - i)) - 1;
+				found += (uint32_t)_mm_popcnt_u32(mask);
+				if (mask != Full)
+					break;
+			}
+			return found;
+		}
+		#endif
+		if constexpr (OrEqual)
+			return (uint32_t)(std::upper_bound(node->keys, node->keys + node->count, key, comp) - node->keys);
+		else
+			return (uint32_t)(std::lower_bound(node->keys, node->keys + node->count, key, comp) - node->keys);
+	}
+
+	template<class Key, class Value, class Compare, size_t KeyBytes>
+	typename BTree<Key, Value, Compare, KeyBytes>::LeafType* BTree<Key, Value, Compare, KeyBytes>::descend(const Key& key, Path* path) const
+	{
+		NodeType* p = tree;
+		if (path != nullptr)
+			path->depth = 0;
+		while (p->h > 1)
+		{
+			InnerType* q = static_cast<InnerType*>(p);
+			uint32_t i = search<true>(q, key);
+			if (path != nullptr)
+				path->nodes[path->depth] = q, path->slots[path->depth++] = i;
+			p = q->children[i];
+		}
+		return static_cast<LeafType*>(p);
+	}
+
+	template<class Key, class Value, class Compare, size_t KeyBytes>
+	template<bool OrEqual>
+	size_t BTree<Key, Value, Compare, KeyBytes>::countBelow(const Key& key) const
+	{
+		if (tree == nullptr)
+			return 0;
+		size_t r = 0;
+		const NodeType* p = tree;
+		while (p->h > 1)
+		{
+			const InnerType* q = static_cast<const InnerType*>(p);
+			uint32_t i = search<true>(q, key);
+			for (uint32_t j = 0; j < i; ++j)
+				r += q->children[j]->n;
+			p = q->children[i];
+		}
+		return r + search<OrEqual>(p, key);
+	}
+
+	template<class Key, class Value, class Compare, size_t KeyBytes>
+	typename BTree<Key, Value, Compare, KeyBytes>::LeafType* BTree<Key, Value, Compare, KeyBytes>::createLeaf()
+	{
+		LeafType* leaf = leafPool.create();
+		leaf->count = 0, leaf->h = 1, leaf->n = 0;
+		leaf->prev = leaf->next = nullptr;
+		return leaf;
+	}
+
+	template<class Key, class Value, class Compare, size_t KeyBytes>
+	typename BTree<Key, Value, Compare, KeyBytes>::InnerType* BTree<Key, Value, Compare, KeyBytes>::createInner(uint32_t h)
+	{
+		InnerType* node = innerPool.create();
+		node->count = 0, node->h = h, node->n = 0;
+		return node;
+	}
+
+	template<class Key, class Value, class Compare, size_t KeyBytes>
+	void BTree<Key, Value, Compare, KeyBytes>::destroySubtree(NodeType* node)
+	{
+		if (node->h == 1)
+			return leafPool.destroy(static_cast<LeafType*>(node));
+		InnerType* inner = static_cast<InnerType*>(node);
+		for (uint32_t i = 0; i <= inner->count; ++i)
+			destroySubtree(inner->children[i]);
+		innerPool.destroy(inner);
+	}
+
+	template<class Key, class Value, class Compare, size_t KeyBytes>
+	size_t BTree<Key, Value, Compare, KeyBytes>::childrenSize(const InnerType* node)
+	{
+		size_t n = 0;
+		for (uint32_t i = 0; i <= node->count; ++i)
+			n += node->children[i]->n;
+		return n;
+	}
+
+	template<class Key, class Value, class Compare, size_t KeyBytes>
+	template<class T>
+	const Key& BTree<Key, Value, Compare, KeyBytes>::keyOf(const T& item)
+	{
+		if constexpr (std::is_same<T, Key>::value)
+			return item;
+		else
+			return item.first;
+	}
+
+	template<class Key, class Value, class Compare, size_t KeyBytes>
+	void BTree<Key, Value, Compare, KeyBytes>::insertAt(LeafType* leaf, uint32_t i, const Key& key, const MappedType& value)
+	{
+		std::move_backward(leaf->keys + i, leaf->keys + leaf->count, leaf->keys + leaf->count + 1);
+		leaf->keys[i] = key;
+		if constexpr (!std::is_void<Value>::value)
+		{
+			std::move_backward(leaf->values + i, leaf->values + leaf->count, leaf->values + leaf->count + 1);
+			leaf->values[i] = value;
+		}
+		++leaf->count, ++leaf->n;
+	}
+
+	template<class Key, class Value, class Compare, size_t KeyBytes>
+	void BTree<Key, Value, Compare, KeyBytes>::moveEntries(LeafType* from, uint32_t i, LeafType* to, uint32_t j, uint32_t count)
+	{
+		std::move(from->keys + i, from->keys + i + count, to->keys + j);
+		if constexpr (!std::is_void<Value>::value)
+			std::move(from->values + i, from->values + i + count, to->values + j);
+	}
+
+	template<class Key, class Value, class Compare, size_t KeyBytes>
+	typename BTree<Key, Value, Compare, KeyBytes>::LeafType* BTree<Key, Value, Compare, KeyBytes>::splitLeaf(LeafType* leaf)
+	{
+		LeafType* right = createLeaf();
+		moveEntries(leaf, MinCount, right, 0, Capacity - MinCount);
+		right->count = right->n = Capacity - MinCount;
+		leaf->count = leaf->n = MinCount;
+		right->prev = leaf, right->next = leaf->next;
+		if (leaf->next != nullptr)
+			leaf->next->prev = right;
+		else
+			tail = right;
+		leaf->next = right;
+		return right;
+	}
+
+	template<class Key, class Value, class Compare, size_t KeyBytes>
+	typename BTree<Key, Value, Compare, KeyBytes>::InnerType* BTree<Key, Value, Compare, KeyBytes>::splitInner(InnerType* node, uint32_t slot, Key& sep, NodeType* child)
+	{
+		Key keys[Capacity + 1];
+		NodeType* children[Capacity + 2];
+		std::move(node->keys, node->keys + slot, keys);
+		keys[slot] = std::move(sep);
+		std::move(node->keys + slot, node->keys + Capacity, keys + slot + 1);
+		std::copy(node->children, node->children + slot + 1, children);
+		children[slot + 1] = child;
+		std::copy(node->children + slot + 1, node->children + Capacity + 1, children + slot + 2);
+		InnerType* right = createInner(node->h);
+		std::move(keys, keys + MinCount, node->keys);
+		std::copy(children, children + MinCount + 1, node->children);
+		sep = std::move(keys[MinCount]);
+		std::move(keys + MinCount + 1, keys + Capacity + 1, right->keys);
+		std::copy(children + MinCount + 1, children + Capacity + 2, right->children);
+		node->count = MinCount, right->count = Capacity - MinCount;
+		node->n = childrenSize(node), right->n = childrenSize(right);
+		return right;
+	}
+
+	template<class Key, class Value, class Compare, size_t KeyBytes>
+	void BTree<Key, Value, Compare, KeyBytes>::rebalance(InnerType* parent, uint32_t slot)
+	{
+		NodeType* node = parent->children[slot];
+		bool leaf = (node->h == 1);
+		if (slot > 0 && parent->children[slot - 1]->count > MinCount)
+		{
+			// The last entry of the left sibling moves over
+			if (leaf)
+			{
+				LeafType* l = static_cast<LeafType*>(parent->children[slot - 1]), * p = static_cast<LeafType*>(node);
+				std::move_backward(p->keys, p->keys + p->count, p->keys + p->count + 1);
+				if constexpr (!std::is_void<Value>::value)
+					std::move_backward(p->values, p->values + p->count, p->values + p->count + 1);
+				moveEntries(l, l->count - 1, p, 0, 1);
+				--l->count, --l->n, ++p->count, ++p->n;
+				parent->keys[slot - 1] = p->keys[0];
+			}
+			else
+			{
+				InnerType* l = static_cast<InnerType*>(parent->children[slot - 1]), * p = static_cast<InnerType*>(node);
+				std::move_backward(p->keys, p->keys + p->count, p->keys + p->count + 1);
+				std::move_backward(p->children, p->children + p->count + 1, p->children + p->count + 2);
+				p->keys[0] = std::move(parent->keys[slot - 1]);
+				p->children[0] = l->children[l->count];
+				parent->keys[slot - 1] = std::move(l->keys[l->count - 1]);
+				size_t moved = p->children[0]->n;
+				--l->count, l->n -= moved, ++p->count, p->n += moved;
+			}
+			return;
+		}
+		if (slot < parent->count && parent->children[slot + 1]->count > MinCount)
+		{
+			// The first entry of the right sibling moves over
+			if (leaf)
+			{
+				LeafType* r = static_cast<LeafType*>(parent->children[slot + 1]), * p = static_cast<LeafType*>(node);
+				moveEntries(r, 0, p, p->count, 1);
+				std::move(r->keys + 1, r->keys + r->count, r->keys);
+				if constexpr (!std::is_void<Value>::value)
+					std::move(r->values + 1, r->values + r->count, r->values);
+				--r->count, --r->n, ++p->count, ++p->n;
+				parent->keys[slot] = r->keys[0];
+			}
+			else
+			{
+				InnerType* r = static_cast<InnerType*>(parent->children[slot + 1]), * p = static_cast<InnerType*>(node);
+				p->keys[p->count] = std::move(parent->keys[slot]);
+				p->children[p->count + 1] = r->children[0];
+				parent->keys[slot] = std::move(r->keys[0]);
+				std::move(r->keys + 1, r->keys + r->count, r->keys);
+				std::move(r->children + 1, r->children + r->count + 1, r->children);
+				size_t moved = p->children[p->count + 1]->n;
+				--r->count, r->n -= moved, ++p->count, p->n += moved;
+			}
+			return;
+		}
+		// Both siblings are at the minimum: node merges with one of them, the right one of the pair is freed
+		if (slot == parent->count)
+			--slot;
+		if (leaf)
+		{
+			LeafType* l = static_cast<LeafType*>(parent->children[slot]), * r = static_cast<LeafType*>(parent->children[slot + 1]);
+			moveEntries(r, 0, l, l->count, r->count);
+			l->count += r->count, l->n += r->n;
+			if ((l->next = r->next) != nullptr)
+				l->next->prev = l;
+			else
+				tail = l;
+			leafPool.destroy(r);
+		}
+		else
+		{
+			InnerType* l = static_cast<InnerType*>(parent->children[slot]), * r = static_cast<InnerType*>(parent->children[slot + 1]);
+			l->keys[l->count] = std::move(parent->keys[slot]);
+			std::move(r->keys, r->keys + r->count, l->keys + l->count + 1);
+			std::copy(r->children, r->children + r->count + 1, l->children + l->count + 1);
+			l->count += r->count + 1, l->n += r->n;
+			innerPool.destroy(r);
+		}
+		std::move(parent->keys + slot + 1, parent->keys + parent->count, parent->keys + slot);
+		std::move(parent->children + slot + 2, parent->children + parent->count + 1, parent->children + slot + 1);
+		--parent->count;
+	}
+
+	template<class Key, class Value, class Compare, size_t KeyBytes>
+	void BTree<Key, Value, Compare, KeyBytes>::insertRandom(size_t n)
+	{
+		thread_local std::mt19937 rng(auxillary::threadSeed());
+		while (n)
+		{
+			if (insert((Key)rng()))
+				--n;
+		}
+	}
+
+	template<class Key, class Value, class Compare, size_t KeyBytes>
+	template<class Iterator>
+	void BTree<Key, Value, Compare, KeyBytes>::buildFromSorted(Iterator begin, Iterator end)
+	{
+		clear();
+		size_t total = (size_t)std::distance(begin, end);
+		if (total == 0)
+			return;
+		// The entries are spread evenly over as few nodes as possible, a level at a time.
+		// lows holds the smallest key under each node, the separators of the level above
+		std::vector<NodeType*> level((total + Capacity - 1) / Capacity), upper;
+		std::vector<Key> lows(level.size()), upperLows;
+		LeafType* prev = nullptr;
+		for (size_t j = 0; j < level.size(); ++j)
+		{
+			LeafType* leaf = createLeaf();
+			uint32_t take = (uint32_t)(total / level.size() + (j < total % level.size()));
+			for (uint32_t i = 0; i < take; ++i, ++begin)
+			{
+				leaf->keys[i] = keyOf(*begin);
+				if constexpr (!std::is_void<Value>::value)
+					leaf->values[i] = begin->second;
+			}
+			leaf->count = take, leaf->n = take;
+			lows[j] = leaf->keys[0];
+			if ((leaf->prev = prev) != nullptr)
+				prev->next = leaf;
+			else
+				head = leaf;
+			level[j] = prev = leaf;
+		}
+		tail = prev;
+		while (level.size() > 1)
+		{
+			size_t parents = (level.size() + Capacity) / (Capacity + 1);
+			upper.resize(parents), upperLows.resize(parents);
+			for (size_t j = 0, c = 0; j < parents; ++j)
+			{
+				InnerType* node = createInner(level[0]->h + 1);
+				size_t take = level.size() / parents + (j < level.size() % parents);
+				upperLows[j] = lows[c];
+				for (size_t i = 0; i < take; ++i, ++c)
+				{
+					node->children[i] = level[c], node->n += level[c]->n;
+					if (i > 0)
+						node->keys[i - 1] = lows[c];
+				}
+				node->count = (uint32_t)take - 1;
+				upper[j] = node;
+			}
+			level.swap(upper), lows.swap(upperLows);
+		}
+		tree = level[0];
+	}
+
+	template<class Key, class Value, class Compare, size_t KeyBytes>
+	void BTree<Key, Value, Compare, KeyBytes>::clear()
+	{
+		// The arenas are released whole, nodes only need visiting to run their destructors
+		if constexpr (!std::is_trivially_destructible<LeafType>::value)
+		{
+			if (tree != nullptr)
+				destroySubtree(tree);
+		}
+		leafPool.clear(), innerPool.clear();
+		tree = nullptr, head = tail = nullptr;
+	}
+
+	template<class Key, class Value, class Compare, size_t KeyBytes>
+	size_t BTree<Key, Value, Compare, KeyBytes>::size() const
+	{
+		return tree == nullptr ? 0 : tree->n;
+	}
+
+	template<class Key, class Value, class Compare, size_t KeyBytes>
+	const typename BTree<Key, Value, Compare, KeyBytes>::NodeType* BTree<Key, Value, Compare, KeyBytes>::rootPtr() const
+	{
+		return tree;
+	}
+
+	template<class Key, class Value, class Compare, size_t KeyBytes>
+	typename BTree<Key, Value, Compare, KeyBytes>::iterator BTree<Key, Value, Compare, KeyBytes>::begin() const
+	{
+		return iterator(head, 0, this);
+	}
+
+	template<class Key, class Value, class Compare, size_t KeyBytes>
+	typename BTree<Key, Value, Compare, KeyBytes>::iterator BTree<Key, Value, Compare, KeyBytes>::end() const
+	{
+		return iterator(nullptr, 0, this);
+	}
+
+	template<class Key, class Value, class Compare, size_t KeyBytes>
+	typename BTree<Key, Value, Compare, KeyBytes>::iterator BTree<Key, Value, Compare, KeyBytes>::find(const Key& key) const
+	{
+		iterator it = lower_bound(key);
+		if (it.leaf != nullptr && !comp(key, *it))
+			return it;
+		return end();
+	}
+
+	template<class Key, class Value, class Compare, size_t KeyBytes>
+	bool BTree<Key, Value, Compare, KeyBytes>::contains(const Key& key) const
+	{
+		return find(key).leaf != nullptr;
+	}
+
+	template<class Key, class Value, class Compare, size_t KeyBytes>
+	typename BTree<Key, Value, Compare, KeyBytes>::iterator BTree<Key, Value, Compare, KeyBytes>::lower_bound(const Key& key) const
+	{
+		if (tree == nullptr)
+			return end();
+		const LeafType* leaf = descend(key, nullptr);
+		uint32_t i = search<false>(leaf, key);
+		if (i == leaf->count)
+			leaf = leaf->next, i = 0;
+		return iterator(leaf, i, this);
+	}
+
+	template<class Key, class Value, class Compare, size_t KeyBytes>
+	typename BTree<Key, Value, Compare, KeyBytes>::iterator BTree<Key, Value, Compare, KeyBytes>::upper_bound(const Key& key) const
+	{
+		if (tree == nullptr)
+			return end();
+		const LeafType* leaf = descend(key, nullptr);
+		uint32_t i = search<true>(leaf, key);
+		if (i == leaf->count)
+			leaf = leaf->next, i = 0;
+		return iterator(leaf, i, this);
+	}
+
+	template<class Key, class Value, class Compare, size_t KeyBytes>
+	typename BTree<Key, Value, Compare, KeyBytes>::iterator BTree<Key, Value, Compare, KeyBytes>::select(size_t k) const
+	{
+		if (k >= size())
+			return end();
+		const NodeType* p = tree;
+		while (p->h > 1)
+		{
+			const InnerType* q = static_cast<const InnerType*>(p);
+			uint32_t i = 0;
+			for (; k >= q->children[i]->n; ++i)
+				k -= q->children[i]->n;
+			p = q->children[i];
+		}
+		return iterator(static_cast<const LeafType*>(p), (uint32_t)k, this);
+	}
+
+	template<class Key, class Value, class Compare, size_t KeyBytes>
+	size_t BTree<Key, Value, Compare, KeyBytes>::rank(const Key& key) const
+	{
+		return countBelow<false>(key);
+	}
+
+	template<class Key, class Value, class Compare, size_t KeyBytes>
+	size_t BTree<Key, Value, Compare, KeyBytes>::countInRange(const Key& lo, const Key& hi) const
+	{
+		if (comp(hi, lo))
+			return 0;
+		return countBelow<true>(hi) - countBelow<false>(lo);
+	}
+
+	template<class Key, class Value, class Compare, size_t KeyBytes>
+	typename BTree<Key, Value, Compare, KeyBytes>::iterator BTree<Key, Value, Compare, KeyBytes>::percentile(double p) const
+	{
+		size_t n = size();
+		if (n == 0)
+			return end();
+		size_t k = (size_t)std::ceil(auxillary::clamp(p, 0., 1.) * n);
+		return select(k == 0 ? 0 : k - 1);
+	}
+
+	template<class Key, class Value, class Compare, size_t KeyBytes>
+	bool BTree<Key, Value, Compare, KeyBytes>::insert(const Key& key, const MappedType& value)
+	{
+		if (tree == nullptr)
+		{
+			LeafType* leaf = createLeaf();
+			insertAt(leaf, 0, key, value);
+			tree = head = tail = leaf;
+			return true;
+		}
+		Path path;
+		LeafType* leaf = descend(key, &path);
+		uint32_t i = search<false>(leaf, key);
+		if (i < leaf->count && !comp(key, leaf->keys[i]))
+			return false;
+		for (uint32_t d = 0; d < path.depth; ++d)
+			++path.nodes[d]->n;
+		if (leaf->count < Capacity)
+		{
+			insertAt(leaf, i, key, value);
+			return true;
+		}
+		// A full leaf splits in two, the split goes up the path while the parents are full too
+		LeafType* right = splitLeaf(leaf);
+		if (i <= leaf->count)
+			insertAt(leaf, i, key, value);
+		else
+			insertAt(right, i - leaf->count, key, value);
+		Key sep = right->keys[0];
+		NodeType* child = right;
+		for (uint32_t d = path.depth; d-- > 0;)
+		{
+			InnerType* parent = path.nodes[d];
+			uint32_t slot = path.slots[d];
+			if (parent->count < Capacity)
+			{
+				std::move_backward(parent->keys + slot, parent->keys + parent->count, parent->keys + parent->count + 1);
+				std::move_backward(parent->children + slot + 1, parent->children + parent->count + 1,
+								   parent->children + parent->count + 2);
+				parent->keys[slot] = std::move(sep), parent->children[slot + 1] = child;
+				++parent->count;
+				return true;
+			}
+			child = splitInner(parent, slot, sep, child);
+		}
+		InnerType* root = createInner(tree->h + 1);
+		root->keys[0] = std::move(sep);
+		root->children[0] = tree, root->children[1] = child;
+		root->count = 1, root->n = tree->n + child->n;
+		tree = root;
+		return true;
+	}
+
+	template<class Key, class Value, class Compare, size_t KeyBytes>
+	bool BTree<Key, Value, Compare, KeyBytes>::erase(const Key& key)
+	{
+		if (tree == nullptr)
+			return false;
+		Path path;
+		LeafType* leaf = descend(key, &path);
+		uint32_t i = search<false>(leaf, key);
+		if (i == leaf->count || comp(key, leaf->keys[i]))
+			return false;
+		std::move(leaf->keys + i + 1, leaf->keys + leaf->count, leaf->keys + i);
+		if constexpr (!std::is_void<Value>::value)
+			std::move(leaf->values + i + 1, leaf->values + leaf->count, leaf->values + i);
+		--leaf->count, --leaf->n;
+		for (uint32_t d = 0; d < path.depth; ++d)
+			--path.nodes[d]->n;
+		// Separators equal to the key may stay, they still split the keys correctly.
+		// Underfull nodes take from a sibling or merge with one, a merge can leave the parent underfull
+		NodeType* node = leaf;
+		for (uint32_t d = path.depth; d-- > 0 && node->count < MinCount; node = path.nodes[d])
+			rebalance(path.nodes[d], path.slots[d]);
+		if (tree->count == 0)
+		{
+			if (tree->h == 1)
+			{
+				leafPool.destroy(static_cast<LeafType*>(tree));
+				tree = head = tail = nullptr;
+			}
+			else
+			{
+				InnerType* root = static_cast<InnerType*>(tree);
+				tree = root->children[0];
+				innerPool.destroy(root);
+			}
+		}
+		return true;
+	}
+	#pragma endregion
+
+	#pragma region BTree::iterator
+	template<class Key, class Value, class Compare, size_t KeyBytes>
+	BTree<Key, Value, Compare, KeyBytes>::iterator::iterator(const LeafType* leaf, uint32_t slot, const BTree* owner)
+		: leaf(leaf), slot(slot), owner(owner) {}
+
+	template<class Key, class Value, class Compare, size_t KeyBytes>
+	BTree<Key, Value, Compare, KeyBytes>::iterator::iterator() : leaf(nullptr), slot(0), owner(nullptr) {}
+
+	template<class Key, class Value, class Compare, size_t KeyBytes>
+	const Key& BTree<Key, Value, Compare, KeyBytes>::iterator::operator*() const
+	{
+		return leaf->keys[slot];
+	}
+
+	template<class Key, class Value, class Compare, size_t KeyBytes>
+	const Key* BTree<Key, Value, Compare, KeyBytes>::iterator::operator->() const
+	{
+		return leaf->keys + slot;
+	}
+
+	template<class Key, class Value, class Compare, size_t KeyBytes>
+	const typename BTree<Key, Value, Compare, KeyBytes>::MappedType& BTree<Key, Value, Compare, KeyBytes>::iterator::value() const
+	{
+		static_assert(!std::is_void<Value>::value, "sets have no mapped values");
+		return leaf->values[slot];
+	}
+
+	template<class Key, class Value, class Compare, size_t KeyBytes>
+	typename BTree<Key, Value, Compare, KeyBytes>::iterator& BTree<Key, Value, Compare, KeyBytes>::iterator::operator++()
+	{
+		if (++slot == leaf->count)
+			leaf = leaf->next, slot = 0;
+		return *this;
+	}
+
+	template<class Key, class Value, class Compare, size_t KeyBytes>
+	typename BTree<Key, Value, Compare, KeyBytes>::iterator BTree<Key, Value, Compare, KeyBytes>::iterator::operator++(int)
+	{
+		iterator ret = *this;
+		return ++*this, ret;
+	}
+
+	template<class Key, class Value, class Compare, size_t KeyBytes>
+	typename BTree<Key, Value, Compare, KeyBytes>::iterator& BTree<Key, Value, Compare, KeyBytes>::iterator::operator--()
+	{
+		if (leaf == nullptr)
+			leaf = owner->tail, slot = leaf->count - 1;
+		else if (slot == 0)
+			leaf = leaf->prev, slot = leaf->count - 1;
+		else
+			--slot;
+		return *this;
+	}
+
+	template<class Key, class Value, class Compare, size_t KeyBytes>
+	typename BTree<Key, Value, Compare, KeyBytes>::iterator BTree<Key, Value, Compare, KeyBytes>::iterator::operator--(int)
+	{
+		iterator ret = *this;
+		return --*this, ret;
+	}
+
+	template<class Key, class Value, class Compare, size_t KeyBytes>
+	bool BTree<Key, Value, Compare, KeyBytes>::iterator::operator==(const iterator& other) const
+	{
+		return leaf == other.leaf && slot == other.slot;
+	}
+
+	template<class Key, class Value, class Compare, size_t KeyBytes>
+	bool BTree<Key, Value, Compare, KeyBytes>::iterator::operator!=(const iterator& other) const
+	{
+		return !(*this == other);
+	}
+	#pragma endregion
+
+	#pragma region ART
+	template<class Key, class Value>
+	ARTLeaf<Key, Value>::ARTLeaf(const Key& key, const MappedType& value)
+		: ARTNode{ ARTNode::Type::Leaf, 0, 0, {} }, ValueField<Value>(value), key(key) {}
+
+	template<class Key, class Value>
+	ARTree<Key, Value>::ARTree() : tree(nullptr), count(0) {}
+
+	template<class Key, class Value>
+	ARTree<Key, Value>::~ARTree()
+	{
+		clear();
+	}
+
+	template<class Key, class Value>
+	uint8_t ARTree<Key, Value>::byteAt(const Key& key, uint32_t depth)
+	{
+		// Big-endian bytes order unsigned keys, signed ones get the sign bit flipped
+		using Unsigned = std::make_unsigned_t<Key>;
+		Unsigned k = (Unsigned)key;
+		if constexpr (std::is_signed<Key>::value)
+			k ^= (Unsigned)1 << (8 * KeyLength - 1);
+		return (uint8_t)(k >> (8 * (KeyLength - 1 - depth)));
+	}
+
+	template<class Key, class Value>
+	const typename ARTree<Key, Value>::LeafType* ARTree<Key, Value>::asLeaf(const ARTNode* node)
+	{
+		return static_cast<const LeafType*>(node);
+	}
+
+	template<class Key, class Value>
+	ARTNode** ARTree<Key, Value>::findChild(ARTNode* node, uint8_t byte)
+	{
+		switch (node->type)
+		{
+		case ARTNode::Type::Node4:
+		{
+			ARTNode4* p = static_cast<ARTNode4*>(node);
+			for (uint32_t i = 0; i < p->count; ++i)
+				if (p->keys[i] == byte)
+					return p->children + i;
+			return nullptr;
+		}
+		case ARTNode::Type::Node16:
+		{
+			ARTNode16* p = static_cast<ARTNode16*>(node);
+			#if defined(__SSE2__) || defined(_M_X64)
+			// All 16 key bytes are compared at once, the lanes past count are masked off
+			__m128i eq = _mm_cmpeq_epi8(_mm_set1_epi8((char)byte), _mm_loadu_si128((const __m128i*)p->keys));
+			uint32_t mask = (uint32_t)_mm_movemask_epi8(eq) & ((1u << p->count) - 1);
+			if (mask == 0)
+				return nullptr;
+			#if defined(_MSC_VER)
+			unsigned long i;
+			_BitScanForward(&i, mask);
+			return p->children + i;
+			#else
+			return p->children + __builtin_ctz(mask);
+			#endif
+			#else
+			for (uint32_t i = 0; i < p->count; ++i)
+				if (p->keys[i] == byte)
+					return p->children + i;
+			return nullptr;
+			#endif
+		}
+		case ARTNode::Type::Node48:
+		{
+			ARTNode48* p = static_cast<ARTNode48*>(node);
+			return p->index[byte] == 0 ? nullptr : p->children + p->index[byte] - 1;
+		}
+		case ARTNode::Type::Node256:
+		{
+			ARTNode256* p = static_cast<ARTNode256*>(node);
+			return p->children[byte] == nullptr ? nullptr : p->children + byte;
+		}
+		default:
+			return nullptr;
+		}
+	}
+
+	template<class Key, class Value>
+	ARTNode* ARTree<Key, Value>::childAfter(const ARTNode* node, int byte)
+	{
+		switch (node->type)
+		{
+		case ARTNode::Type::Node4:
+		{
+			const ARTNode4* p = static_cast<const ARTNode4*>(node);
+			for (uint32_t i = 0; i < p->count; ++i)
+				if (p->keys[i] > byte)
+					return p->children[i];
+			return nullptr;
+		}
+		case ARTNode::Type::Node16:
+		{
+			const ARTNode16* p = static_cast<const ARTNode16*>(node);
+			for (uint32_t i = 0; i < p->count; ++i)
+				if (p->keys[i] > byte)
+					return p->children[i];
+			return nullptr;
+		}
+		case ARTNode::Type::Node48:
+		{
+			const ARTNode48* p = static_cast<const ARTNode48*>(node);
+			for (int b = byte + 1; b < 256; ++b)
+				if (p->index[b] != 0)
+					return p->children[p->index[b] - 1];
+			return nullptr;
+		}
+		case ARTNode::Type::Node256:
+		{
+			const ARTNode256* p = static_cast<const ARTNode256*>(node);
+			for (int b = byte + 1; b < 256; ++b)
+				if (p->children[b] != nullptr)
+					return p->children[b];
+			return nullptr;
+		}
+		default:
+			return nullptr;
+		}
+	}
+
+	template<class Key, class Value>
+	ARTNode* ARTree<Key, Value>::childBefore(const ARTNode* node, int byte)
+	{
+		switch (node->type)
+		{
+		case ARTNode::Type::Node4:
+		{
+			const ARTNode4* p = static_cast<const ARTNode4*>(node);
+			for (uint32_t i = p->count; i-- > 0;)
+				if (p->keys[i] < byte)
+					return p->children[i];
+			return nullptr;
+		}
+		case ARTNode::Type::Node16:
+		{
+			const ARTNode16* p = static_cast<const ARTNode16*>(node);
+			for (uint32_t i = p->count; i-- > 0;)
+				if (p->keys[i] < byte)
+					return p->children[i];
+			return nullptr;
+		}
+		case ARTNode::Type::Node48:
+		{
+			const ARTNode48* p = static_cast<const ARTNode48*>(node);
+			for (int b = byte - 1; b >= 0; --b)
+				if (p->index[b] != 0)
+					return p->children[p->index[b] - 1];
+			return nullptr;
+		}
+		case ARTNode::Type::Node256:
+		{
+			const ARTNode256* p = static_cast<const ARTNode256*>(node);
+			for (int b = byte - 1; b >= 0; --b)
+				if (p->children[b] != nullptr)
+					return p->children[b];
+			return nullptr;
+		}
+		default:
+			return nullptr;
+		}
+	}
+
+	template<class Key, class Value>
+	const typename ARTree<Key, Value>::LeafType* ARTree<Key, Value>::minimum(const ARTNode* node)
+	{
+		while (node != nullptr && node->type != ARTNode::Type::Leaf)
+			node = childAfter(node, -1);
+		return asLeaf(node);
+	}
+
+	template<class Key, class Value>
+	const typename ARTree<Key, Value>::LeafType* ARTree<Key, Value>::maximum(const ARTNode* node)
+	{
+		while (node != nullptr && node->type != ARTNode::Type::Leaf)
+			node = childBefore(node, 256);
+		return asLeaf(node);
+	}
+
+	template<class Key, class Value>
+	const typename ARTree<Key, Value>::LeafType* ARTree<Key, Value>::above(
+		const ARTNode* node, const Key& key, uint32_t depth, bool orEqual
+	)
+	{
+		if (node == nullptr)
+			return nullptr;
+		if (node->type == ARTNode::Type::Leaf)
+		{
+			const LeafType* leaf = asLeaf(node);
+			return key < leaf->key || (orEqual && key == leaf->key) ? leaf : nullptr;
+		}
+		// A prefix byte differing from the key puts the whole subtree on one side of it
+		for (uint32_t i = 0; i < node->prefixLength; ++i)
+		{
+			uint8_t b = byteAt(key, depth + i);
+			if (node->prefix[i] != b)
+				return node->prefix[i] > b ? minimum(node) : nullptr;
+		}
+		depth += node->prefixLength;
+		uint8_t b = byteAt(key, depth);
+		if (ARTNode** child = findChild(const_cast<ARTNode*>(node), b))
+		{
+			if (const LeafType* leaf = above(*child, key, depth + 1, orEqual))
+				return leaf;
+		}
+		return minimum(childAfter(node, b));
+	}
+
+	template<class Key, class Value>
+	const typename ARTree<Key, Value>::LeafType* ARTree<Key, Value>::below(const ARTNode* node, const Key& key, uint32_t depth)
+	{
+		if (node == nullptr)
+			return nullptr;
+		if (node->type == ARTNode::Type::Leaf)
+		{
+			const LeafType* leaf = asLeaf(node);
+			return leaf->key < key ? leaf : nullptr;
+		}
+		for (uint32_t i = 0; i < node->prefixLength; ++i)
+		{
+			uint8_t b = byteAt(key, depth + i);
+			if (node->prefix[i] != b)
+				return node->prefix[i] < b ? maximum(node) : nullptr;
+		}
+		depth += node->prefixLength;
+		uint8_t b = byteAt(key, depth);
+		if (ARTNode** child = findChild(const_cast<ARTNode*>(node), b))
+		{
+			if (const LeafType* leaf = below(*child, key, depth + 1))
+				return leaf;
+		}
+		return maximum(childBefore(node, b));
+	}
+
+	template<class Key, class Value>
+	template<class NodeT>
+	NodeT* ARTree<Key, Value>::createInner(const ARTNode* header)
+	{
+		NodeT* node;
+		if constexpr (std::is_same<NodeT, ARTNode4>::value)
+			node = pool4.create(), node->type = ARTNode::Type::Node4;
+		else if constexpr (std::is_same<NodeT, ARTNode16>::value)
+			node = pool16.create(), node->type = ARTNode::Type::Node16;
+		else if constexpr (std::is_same<NodeT, ARTNode48>::value)
+			node = pool48.create(), node->type = ARTNode::Type::Node48;
+		else
+			node = pool256.create(), node->type = ARTNode::Type::Node256;
+		if (header != nullptr)
+			node->prefixLength = header->prefixLength, std::copy(header->prefix, header->prefix + 8, node->prefix);
+		return node;
+	}
+
+	template<class Key, class Value>
+	void ARTree<Key, Value>::destroyInner(ARTNode* node)
+	{
+		if (node->type == ARTNode::Type::Node4)
+			pool4.destroy(static_cast<ARTNode4*>(node));
+		else if (node->type == ARTNode::Type::Node16)
+			pool16.destroy(static_cast<ARTNode16*>(node));
+		else if (node->type == ARTNode::Type::Node48)
+			pool48.destroy(static_cast<ARTNode48*>(node));
+		else
+			pool256.destroy(static_cast<ARTNode256*>(node));
+	}
+
+	template<class Key, class Value>
+	void ARTree<Key, Value>::destroySubtree(ARTNode* node)
+	{
+		if (node->type == ARTNode::Type::Leaf)
+			return leafPool.destroy(static_cast<LeafType*>(node));
+		forEachChild(node, [this](uint8_t, const ARTNode* child) { destroySubtree(const_cast<ARTNode*>(child)); });
+		destroyInner(node);
+	}
+
+	template<class Key, class Value>
+	void ARTree<Key, Value>::addChild(ARTNode*& ref, uint8_t byte, ARTNode* child)
+	{
+		switch (ref->type)
+		{
+		case ARTNode::Type::Node4:
+		{
+			ARTNode4* p = static_cast<ARTNode4*>(ref);
+			if (p->count < 4)
+			{
+				uint32_t i = p->count;
+				for (; i > 0 && p->keys[i - 1] > byte; --i)
+					p->keys[i] = p->keys[i - 1], p->children[i] = p->children[i - 1];
+				p->keys[i] = byte, p->children[i] = child, ++p->count;
+				return;
+			}
+			ARTNode16* q = createInner<ARTNode16>(p);
+			std::copy(p->keys, p->keys + 4, q->keys), std::copy(p->children, p->children + 4, q->children);
+			q->count = 4;
+			pool4.destroy(p);
+			ref = q;
+			return addChild(ref, byte, child);
+		}
+		case ARTNode::Type::Node16:
+		{
+			ARTNode16* p = static_cast<ARTNode16*>(ref);
+			if (p->count < 16)
+			{
+				uint32_t i = p->count;
+				for (; i > 0 && p->keys[i - 1] > byte; --i)
+					p->keys[i] = p->keys[i - 1], p->children[i] = p->children[i - 1];
+				p->keys[i] = byte, p->children[i] = child, ++p->count;
+				return;
+			}
+			ARTNode48* q = createInner<ARTNode48>(p);
+			for (uint32_t i = 0; i < 16; ++i)
+				q->index[p->keys[i]] = (uint8_t)(i + 1), q->children[i] = p->children[i];
+			q->count = 16;
+			pool16.destroy(p);
+			ref = q;
+			return addChild(ref, byte, child);
+		}
+		case ARTNode::Type::Node48:
+		{
+			ARTNode48* p = static_cast<ARTNode48*>(ref);
+			if (p->count < 48)
+			{
+				// Erased children leave holes, the first free slot is taken
+				uint32_t slot = 0;
+				while (p->children[slot] != nullptr)
+					++slot;
+				p->index[byte] = (uint8_t)(slot + 1), p->children[slot] = child, ++p->count;
+				return;
+			}
+			ARTNode256* q = createInner<ARTNode256>(p);
+			for (uint32_t b = 0; b < 256; ++b)
+				if (p->index[b] != 0)
+					q->children[b] = p->children[p->index[b] - 1];
+			q->count = 48;
+			pool48.destroy(p);
+			ref = q;
+			return addChild(ref, byte, child);
+		}
+		default:
+		{
+			ARTNode256* p = static_cast<ARTNode256*>(ref);
+			p->children[byte] = child, ++p->count;
+		}
+		}
+	}
+
+	template<class Key, class Value>
+	void ARTree<Key, Value>::removeChild(ARTNode*& ref, uint8_t byte)
+	{
+		// Nodes shrink a bit below the capacity of the smaller kind, so that a key going in and out
+		// at the boundary does not resize every time
+		switch (ref->type)
+		{
+		case ARTNode::Type::Node4:
+		{
+			ARTNode4* p = static_cast<ARTNode4*>(ref);
+			uint32_t i = 0;
+			while (p->keys[i] != byte)
+				++i;
+			std::copy(p->keys + i + 1, p->keys + p->count, p->keys + i);
+			std::copy(p->children + i + 1, p->children + p->count, p->children + i);
+			if (--p->count > 1)
+				return;
+			// A single child takes the place of the node, its prefix grows by the node's prefix and key byte
+			ARTNode* child = p->children[0];
+			if (child->type != ARTNode::Type::Leaf)
+			{
+				uint8_t prefix[8];
+				uint32_t length = p->prefixLength;
+				std::copy(p->prefix, p->prefix + length, prefix);
+				prefix[length++] = p->keys[0];
+				std::copy(child->prefix, child->prefix + child->prefixLength, prefix + length);
+				child->prefixLength = (uint8_t)(length + child->prefixLength);
+				std::copy(prefix, prefix + child->prefixLength, child->prefix);
+			}
+			pool4.destroy(p);
+			ref = child;
+			return;
+		}
+		case ARTNode::Type::Node16:
+		{
+			ARTNode16* p = static_cast<ARTNode16*>(ref);
+			uint32_t i = 0;
+			while (p->keys[i] != byte)
+				++i;
+			std::copy(p->keys + i + 1, p->keys + p->count, p->keys + i);
+			std::copy(p->children + i + 1, p->children + p->count, p->children + i);
+			if (--p->count > 3)
+				return;
+			ARTNode4* q = createInner<ARTNode4>(p);
+			std::copy(p->keys, p->keys + p->count, q->keys), std::copy(p->children, p->children + p->count, q->children);
+			q->count = p->count;
+			pool16.destroy(p);
+			ref = q;
+			return;
+		}
+		case ARTNode::Type::Node48:
+		{
+			ARTNode48* p = static_cast<ARTNode48*>(ref);
+			p->children[p->index[byte] - 1] = nullptr, p->index[byte] = 0;
+			if (--p->count > 12)
+				return;
+			ARTNode16* q = createInner<ARTNode16>(p);
+			for (uint32_t b = 0; b < 256; ++b)
+				if (p->index[b] != 0)
+					q->keys[q->count] = (uint8_t)b, q->children[q->count++] = p->children[p->index[b] - 1];
+			pool48.destroy(p);
+			ref = q;
+			return;
+		}
+		default:
+		{
+			ARTNode256* p = static_cast<ARTNode256*>(ref);
+			p->children[byte] = nullptr;
+			if (--p->count > 37)
+				return;
+			ARTNode48* q = createInner<ARTNode48>(p);
+			for (uint32_t b = 0; b < 256; ++b)
+				if (p->children[b] != nullptr)
+					q->children[q->count] = p->children[b], q->index[b] = (uint8_t)++q->count;
+			pool256.destroy(p);
+			ref = q;
+		}
+		}
+	}
+
+	template<class Key, class Value>
+	template<class T>
+	const Key& ARTree<Key, Value>::keyOf(const T& item)
+	{
+		if constexpr (std::is_same<T, Key>::value)
+			return item;
+		else
+			return item.first;
+	}
+
+	template<class Key, class Value>
+	template<class F>
+	void ARTree<Key, Value>::forEachChild(const ARTNode* node, F&& f)
+	{
+		switch (node->type)
+		{
+		case ARTNode::Type::Node4:
+		{
+			const ARTNode4* p = static_cast<const ARTNode4*>(node);
+			for (uint32_t i = 0; i < p->count; ++i)
+				f(p->keys[i], (const ARTNode*)p->children[i]);
+			break;
+		}
+		case ARTNode::Type::Node16:
+		{
+			const ARTNode16* p = static_cast<const ARTNode16*>(node);
+			for (uint32_t i = 0; i < p->count; ++i)
+				f(p->keys[i], (const ARTNode*)p->children[i]);
+			break;
+		}
+		case ARTNode::Type::Node48:
+		{
+			const ARTNode48* p = static_cast<const ARTNode48*>(node);
+			for (uint32_t b = 0; b < 256; ++b)
+				if (p->index[b] != 0)
+					f((uint8_t)b, (const ARTNode*)p->children[p->index[b] - 1]);
+			break;
+		}
+		case ARTNode::Type::Node256:
+		{
+			const ARTNode256* p = static_cast<const ARTNode256*>(node);
+			for (uint32_t b = 0; b < 256; ++b)
+				if (p->children[b] != nullptr)
+					f((uint8_t)b, (const ARTNode*)p->children[b]);
+			break;
+		}
+		default:
+			break;
+		}
+	}
+
+	template<class Key, class Value>
+	void ARTree<Key, Value>::insertRandom(size_t n)
+	{
+		thread_local std::mt19937 rng(auxillary::threadSeed());
+		while (n)
+		{
+			if (insert((Key)rng()))
+				--n;
+		}
+	}
+
+	template<class Key, class Value>
+	template<class Iterator>
+	void ARTree<Key, Value>::buildFromSorted(Iterator begin, Iterator end)
+	{
+		// The shape of a radix tree depends on the keys only, sorted input just keeps the touched path in cache
+		clear();
+		for (; begin != end; ++begin)
+		{
+			if constexpr (std::is_void<Value>::value)
+				insert(keyOf(*begin));
+			else
+				insert(keyOf(*begin), begin->second);
+		}
+	}
+
+	template<class Key, class Value>
+	void ARTree<Key, Value>::clear()
+	{
+		if constexpr (!std::is_trivially_destructible<LeafType>::value)
+		{
+			if (tree != nullptr)
+				destroySubtree(tree);
+		}
+		leafPool.clear(), pool4.clear(), pool16.clear(), pool48.clear(), pool256.clear();
+		tree = nullptr, count = 0;
+	}
+
+	template<class Key, class Value>
+	size_t ARTree<Key, Value>::size() const
+	{
+		return count;
+	}
+
+	template<class Key, class Value>
+	const typename ARTree<Key, Value>::NodeType* ARTree<Key, Value>::rootPtr() const
+	{
+		return tree;
+	}
+
+	template<class Key, class Value>
+	typename ARTree<Key, Value>::iterator ARTree<Key, Value>::begin() const
+	{
+		return iterator(minimum(tree), this);
+	}
+
+	template<class Key, class Value>
+	typename ARTree<Key, Value>::iterator ARTree<Key, Value>::end() const
+	{
+		return iterator(nullptr, this);
+	}
+
+	template<class Key, class Value>
+	typename ARTree<Key, Value>::iterator ARTree<Key, Value>::find(const Key& key) const
+	{
+		const ARTNode* node = tree;
+		for (uint32_t depth = 0; node != nullptr && node->type != ARTNode::Type::Leaf; ++depth)
+		{
+			for (uint32_t i = 0; i < node->prefixLength; ++i)
+				if (node->prefix[i] != byteAt(key, depth + i))
+					return end();
+			depth += node->prefixLength;
+			ARTNode** child = findChild(const_cast<ARTNode*>(node), byteAt(key, depth));
+			node = child == nullptr ? nullptr : *child;
+		}
+		// Leaves below a single child skip bytes, the full key is checked last
+		if (node == nullptr || asLeaf(node)->key != key)
+			return end();
+		return iterator(asLeaf(node), this);
+	}
+
+	template<class Key, class Value>
+	bool ARTree<Key, Value>::contains(const Key& key) const
+	{
+		return find(key).leaf != nullptr;
+	}
+
+	template<class Key, class Value>
+	typename ARTree<Key, Value>::iterator ARTree<Key, Value>::lower_bound(const Key& key) const
+	{
+		return iterator(above(tree, key, 0, true), this);
+	}
+
+	template<class Key, class Value>
+	typename ARTree<Key, Value>::iterator ARTree<Key, Value>::upper_bound(const Key& key) const
+	{
+		return iterator(above(tree, key, 0, false), this);
+	}
+
+	template<class Key, class Value>
+	bool ARTree<Key, Value>::insert(const Key& key, const MappedType& value)
+	{
+		ARTNode** ref = &tree;
+		for (uint32_t depth = 0;; ++depth)
+		{
+			ARTNode* node = *ref;
+			if (node == nullptr)
+			{
+				*ref = leafPool.create(key, value), ++count;
+				return true;
+			}
+			if (node->type == ARTNode::Type::Leaf)
+			{
+				// Two leaves under one slot get a Node4 holding the bytes they share as its prefix
+				const Key& other = asLeaf(node)->key;
+				if (other == key)
+					return false;
+				uint32_t p = depth;
+				while (byteAt(other, p) == byteAt(key, p))
+					++p;
+				ARTNode4* inner = createInner<ARTNode4>(nullptr);
+				inner->prefixLength = (uint8_t)(p - depth);
+				for (uint32_t i = depth; i < p; ++i)
+					inner->prefix[i - depth] = byteAt(key, i);
+				*ref = inner;
+				addChild(*ref, byteAt(other, p), node);
+				addChild(*ref, byteAt(key, p), leafPool.create(key, value)), ++count;
+				return true;
+			}
+			uint32_t p = 0;
+			while (p < node->prefixLength && node->prefix[p] == byteAt(key, depth + p))
+				++p;
+			if (p < node->prefixLength)
+			{
+				// The key leaves the prefix, a Node4 takes the shared part and the node keeps the rest
+				ARTNode4* inner = createInner<ARTNode4>(nullptr);
+				inner->prefixLength = (uint8_t)p;
+				std::copy(node->prefix, node->prefix + p, inner->prefix);
+				uint8_t byte = node->prefix[p];
+				node->prefixLength -= (uint8_t)(p + 1);
+				std::copy(node->prefix + p + 1, node->prefix + p + 1 + node->prefixLength, node->prefix);
+				*ref = inner;
+				addChild(*ref, byte, node);
+				addChild(*ref, byteAt(key, depth + p), leafPool.create(key, value)), ++count;
+				return true;
+			}
+			depth += node->prefixLength;
+			uint8_t byte = byteAt(key, depth);
+			ARTNode** child = findChild(node, byte);
+			if (child == nullptr)
+			{
+				addChild(*ref, byte, leafPool.create(key, value)), ++count;
+				return true;
+			}
+			ref = child;
+		}
+	}
+
+	template<class Key, class Value>
+	bool ARTree<Key, Value>::erase(const Key& key)
+	{
+		ARTNode** ref = &tree, ** parent = nullptr;
+		uint8_t byte = 0;
+		for (uint32_t depth = 0;; ++depth)
+		{
+			ARTNode* node = *ref;
+			if (node == nullptr)
+				return false;
+			if (node->type == ARTNode::Type::Leaf)
+			{
+				if (asLeaf(node)->key != key)
+					return false;
+				if (parent == nullptr)
+					tree = nullptr;
+				else
+					removeChild(*parent, byte);
+				leafPool.destroy(static_cast<LeafType*>(node)), --count;
+				return true;
+			}
+			for (uint32_t i = 0; i < node->prefixLength; ++i)
+				if (node->prefix[i] != byteAt(key, depth + i))
+					return false;
+			depth += node->prefixLength;
+			byte = byteAt(key, depth);
+			parent = ref;
+			ref = findChild(node, byte);
+			if (ref == nullptr)
+				return false;
+		}
+	}
+	#pragma endregion
+
+	#pragma region ART::iterator
+	template<class Key, class Value>
+	ARTree<Key, Value>::iterator::iterator(const LeafType* leaf, const ARTree* owner) : leaf(leaf), owner(owner) {}
+
+	template<class Key, class Value>
+	ARTree<Key, Value>::iterator::iterator() : leaf(nullptr), owner(nullptr) {}
+
+	template<class Key, class Value>
+	const Key& ARTree<Key, Value>::iterator::operator*() const
+	{
+		return leaf->key;
+	}
+
+	template<class Key, class Value>
+	const Key* ARTree<Key, Value>::iterator::operator->() const
+	{
+		return &leaf->key;
+	}
+
+	template<class Key, class Value>
+	const typename ARTree<Key, Value>::MappedType& ARTree<Key, Value>::iterator::value() const
+	{
+		static_assert(!std::is_void<Value>::value, "sets have no mapped values");
+		return leaf->value;
+	}
+
+	template<class Key, class Value>
+	typename ARTree<Key, Value>::iterator& ARTree<Key, Value>::iterator::operator++()
+	{
+		leaf = above(owner->tree, leaf->key, 0, false);
+		return *this;
+	}
+
+	template<class Key, class Value>
+	typename ARTree<Key, Value>::iterator ARTree<Key, Value>::iterator::operator++(int)
+	{
+		iterator ret = *this;
+		return ++*this, ret;
+	}
+
+	template<class Key, class Value>
+	typename ARTree<Key, Value>::iterator& ARTree<Key, Value>::iterator::operator--()
+	{
+		leaf = leaf == nullptr ? maximum(owner->tree) : below(owner->tree, leaf->key, 0);
+		return *this;
+	}
+
+	template<class Key, class Value>
+	typename ARTree<Key, Value>::iterator ARTree<Key, Value>::iterator::operator--(int)
+	{
+		iterator ret = *this;
+		return --*this, ret;
+	}
+
+	template<class Key, class Value>
+	bool ARTree<Key, Value>::iterator::operator==(const iterator& other) const
+	{
+		return leaf == other.leaf;
+	}
+
+	template<class Key, class Value>
+	bool ARTree<Key, Value>::iterator::operator!=(const iterator& other) const
+	{
+		return !(*this == other);
+	}
+	#pragma endregion
+
+	#pragma region Persistent tree
+	template<class Derived, class NodeType, class Compare>
+	PersistentTree<Derived, NodeType, Compare>::PersistentTree(const Compare& comp)
+		: pool(std::make_shared<Pool>()), comp(comp), history(1, nullptr), current(0),
+		historyLimit(std::numeric_limits<size_t>::max()) {}
+
+	template<class Derived, class NodeType, class Compare>
+	PersistentTree<Derived, NodeType, Compare>::~PersistentTree()
+	{
+		for (NodeType* root : history)
+			release(*pool, root);
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	uint32_t PersistentTree<Derived, NodeType, Compare>::sizeOf(const NodeType* node)
+	{
+		return node == nullptr ? 0 : node->n;
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	uint32_t PersistentTree<Derived, NodeType, Compare>::height(const NodeType* node)
+	{
+		return node == nullptr ? 0 : node->h;
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	NodeType* PersistentTree<Derived, NodeType, Compare>::acquire(NodeType* node)
+	{
+		if (node != nullptr)
+			node->refs.fetch_add(1, std::memory_order_relaxed);
+		return node;
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	void PersistentTree<Derived, NodeType, Compare>::release(Pool& pool, NodeType* node)
+	{
+		if (node == nullptr || node->refs.fetch_sub(1, std::memory_order_acq_rel) != 1)
+			return;
+		// The node was held last here, its children lose a reference each
+		std::vector<NodeType*> stack(1, node);
+		std::lock_guard<std::mutex> lock(pool.mutex);
+		while (!stack.empty())
+		{
+			node = stack.back();
+			stack.pop_back();
+			for (NodeType* child : { node->l, node->r })
+			{
+				if (child != nullptr && child->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+					stack.push_back(child);
+			}
+			pool.arena.destroy(node);
+		}
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	template<class... Args>
+	NodeType* PersistentTree<Derived, NodeType, Compare>::createNode(Args&&... args)
+	{
+		std::lock_guard<std::mutex> lock(pool->mutex);
+		return pool->arena.create(std::forward<Args>(args)...);
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	NodeType* PersistentTree<Derived, NodeType, Compare>::open(NodeType* node)
+	{
+		if (node->refs.load(std::memory_order_acquire) == 1)
+			return node;
+		NodeType* copy = createNode(*node);
+		acquire(copy->l), acquire(copy->r);
+		release(*pool, node);
+		return copy;
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	NodeType* PersistentTree<Derived, NodeType, Compare>::lift(NodeType* node, bool right)
+	{
+		NodeType* q = open(right ? node->r : node->l);
+		if (right)
+			node->r = q->l, q->l = node;
+		else
+			node->l = q->r, q->r = node;
+		Derived::update(node);
+		Derived::update(q);
+		return q;
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	NodeType* PersistentTree<Derived, NodeType, Compare>::splitNodes(
+		NodeType* node, const KeyType& key, NodeType*& l, NodeType*& r
+	)
+	{
+		Derived* self = static_cast<Derived*>(this);
+		if (node == nullptr)
+		{
+			l = r = nullptr;
+			return nullptr;
+		}
+		node = open(node);
+		NodeType* nl = node->l, * nr = node->r, * m;
+		node->l = node->r = nullptr;
+		if (comp(node->elem, key))
+		{
+			m = splitNodes(nr, key, nr, r);
+			l = self->joinNodes(nl, node, nr);
+			return m;
+		}
+		if (comp(key, node->elem))
+		{
+			m = splitNodes(nl, key, l, nl);
+			r = self->joinNodes(nl, node, nr);
+			return m;
+		}
+		l = nl, r = nr;
+		Derived::update(node);
+		return node;
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	NodeType* PersistentTree<Derived, NodeType, Compare>::splitLast(NodeType* node, NodeType*& last)
+	{
+		node = open(node);
+		NodeType* nl = node->l, * nr = node->r;
+		node->l = node->r = nullptr;
+		if (nr == nullptr)
+		{
+			Derived::update(node);
+			last = node;
+			return nl;
+		}
+		nr = splitLast(nr, last);
+		return static_cast<Derived*>(this)->joinNodes(nl, node, nr);
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	NodeType* PersistentTree<Derived, NodeType, Compare>::join2(NodeType* l, NodeType* r)
+	{
+		if (l == nullptr || r == nullptr)
+			return l == nullptr ? r : l;
+		NodeType* last;
+		l = splitLast(l, last);
+		return static_cast<Derived*>(this)->joinNodes(l, last, r);
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	NodeType* PersistentTree<Derived, NodeType, Compare>::settleRoot(NodeType* node)
+	{
+		return node;
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	const NodeType* PersistentTree<Derived, NodeType, Compare>::findNode(const NodeType* node, const KeyType& key) const
+	{
+		while (node != nullptr && (comp(key, node->elem) || comp(node->elem, key)))
+			node = (comp(node->elem, key) ? node->r : node->l);
+		return node;
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	NodeType* PersistentTree<Derived, NodeType, Compare>::insertNode(
+		NodeType* root, const KeyType& key, const MappedType& value, NodeType*& inserted
+	)
+	{
+		Derived* self = static_cast<Derived*>(this);
+		inserted = nullptr;
+		if (findNode(root, key) != nullptr)
+			return root;
+		NodeType* l, * r;
+		splitNodes(root, key, l, r);
+		inserted = self->createLeaf(key, value);
+		return self->joinNodes(l, inserted, r);
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	NodeType* PersistentTree<Derived, NodeType, Compare>::eraseNode(NodeType* root, const KeyType& key, bool& erased)
+	{
+		erased = (findNode(root, key) != nullptr);
+		if (!erased)
+			return root;
+		NodeType* l, * r;
+		release(*pool, splitNodes(root, key, l, r));
+		return join2(l, r);
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	NodeType* PersistentTree<Derived, NodeType, Compare>::take()
+	{
+		// Without history the version is dropped by the next commit anyway, so its reference is passed on
+		// and the nodes it held alone are updated in place
+		NodeType* root = history[current];
+		if (historyLimit != 0)
+			return acquire(root);
+		history[current] = nullptr;
+		return root;
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	void PersistentTree<Derived, NodeType, Compare>::commit(NodeType* root)
+	{
+		while (history.size() > current + 1)
+			release(*pool, history.back()), history.pop_back();
+		history.push_back(static_cast<Derived*>(this)->settleRoot(root)), ++current;
+		for (; history.size() > 1 && history.size() - 1 > historyLimit; --current)
+			release(*pool, history.front()), history.pop_front();
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	const NodeType* PersistentTree<Derived, NodeType, Compare>::insert(const KeyType& key, const MappedType& value)
+	{
+		if (findNode(history[current], key) != nullptr)
+			return nullptr;
+		NodeType* inserted;
+		commit(insertNode(take(), key, value, inserted));
+		return inserted;
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	bool PersistentTree<Derived, NodeType, Compare>::erase(const KeyType& key)
+	{
+		if (findNode(history[current], key) == nullptr)
+			return false;
+		bool erased;
+		commit(eraseNode(take(), key, erased));
+		return true;
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	void PersistentTree<Derived, NodeType, Compare>::insertRandom(size_t n)
+	{
+		// The keys go into one version, so the nodes made on the way are held once and updated in place
+		thread_local std::mt19937 rng(auxillary::threadSeed());
+		NodeType* root = take(), * inserted;
+		while (n)
+		{
+			root = insertNode(root, (KeyType)rng(), MappedType(), inserted);
+			n -= (inserted != nullptr);
+		}
+		commit(root);
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	void PersistentTree<Derived, NodeType, Compare>::clear()
+	{
+		if (history[current] != nullptr)
+			commit(nullptr);
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	bool PersistentTree<Derived, NodeType, Compare>::undo()
+	{
+		if (current == 0)
+			return false;
+		--current;
+		return true;
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	bool PersistentTree<Derived, NodeType, Compare>::redo()
+	{
+		if (current + 1 == history.size())
+			return false;
+		++current;
+		return true;
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	void PersistentTree<Derived, NodeType, Compare>::checkout(size_t version)
+	{
+		current = std::min(version, history.size() - 1);
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	size_t PersistentTree<Derived, NodeType, Compare>::version() const
+	{
+		return current;
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	size_t PersistentTree<Derived, NodeType, Compare>::versions() const
+	{
+		return history.size();
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	void PersistentTree<Derived, NodeType, Compare>::setHistoryLimit(size_t limit)
+	{
+		historyLimit = limit;
+		// Versions ahead of the shown one go first, then the oldest ones
+		while (history.size() - 1 > limit && history.size() > current + 1)
+			release(*pool, history.back()), history.pop_back();
+		for (; history.size() - 1 > limit; --current)
+			release(*pool, history.front()), history.pop_front();
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	typename PersistentTree<Derived, NodeType, Compare>::Snapshot PersistentTree<Derived, NodeType, Compare>::snapshot() const
+	{
+		return Snapshot(pool, acquire(history[current]), comp);
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	size_t PersistentTree<Derived, NodeType, Compare>::size() const
+	{
+		return sizeOf(history[current]);
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	const NodeType* PersistentTree<Derived, NodeType, Compare>::rootPtr() const
+	{
+		return history[current];
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	const NodeType* PersistentTree<Derived, NodeType, Compare>::find(const KeyType& key) const
+	{
+		return findNode(history[current], key);
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	bool PersistentTree<Derived, NodeType, Compare>::contains(const KeyType& key) const
+	{
+		return find(key) != nullptr;
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	const NodeType* PersistentTree<Derived, NodeType, Compare>::select(size_t k) const
+	{
+		const NodeType* p = history[current];
+		while (p != nullptr && k != sizeOf(p->l))
+		{
+			if (k < sizeOf(p->l))
+				p = p->l;
+			else
+				k -= sizeOf(p->l) + 1, p = p->r;
+		}
+		return p;
+	}
+	#pragma endregion
+
+	#pragma region Persistent tree::Snapshot
+	template<class Derived, class NodeType, class Compare>
+	PersistentTree<Derived, NodeType, Compare>::Snapshot::Snapshot(
+		const std::shared_ptr<Pool>& pool, NodeType* root, const Compare& comp
+	)
+		: pool(pool), root(root), comp(comp) {}
+
+	template<class Derived, class NodeType, class Compare>
+	PersistentTree<Derived, NodeType, Compare>::Snapshot::Snapshot() : root(nullptr) {}
+
+	template<class Derived, class NodeType, class Compare>
+	PersistentTree<Derived, NodeType, Compare>::Snapshot::Snapshot(const Snapshot& other)
+		: pool(other.pool), root(acquire(other.root)), comp(other.comp) {}
+
+	template<class Derived, class NodeType, class Compare>
+	typename PersistentTree<Derived, NodeType, Compare>::Snapshot&
+	PersistentTree<Derived, NodeType, Compare>::Snapshot::operator=(Snapshot other)
+	{
+		std::swap(pool, other.pool), std::swap(root, other.root), std::swap(comp, other.comp);
+		return *this;
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	PersistentTree<Derived, NodeType, Compare>::Snapshot::~Snapshot()
+	{
+		if (pool != nullptr)
+			release(*pool, root);
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	size_t PersistentTree<Derived, NodeType, Compare>::Snapshot::size() const
+	{
+		return sizeOf(root);
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	const NodeType* PersistentTree<Derived, NodeType, Compare>::Snapshot::rootPtr() const
+	{
+		return root;
+	}
+
+	template<class Derived, class NodeType, class Compare>
+	const NodeType* PersistentTree<Derived, NodeType, Compare>::Snapshot::find(const KeyType& key) const
+	{
+		const NodeType* p = root;
+		while (p != nullptr && (comp(key, p->elem) || comp(p->elem, key)))
+			p = (comp(p->elem, key) ? p->r : p->l);
+		return p;
+	}
+	#pragma endregion
+
+	#pragma region Persistent AVL
+	template<class Key, class Value, class Compare>
+	PersistentAVLTree<Key, Value, Compare>::PersistentAVLTree(const Compare& comp) : Base(comp) {}
+
+	template<class Key, class Value, class Compare>
+	void PersistentAVLTree<Key, Value, Compare>::update(NodeType* node)
+	{
+		node->n = Base::sizeOf(node->l) + Base::sizeOf(node->r) + 1;
+		node->h = std::max(height(node->l), height(node->r)) + 1;
+	}
+
+	template<class Key, class Value, class Compare>
+	typename PersistentAVLTree<Key, Value, Compare>::NodeType*
+	PersistentAVLTree<Key, Value, Compare>::createLeaf(const Key& key, const MappedType& value)
+	{
+		NodeType* node = Base::createNode(key, value);
+		update(node);
+		return node;
+	}
+
+	template<class Key, class Value, class Compare>
+	typename PersistentAVLTree<Key, Value, Compare>::NodeType*
+	PersistentAVLTree<Key, Value, Compare>::balance(NodeType* node)
+	{
+		if (height(node->l) > height(node->r) + 1)
+		{
+			if (height(node->l->r) > height(node->l->l))
+				node->l = Base::lift(Base::open(node->l), true);
+			return Base::lift(node, false);
+		}
+		if (height(node->r) > height(node->l) + 1)
+		{
+			if (height(node->r->l) > height(node->r->r))
+				node->r = Base::lift(Base::open(node->r), false);
+			return Base::lift(node, true);
+		}
+		update(node);
+		return node;
+	}
+
+	template<class Key, class Value, class Compare>
+	typename PersistentAVLTree<Key, Value, Compare>::NodeType*
+	PersistentAVLTree<Key, Value, Compare>::joinNodes(NodeType* l, NodeType* mid, NodeType* r)
+	{
+		// mid goes down the spine of the taller tree to where the heights meet, the way back up rebalances
+		if (height(l) > height(r) + 1)
+		{
+			l = Base::open(l);
+			l->r = joinNodes(l->r, mid, r);
+			return balance(l);
+		}
+		if (height(r) > height(l) + 1)
+		{
+			r = Base::open(r);
+			r->l = joinNodes(l, mid, r->l);
+			return balance(r);
+		}
+		mid->l = l, mid->r = r;
+		update(mid);
+		return mid;
+	}
+	#pragma endregion
+
+	#pragma region Persistent RB
+	template<class Key, class Value, class Compare>
+	PersistentRBTree<Key, Value, Compare>::PersistentRBTree(const Compare& comp) : Base(comp) {}
+
+	template<class Key, class Value, class Compare>
+	bool PersistentRBTree<Key, Value, Compare>::isRed(const NodeType* node)
+	{
+		return node != nullptr && node->red;
+	}
+
+	template<class Key, class Value, class Compare>
+	void PersistentRBTree<Key, Value, Compare>::update(NodeType* node)
+	{
+		node->n = Base::sizeOf(node->l) + Base::sizeOf(node->r) + 1;
+		node->h = height(node->l) + !node->red;
+	}
+
+	template<class Key, class Value, class Compare>
+	typename PersistentRBTree<Key, Value, Compare>::NodeType*
+	PersistentRBTree<Key, Value, Compare>::createLeaf(const Key& key, const MappedType& value)
+	{
+		NodeType* node = Base::createNode(key, value);
+		update(node);
+		return node;
+	}
+
+	template<class Key, class Value, class Compare>
+	typename PersistentRBTree<Key, Value, Compare>::NodeType*
+	PersistentRBTree<Key, Value, Compare>::blacken(NodeType* node)
+	{
+		if (!isRed(node))
+			return node;
+		node = Base::open(node);
+		node->red = false;
+		update(node);
+		return node;
+	}
+
+	template<class Key, class Value, class Compare>
+	typename PersistentRBTree<Key, Value, Compare>::NodeType*
+	PersistentRBTree<Key, Value, Compare>::joinSpine(NodeType* high, NodeType* mid, NodeType* low, bool right)
+	{
+		if (!isRed(high) && height(high) == height(low))
+		{
+			mid->l = (right ? high : low), mid->r = (right ? low : high);
+			mid->red = true;
+			update(mid);
+			return mid;
+		}
+		high = Base::open(high);
+		NodeType*& inner = (right ? high->r : high->l);
+		inner = joinSpine(inner, mid, low, right);
+		// A red node with a red child came up under a black one: the child is blackened and the red
+		// node rotated up, which keeps the black height of high
+		NodeType* t = inner;
+		if (!high->red && t->red && isRed(right ? t->r : t->l))
+		{
+			NodeType*& outer = (right ? t->r : t->l);
+			outer = blacken(outer);
+			return Base::lift(high, right);
+		}
+		update(high);
+		return high;
+	}
+
+	template<class Key, class Value, class Compare>
+	typename PersistentRBTree<Key, Value, Compare>::NodeType*
+	PersistentRBTree<Key, Value, Compare>::joinNodes(NodeType* l, NodeType* mid, NodeType* r)
+	{
+		l = blacken(l), r = blacken(r);
+		if (height(l) != height(r))
+		{
+			NodeType* t = (height(l) > height(r) ? joinSpine(l, mid, r, true) : joinSpine(r, mid, l, false));
+			return isRed(t->l) || isRed(t->r) ? blacken(t) : t;
+		}
+		mid->l = l, mid->r = r;
+		mid->red = false;
+		update(mid);
+		return mid;
+	}
+
+	template<class Key, class Value, class Compare>
+	typename PersistentRBTree<Key, Value, Compare>::NodeType*
+	PersistentRBTree<Key, Value, Compare>::settleRoot(NodeType* node)
+	{
+		return blacken(node);
+	}
+	#pragma endregion
+
+	#pragma region Persistent treap
+	template<class Key, class Value, class Compare>
+	thread_local std::mt19937 PersistentTreap<Key, Value, Compare>::rng(auxillary::threadSeed());
+
+	template<class Key, class Value, class Compare>
+	PersistentTreap<Key, Value, Compare>::PersistentTreap(const Compare& comp) : Base(comp) {}
+
+	template<class Key, class Value, class Compare>
+	void PersistentTreap<Key, Value, Compare>::update(NodeType* node)
+	{
+		node->n = Base::sizeOf(node->l) + Base::sizeOf(node->r) + 1;
+		node->h = std::max(height(node->l), height(node->r)) + 1;
+	}
+
+	template<class Key, class Value, class Compare>
+	typename PersistentTreap<Key, Value, Compare>::NodeType*
+	PersistentTreap<Key, Value, Compare>::createLeaf(const Key& key, const MappedType& value)
+	{
+		NodeType* node = Base::createNode(key, value);
+		node->prior = (uint32_t)rng();
+		update(node);
+		return node;
+	}
+
+	template<class Key, class Value, class Compare>
+	typename PersistentTreap<Key, Value, Compare>::NodeType*
+	PersistentTreap<Key, Value, Compare>::merge(NodeType* l, NodeType* r)
+	{
+		if (l == nullptr || r == nullptr)
+			return l == nullptr ? r : l;
+		if (l->prior > r->prior)
+		{
+			l = Base::open(l);
+			l->r = merge(l->r, r);
+			update(l);
+			return l;
+		}
+		r = Base::open(r);
+		r->l = merge(l, r->l);
+		update(r);
+		return r;
+	}
+
+	template<class Key, class Value, class Compare>
+	typename PersistentTreap<Key, Value, Compare>::NodeType*
+	PersistentTreap<Key, Value, Compare>::joinNodes(NodeType* l, NodeType* mid, NodeType* r)
+	{
+		update(mid);
+		return merge(merge(l, mid), r);
+	}
+	#pragma endregion
+
+	#pragma region Concurrent AVL tree
+	template<class Key>
+	ConcurrentNode<Key>::ConcurrentNode(const Key& elem, ConcurrentNode* parent, bool present)
+		: l(nullptr), r(nullptr), parent(parent), version(0), h(1), present(present), retiredNext(nullptr),
+		elem(elem) {}
+
+	template<class Key, class Compare>
+	ConcurrentAVLTree<Key, Compare>::ConcurrentAVLTree(const Compare& comp)
+		: holder(Key(), nullptr, false), comp(comp), retired(nullptr) {}
+
+	template<class Key, class Compare>
+	ConcurrentAVLTree<Key, Compare>::~ConcurrentAVLTree()
+	{
+		clear();
+	}
+
+	template<class Key, class Compare>
+	int ConcurrentAVLTree<Key, Compare>::compare(const Key& key, const NodeType* node) const
+	{
+		return comp(key, node->elem) ? -1 : comp(node->elem, key) ? 1 : 0;
+	}
+
+	template<class Key, class Compare>
+	std::atomic<typename ConcurrentAVLTree<Key, Compare>::NodeType*>&
+	ConcurrentAVLTree<Key, Compare>::side(NodeType* node, bool left)
+	{
+		return left ? node->l : node->r;
+	}
+
+	template<class Key, class Compare>
+	const typename ConcurrentAVLTree<Key, Compare>::NodeType*
+	ConcurrentAVLTree<Key, Compare>::childOf(const NodeType* node, int dir)
+	{
+		return dir < 0 ? node->l.load() : node->r.load();
+	}
+
+	template<class Key, class Compare>
+	int32_t ConcurrentAVLTree<Key, Compare>::height(const NodeType* node)
+	{
+		return node == nullptr ? 0 : node->h.load();
+	}
+
+	template<class Key, class Compare>
+	bool ConcurrentAVLTree<Key, Compare>::canUnlink(const NodeType* node)
+	{
+		return node->l.load() == nullptr || node->r.load() == nullptr;
+	}
+
+	template<class Key, class Compare>
+	void ConcurrentAVLTree<Key, Compare>::waitUntilNotChanging(const NodeType* node)
+	{
+		// Rotations are short, the node lock is held for them anyway
+		uint64_t version = node->version.load();
+		for (int spins = 0; (version & NodeType::Shrinking) && node->version.load() == version; ++spins)
+			if (spins > 64)
+				std::this_thread::yield();
+	}
+
+	template<class Key, class Compare>
+	void ConcurrentAVLTree<Key, Compare>::retire(NodeType* node)
+	{
+		node->retiredNext = retired.load();
+		while (!retired.compare_exchange_weak(node->retiredNext, node));
+	}
+
+	template<class Key, class Compare>
+	void ConcurrentAVLTree<Key, Compare>::destroy(NodeType* node)
+	{
+		if (node == nullptr)
+			return;
+		destroy(node->l.load()), destroy(node->r.load());
+		delete node;
+	}
+
+	template<class Key, class Compare>
+	typename ConcurrentAVLTree<Key, Compare>::Outcome
+	ConcurrentAVLTree<Key, Compare>::attemptFind(const Key& key, const NodeType* node, int dir, uint64_t nodeV) const
+	{
+		while (true)
+		{
+			const NodeType* child = childOf(node, dir);
+			if (node->version.load() != nodeV)
+				return Outcome::Retry;
+			if (child == nullptr)
+				return Outcome::Absent;
+			int next = compare(key, child);
+			if (next == 0)
+				return child->present.load() ? Outcome::Present : Outcome::Absent;
+			uint64_t childV = child->version.load();
+			if (childV & NodeType::Shrinking)
+			{
+				waitUntilNotChanging(child);
+			}
+			else if (!(childV & NodeType::Unlinked) && child == childOf(node, dir))
+			{
+				// child was reached before node changed, so the key is below child if anywhere
+				if (node->version.load() != nodeV)
+					return Outcome::Retry;
+				Outcome found = attemptFind(key, child, next, childV);
+				if (found != Outcome::Retry)
+					return found;
+			}
+		}
+	}
+
+	template<class Key, class Compare>
+	typename ConcurrentAVLTree<Key, Compare>::Outcome
+	ConcurrentAVLTree<Key, Compare>::attemptInsert(const Key& key, NodeType* node, int dir, uint64_t nodeV)
+	{
+		Outcome result = Outcome::Retry;
+		do
+		{
+			NodeType* child = (dir < 0 ? node->l.load() : node->r.load());
+			if (node->version.load() != nodeV)
+				return Outcome::Retry;
+			if (child == nullptr)
+			{
+				result = attemptLink(key, node, dir, nodeV);
+				continue;
+			}
+			int next = compare(key, child);
+			if (next == 0)
+			{
+				result = attemptRevive(child);
+				continue;
+			}
+			uint64_t childV = child->version.load();
+			if (childV & NodeType::Shrinking)
+			{
+				waitUntilNotChanging(child);
+			}
+			else if (!(childV & NodeType::Unlinked) && child == childOf(node, dir))
+			{
+				if (node->version.load() != nodeV)
+					return Outcome::Retry;
+				result = attemptInsert(key, child, next, childV);
+			}
+		} while (result == Outcome::Retry);
+		return result;
+	}
+
+	template<class Key, class Compare>
+	typename ConcurrentAVLTree<Key, Compare>::Outcome
+	ConcurrentAVLTree<Key, Compare>::attemptErase(const Key& key, NodeType* node, int dir, uint64_t nodeV)
+	{
+		Outcome result = Outcome::Retry;
+		do
+		{
+			NodeType* child = (dir < 0 ? node->l.load() : node->r.load());
+			if (node->version.load() != nodeV)
+				return Outcome::Retry;
+			if (child == nullptr)
+				return Outcome::Absent;
+			int next = compare(key, child);
+			if (next == 0)
+			{
+				result = attemptRemove(node, child);
+				continue;
+			}
+			uint64_t childV = child->version.load();
+			if (childV & NodeType::Shrinking)
+			{
+				waitUntilNotChanging(child);
+			}
+			else if (!(childV & NodeType::Unlinked) && child == childOf(node, dir))
+			{
+				if (node->version.load() != nodeV)
+					return Outcome::Retry;
+				result = attemptErase(key, child, next, childV);
+			}
+		} while (result == Outcome::Retry);
+		return result;
+	}
+
+	template<class Key, class Compare>
+	typename ConcurrentAVLTree<Key, Compare>::Outcome
+	ConcurrentAVLTree<Key, Compare>::attemptLink(const Key& key, NodeType* node, int dir, uint64_t nodeV)
+	{
+		NodeType* leaf = new NodeType(key, node);
+		{
+			std::lock_guard<auxillary::SpinLock> guard(node->lock);
+			if (node->version.load() != nodeV || childOf(node, dir) != nullptr)
+			{
+				delete leaf;
+				return Outcome::Retry;
+			}
+			side(node, dir < 0).store(leaf);
+		}
+		fixHeightAndRebalance(node);
+		return Outcome::Absent;
+	}
+
+	template<class Key, class Compare>
+	typename ConcurrentAVLTree<Key, Compare>::Outcome
+	ConcurrentAVLTree<Key, Compare>::attemptRevive(NodeType* node)
+	{
+		std::lock_guard<auxillary::SpinLock> guard(node->lock);
+		if (node->version.load() & NodeType::Unlinked)
+			return Outcome::Retry;
+		return node->present.exchange(true) ? Outcome::Present : Outcome::Absent;
+	}
+
+	template<class Key, class Compare>
+	typename ConcurrentAVLTree<Key, Compare>::Outcome
+	ConcurrentAVLTree<Key, Compare>::attemptRemove(NodeType* parent, NodeType* node)
+	{
+		if (!node->present.load())
+			return Outcome::Absent;
+		if (!canUnlink(node))
+		{
+			// Two children: the node only stops being present and keeps routing lookups
+			std::lock_guard<auxillary::SpinLock> guard(node->lock);
+			if ((node->version.load() & NodeType::Unlinked) || canUnlink(node))
+				return Outcome::Retry;
+			return node->present.exchange(false) ? Outcome::Present : Outcome::Absent;
+		}
+		{
+			std::lock_guard<auxillary::SpinLock> parentGuard(parent->lock);
+			if ((parent->version.load() & NodeType::Unlinked) || node->parent.load() != parent ||
+				(node->version.load() & NodeType::Unlinked))
+				return Outcome::Retry;
+			std::lock_guard<auxillary::SpinLock> guard(node->lock);
+			if (!node->present.load())
+				return Outcome::Absent;
+			if (!canUnlink(node))
+				return Outcome::Retry;
+			NodeType* child = (node->l.load() != nullptr ? node->l.load() : node->r.load());
+			side(parent, parent->l.load() == node).store(child);
+			if (child != nullptr)
+				child->parent.store(parent);
+			node->present.store(false);
+			node->version.store(node->version.load() | NodeType::Unlinked);
+			retire(node);
+		}
+		fixHeightAndRebalance(parent);
+		return Outcome::Present;
+	}
+
+	template<class Key, class Compare>
+	int32_t ConcurrentAVLTree<Key, Compare>::nodeCondition(const NodeType* node)
+	{
+		const NodeType* l = node->l.load(), * r = node->r.load();
+		if ((l == nullptr || r == nullptr) && !node->present.load())
+			return UnlinkRequired;
+		int32_t h = node->h.load(), hl = height(l), hr = height(r), repl = 1 + std::max(hl, hr);
+		if (hl - hr < -1 || hl - hr > 1)
+			return RebalanceRequired;
+		return h != repl ? repl : NothingRequired;
+	}
+
+	template<class Key, class Compare>
+	void ConcurrentAVLTree<Key, Compare>::fixHeightAndRebalance(NodeType* node)
+	{
+		// The holder has no parent, the walk ends below it. Heights change under the locks of the node and
+		// of its parent, which the children take for theirs, so a change is seen by the step above it
+		std::vector<NodeType*> resume;
+		while (true)
+		{
+			if (node == nullptr || node->parent.load() == nullptr || nodeCondition(node) == NothingRequired ||
+				(node->version.load() & NodeType::Unlinked))
+			{
+				if (resume.empty())
+					return;
+				node = resume.back(), resume.pop_back();
+				continue;
+			}
+			NodeType* parent = node->parent.load();
+			std::lock_guard<auxillary::SpinLock> parentGuard(parent->lock);
+			if (!(parent->version.load() & NodeType::Unlinked) && node->parent.load() == parent)
+			{
+				// node may have been unlinked meanwhile, its parent link is left as it was
+				std::lock_guard<auxillary::SpinLock> guard(node->lock);
+				node = (node->version.load() & NodeType::Unlinked) ? nullptr : rebalance(parent, node, resume);
+			}
+		}
+	}
+
+	template<class Key, class Compare>
+	bool ConcurrentAVLTree<Key, Compare>::unlink(NodeType* parent, NodeType* node)
+	{
+		NodeType* parentL = parent->l.load(), * parentR = parent->r.load();
+		if (parentL != node && parentR != node)
+			return false;
+		NodeType* l = node->l.load(), * r = node->r.load();
+		if (l != nullptr && r != nullptr)
+			return false;
+		NodeType* splice = (l != nullptr ? l : r);
+		side(parent, parentL == node).store(splice);
+		if (splice != nullptr)
+			splice->parent.store(parent);
+		node->version.store(node->version.load() | NodeType::Unlinked);
+		retire(node);
+		return true;
+	}
+
+	template<class Key, class Compare>
+	typename ConcurrentAVLTree<Key, Compare>::NodeType*
+	ConcurrentAVLTree<Key, Compare>::rebalance(NodeType* parent, NodeType* node, std::vector<NodeType*>& resume)
+	{
+		NodeType* l = node->l.load(), * r = node->r.load();
+		if ((l == nullptr || r == nullptr) && !node->present.load())
+			return unlink(parent, node) ? parent : node;
+		int32_t h = node->h.load(), hl = height(l), hr = height(r), repl = 1 + std::max(hl, hr);
+		if (hl - hr > 1)
+			return rebalanceToSide(parent, node, l, hr, true, resume);
+		if (hl - hr < -1)
+			return rebalanceToSide(parent, node, r, hl, false, resume);
+		if (repl != h)
+			return node->h.store(repl), parent;
+		return nullptr;
+	}
+
+	template<class Key, class Compare>
+	typename ConcurrentAVLTree<Key, Compare>::NodeType*
+	ConcurrentAVLTree<Key, Compare>::rebalanceToSide(NodeType* parent, NodeType* node, NodeType* heavy,
+													 int32_t hLight, bool left, std::vector<NodeType*>& resume)
+	{
+		std::lock_guard<auxillary::SpinLock> heavyGuard(heavy->lock);
+		if (heavy->h.load() - hLight <= 1)
+			return node;    // changed since, the caller looks again
+		NodeType* inner = side(heavy, !left).load();
+		int32_t hOuter = height(side(heavy, left).load()), hInner = height(inner);
+		if (hOuter >= hInner)
+			return rotate(parent, node, heavy, hLight, hOuter, inner, hInner, left, resume);
+		{
+			std::lock_guard<auxillary::SpinLock> innerGuard(inner->lock);
+			hInner = inner->h.load();
+			if (hOuter >= hInner)
+				return rotate(parent, node, heavy, hLight, hOuter, inner, hInner, left, resume);
+			int32_t hInnerOuter = height(side(inner, left).load()), balance = hOuter - hInnerOuter;
+			if (balance >= -1 && balance <= 1)
+				return rotateDouble(parent, node, heavy, hLight, hOuter, inner, hInnerOuter, left, resume);
+		}
+		// The double rotation would leave heavy unbalanced. Either heavy or, if heavy is balanced, inner is out
+		// of balance itself, and is fixed before node
+		resume.push_back(node);
+		if (hInner - hOuter > 1)
+			return rebalanceToSide(node, heavy, inner, hOuter, !left, resume);
+		return inner;
+	}
+
+	template<class Key, class Compare>
+	typename ConcurrentAVLTree<Key, Compare>::NodeType*
+	ConcurrentAVLTree<Key, Compare>::rotate(NodeType* parent, NodeType* node, NodeType* heavy, int32_t hLight,
+											int32_t hOuter, NodeType* inner, int32_t hInner, bool left,
+											std::vector<NodeType*>& resume)
+	{
+		uint64_t nodeV = node->version.load();
+		bool nodeLeft = (parent->l.load() == node);
+		// Keys of node's side of heavy are not below node from now on, lookups there are sent back
+		node->version.store(nodeV | NodeType::Shrinking);
+		side(node, left).store(inner);
+		if (inner != nullptr)
+			inner->parent.store(node);
+		side(heavy, !left).store(node);
+		node->parent.store(heavy);
+		side(parent, nodeLeft).store(heavy);
+		heavy->parent.store(parent);
+		int32_t repl = 1 + std::max(hInner, hLight);
+		node->h.store(repl);
+		heavy->h.store(1 + std::max(hOuter, repl));
+		node->version.store(nodeV + NodeType::ShrinkCount);
+		// Whatever is still off balance is fixed next, the height of parent after it
+		resume.push_back(parent);
+		if (hInner - hLight < -1 || hInner - hLight > 1)
+			return node;
+		if ((inner == nullptr || hLight == 0) && !node->present.load())
+			return node;
+		if (hOuter - repl < -1 || hOuter - repl > 1)
+			return heavy;
+		if (hOuter == 0 && !heavy->present.load())
+			return heavy;
+		return parent;
+	}
+
+	template<class Key, class Compare>
+	typename ConcurrentAVLTree<Key, Compare>::NodeType*
+	ConcurrentAVLTree<Key, Compare>::rotateDouble(NodeType* parent, NodeType* node, NodeType* heavy, int32_t hLight,
+												  int32_t hOuter, NodeType* inner, int32_t hInnerOuter, bool left,
+												  std::vector<NodeType*>& resume)
+	{
+		uint64_t nodeV = node->version.load(), heavyV = heavy->version.load();
+		bool nodeLeft = (parent->l.load() == node);
+		NodeType* innerOuter = side(inner, left).load(), * innerInner = side(inner, !left).load();
+		int32_t hInnerInner = height(innerInner);
+		node->version.store(nodeV | NodeType::Shrinking);
+		heavy->version.store(heavyV | NodeType::Shrinking);
+		side(node, left).store(innerInner);
+		if (innerInner != nullptr)
+			innerInner->parent.store(node);
+		side(heavy, !left).store(innerOuter);
+		if (innerOuter != nullptr)
+			innerOuter->parent.store(heavy);
+		side(inner, left).store(heavy);
+		heavy->parent.store(inner);
+		side(inner, !left).store(node);
+		node->parent.store(inner);
+		side(parent, nodeLeft).store(inner);
+		inner->parent.store(parent);
+		int32_t replNode = 1 + std::max(hInnerInner, hLight), replHeavy = 1 + std::max(hOuter, hInnerOuter);
+		node->h.store(replNode);
+		heavy->h.store(replHeavy);
+		inner->h.store(1 + std::max(replNode, replHeavy));
+		node->version.store(nodeV + NodeType::ShrinkCount);
+		heavy->version.store(heavyV + NodeType::ShrinkCount);
+		resume.push_back(parent);
+		if (hInnerInner - hLight < -1 || hInnerInner - hLight > 1)
+			return node;
+		if ((innerInner == nullptr || hLight == 0) && !node->present.load())
+			return node;
+		if ((hOuter == 0 || hInnerOuter == 0) && !heavy->present.load())
+			return heavy;
+		if (replHeavy - replNode < -1 || replHeavy - replNode > 1)
+			return inner;
+		return parent;
+	}
+
+	template<class Key, class Compare>
+	bool ConcurrentAVLTree<Key, Compare>::insert(const Key& key)
+	{
+		return attemptInsert(key, &holder, 1, 0) == Outcome::Absent;
+	}
+
+	template<class Key, class Compare>
+	bool ConcurrentAVLTree<Key, Compare>::erase(const Key& key)
+	{
+		return attemptErase(key, &holder, 1, 0) == Outcome::Present;
+	}
+
+	template<class Key, class Compare>
+	bool ConcurrentAVLTree<Key, Compare>::contains(const Key& key) const
+	{
+		return attemptFind(key, &holder, 1, 0) == Outcome::Present;
+	}
+
+	template<class Key, class Compare>
+	void ConcurrentAVLTree<Key, Compare>::insertRandom(size_t n)
+	{
+		// Every block draws its own keys and inserts them directly, without any sorting or merging
+		unsigned seed = (unsigned)std::time(nullptr);
+		auxillary::parallelFor(n, [this, seed](size_t begin, size_t end)
+		{
+			std::mt19937_64 rng(seed + begin);
+			for (size_t i = begin; i < end; )
+				i += insert(Key(rng()));
+		}, 1 << 12);
+	}
+
+	template<class Key, class Compare>
+	void ConcurrentAVLTree<Key, Compare>::clear()
+	{
+		destroy(holder.r.exchange(nullptr));
+		collect();
+	}
+
+	template<class Key, class Compare>
+	void ConcurrentAVLTree<Key, Compare>::collect()
+	{
+		for (NodeType* node = retired.exchange(nullptr), * next; node != nullptr; node = next)
+			next = node->retiredNext, delete node;
+	}
+
+	template<class Key, class Compare>
+	size_t ConcurrentAVLTree<Key, Compare>::size() const
+	{
+		size_t count = 0;
+		std::vector<const NodeType*> stack;
+		if (holder.r.load() != nullptr)
+			stack.push_back(holder.r.load());
+		while (!stack.empty())
+		{
+			const NodeType* node = stack.back();
+			stack.pop_back();
+			count += node->present.load();
+			if (node->l.load() != nullptr)
+				stack.push_back(node->l.load());
+			if (node->r.load() != nullptr)
+				stack.push_back(node->r.load());
+		}
+		return count;
+	}
+
+	template<class Key, class Compare>
+	const typename ConcurrentAVLTree<Key, Compare>::NodeType* ConcurrentAVLTree<Key, Compare>::rootPtr() const
+	{
+		return holder.r.load();
+	}
+	#pragma endregion
+
+	#pragma region Locked tree
+	template<class TreeType>
+	bool LockedTree<TreeType>::insert(const KeyType& key)
+	{
+		std::unique_lock<std::shared_mutex> lock(mutex);
+		return static_cast<bool>(tree.insert(key));
+	}
+
+	template<class TreeType>
+	bool LockedTree<TreeType>::erase(const KeyType& key)
+	{
+		std::unique_lock<std::shared_mutex> lock(mutex);
+		return tree.erase(key);
+	}
+
+	template<class TreeType>
+	bool LockedTree<TreeType>::contains(const KeyType& key) const
+	{
+		std::shared_lock<std::shared_mutex> lock(mutex);
+		return tree.contains(key);
+	}
+
+	template<class TreeType>
+	void LockedTree<TreeType>::insertRandom(size_t n)
+	{
+		std::unique_lock<std::shared_mutex> lock(mutex);
+		tree.insertRandom(n);
+	}
+
+	template<class TreeType>
+	void LockedTree<TreeType>::clear()
+	{
+		std::unique_lock<std::shared_mutex> lock(mutex);
+		tree.clear();
+	}
+
+	template<class TreeType>
+	size_t LockedTree<TreeType>::size() const
+	{
+		std::shared_lock<std::shared_mutex> lock(mutex);
+		return tree.size();
+	}
+	#pragma endregion
+
+	#pragma region Sharded tree
+	template<class TreeType, class Compare>
+	ShardedTree<TreeType, Compare>::ShardedTree(size_t shardCount, const Compare& comp) : comp(comp)
+	{
+		shardCount = std::max<size_t>(shardCount, 1);
+		for (size_t i = 0; i < shardCount; ++i)
+			shards.emplace_back(new Shard());
+		for (const std::unique_ptr<Shard>& shard : shards)
+			shard->worker = std::thread(&ShardedTree::run, this, std::ref(*shard));
+	}
+
+	template<class TreeType, class Compare>
+	ShardedTree<TreeType, Compare>::~ShardedTree()
+	{
+		// Workers apply what is left in their queues before they exit
+		for (const std::unique_ptr<Shard>& shard : shards)
+		{
+			{
+				std::lock_guard<std::mutex> lock(shard->queueMutex);
+				shard->stopping = true;
+			}
+			shard->ready.notify_one();
+		}
+		for (const std::unique_ptr<Shard>& shard : shards)
+			shard->worker.join();
+	}
+
+	template<class TreeType, class Compare>
+	size_t ShardedTree<TreeType, Compare>::route(const KeyType& key) const
+	{
+		return (size_t)(std::upper_bound(bounds.begin(), bounds.end(), key, comp) - bounds.begin());
+	}
+
+	template<class TreeType, class Compare>
+	size_t ShardedTree<TreeType, Compare>::sizeOf(const Shard& shard)
+	{
+		const NodeType* root = shard.tree.rootPtr();
+		return root != nullptr ? (size_t)root->n : 0;
+	}
+
+	template<class TreeType, class Compare>
+	void ShardedTree<TreeType, Compare>::run(Shard& shard)
+	{
+		std::vector<Request> batch;
+		while (true)
+		{
+			{
+				std::unique_lock<std::mutex> lock(shard.queueMutex);
+				shard.ready.wait(lock, [&shard] { return shard.stopping || !shard.queue.empty(); });
+				if (shard.queue.empty())
+					return;
+				batch.swap(shard.queue), shard.queuedInserts = 0;
+			}
+			size_t size;
+			{
+				std::lock_guard<std::mutex> lock(shard.treeMutex);
+				for (const Request& request : batch)
+				{
+					if (request.erase)
+						shard.tree.erase(request.key);
+					else if (shard.tree.insert(request.key) != nullptr && request.added != nullptr)
+						request.added->fetch_add(1, std::memory_order_relaxed);
+				}
+				size = shard.tree.size();
+			}
+			{
+				std::lock_guard<std::mutex> lock(shard.queueMutex);
+				shard.applied += batch.size();
+				shard.estimate.store(size + shard.queuedInserts, std::memory_order_relaxed);
+			}
+			shard.drained.notify_all();
+			batch.clear();
+		}
+	}
+
+	template<class TreeType, class Compare>
+	void ShardedTree<TreeType, Compare>::post(Shard& shard, const Request& request)
+	{
+		{
+			std::lock_guard<std::mutex> lock(shard.queueMutex);
+			shard.queue.push_back(request), ++shard.queued;
+			if (!request.erase)
+				++shard.queuedInserts, shard.estimate.fetch_add(1, std::memory_order_relaxed);
+		}
+		shard.ready.notify_one();
+	}
+
+	template<class TreeType, class Compare>
+	void ShardedTree<TreeType, Compare>::post(Shard& shard, std::vector<Request>& requests)
+	{
+		size_t count = requests.size(), inserts = 0;
+		for (const Request& request : requests)
+			inserts += !request.erase;
+		{
+			std::lock_guard<std::mutex> lock(shard.queueMutex);
+			if (shard.queue.empty())
+				shard.queue.swap(requests);
+			else
+				shard.queue.insert(shard.queue.end(), requests.begin(), requests.end());
+			shard.queued += count, shard.queuedInserts += inserts;
+			shard.estimate.fetch_add(inserts, std::memory_order_relaxed);
+		}
+		shard.ready.notify_one();
+	}
+
+	template<class TreeType, class Compare>
+	void ShardedTree<TreeType, Compare>::wait(Shard& shard) const
+	{
+		std::unique_lock<std::mutex> lock(shard.queueMutex);
+		size_t target = shard.queued;
+		shard.drained.wait(lock, [&shard, target] { return shard.applied >= target; });
+	}
+
+	template<class TreeType, class Compare>
+	bool ShardedTree<TreeType, Compare>::skewed() const
+	{
+		size_t total = 0, largest = 0;
+		for (const std::unique_ptr<Shard>& shard : shards)
+		{
+			size_t n = shard->estimate.load(std::memory_order_relaxed);
+			total += n, largest = std::max(largest, n);
+		}
+		return largest >= MinSkewedSize && (double)largest * (double)shards.size() > SkewFactor * (double)total;
+	}
+
+	template<class TreeType, class Compare>
+	void ShardedTree<TreeType, Compare>::rebalanceIfSkewed()
+	{
+		// The estimates only hint at a skew, the sizes are checked again once the queues are drained
+		if (!skewed())
+			return;
+		std::unique_lock<std::shared_mutex> lock(boundsMutex);
+		for (const std::unique_ptr<Shard>& shard : shards)
+			wait(*shard);
+		if (skewed())
+			evenOut();
+	}
+
+	template<class TreeType, class Compare>
+	void ShardedTree<TreeType, Compare>::evenOut()
+	{
+		// Shards hold ascending ranges, so their keys in order are sorted. Every shard is rebuilt from its new
+		// range, which keeps its own arena: split pieces would share one across the workers
+		std::vector<KeyType> keys;
+		for (const std::unique_ptr<Shard>& shard : shards)
+		{
+			for (const NodeType& node : shard->tree)
+				keys.push_back(node.elem);
+		}
+		if (keys.size() < shards.size())
+			return;
+		std::vector<KeyType> even;
+		for (size_t j = 1; j < shards.size(); ++j)
+			even.push_back(keys[j * keys.size() / shards.size()]);
+		for (size_t j = 0; j < shards.size(); ++j)
+		{
+			size_t lo = j * keys.size() / shards.size(), hi = (j + 1) * keys.size() / shards.size();
+			shards[j]->tree.buildFromSorted(keys.begin() + lo, keys.begin() + hi);
+		}
+		bounds.swap(even);
+		for (const std::unique_ptr<Shard>& shard : shards)
+			shard->estimate.store(shard->tree.size(), std::memory_order_relaxed);
+	}
+
+	template<class TreeType, class Compare>
+	void ShardedTree<TreeType, Compare>::insert(const KeyType& key)
+	{
+		{
+			std::shared_lock<std::shared_mutex> lock(boundsMutex);
+			post(*shards[route(key)], { key, false });
+		}
+		rebalanceIfSkewed();
+	}
+
+	template<class TreeType, class Compare>
+	void ShardedTree<TreeType, Compare>::erase(const KeyType& key)
+	{
+		std::shared_lock<std::shared_mutex> lock(boundsMutex);
+		post(*shards[route(key)], { key, true });
+	}
+
+	template<class TreeType, class Compare>
+	template<class Iterator>
+	void ShardedTree<TreeType, Compare>::postAll(Iterator begin, Iterator end, std::atomic<size_t>* added)
+	{
+		std::shared_lock<std::shared_mutex> lock(boundsMutex);
+		std::vector<std::vector<Request>> routed(shards.size());
+		for (; begin != end; ++begin)
+			routed[route(*begin)].push_back({ *begin, false, added });
+		for (size_t i = 0; i < shards.size(); ++i)
+		{
+			if (!routed[i].empty())
+				post(*shards[i], routed[i]);
+		}
+	}
+
+	template<class TreeType, class Compare>
+	template<class Iterator>
+	void ShardedTree<TreeType, Compare>::insert(Iterator begin, Iterator end)
+	{
+		postAll(begin, end, nullptr);
+		rebalanceIfSkewed();
+	}
+
+	template<class TreeType, class Compare>
+	void ShardedTree<TreeType, Compare>::insertRandom(size_t n)
+	{
+		// Several threads may ingest at once, each with its own generator
+		thread_local std::mt19937 rng(auxillary::threadSeed());
+		std::atomic<size_t> added(0);
+		std::vector<KeyType> keys;
+		while (added.load(std::memory_order_relaxed) < n)
+		{
+			keys.resize(n - added.load(std::memory_order_relaxed));
+			for (KeyType& key : keys)
+				key = (KeyType)rng();
+			std::sort(keys.begin(), keys.end(), comp);
+			keys.erase(std::unique(keys.begin(), keys.end(), [this](const KeyType& a, const KeyType& b)
+			{
+				return !comp(a, b) && !comp(b, a);
+			}), keys.end());
+			postAll(keys.begin(), keys.end(), &added);
+			flush();
+			rebalanceIfSkewed();
+		}
+	}
+
+	template<class TreeType, class Compare>
+	void ShardedTree<TreeType, Compare>::clear()
+	{
+		std::unique_lock<std::shared_mutex> lock(boundsMutex);
+		for (const std::unique_ptr<Shard>& shard : shards)
+		{
+			wait(*shard);
+			shard->tree.clear(), shard->estimate.store(0, std::memory_order_relaxed);
+		}
+	}
+
+	template<class TreeType, class Compare>
+	void ShardedTree<TreeType, Compare>::rebalance()
+	{
+		std::unique_lock<std::shared_mutex> lock(boundsMutex);
+		for (const std::unique_ptr<Shard>& shard : shards)
+			wait(*shard);
+		evenOut();
+	}
+
+	template<class TreeType, class Compare>
+	void ShardedTree<TreeType, Compare>::flush() const
+	{
+		std::shared_lock<std::shared_mutex> lock(boundsMutex);
+		for (const std::unique_ptr<Shard>& shard : shards)
+			wait(*shard);
+	}
+
+	template<class TreeType, class Compare>
+	std::optional<typename ShardedTree<TreeType, Compare>::KeyType> ShardedTree<TreeType, Compare>::find(
+		const KeyType& key
+	) const
+	{
+		std::shared_lock<std::shared_mutex> lock(boundsMutex);
+		Shard& shard = *shards[route(key)];
+		wait(shard);
+		std::lock_guard<std::mutex> treeLock(shard.treeMutex);
+		auto it = shard.tree.find(key);
+		return it != shard.tree.end() ? std::optional<KeyType>(it->elem) : std::nullopt;
+	}
+
+	template<class TreeType, class Compare>
+	bool ShardedTree<TreeType, Compare>::contains(const KeyType& key) const
+	{
+		std::shared_lock<std::shared_mutex> lock(boundsMutex);
+		Shard& shard = *shards[route(key)];
+		wait(shard);
+		std::lock_guard<std::mutex> treeLock(shard.treeMutex);
+		return shard.tree.contains(key);
+	}
+
+	template<class TreeType, class Compare>
+	size_t ShardedTree<TreeType, Compare>::size() const
+	{
+		std::shared_lock<std::shared_mutex> lock(boundsMutex);
+		size_t total = 0;
+		for (const std::unique_ptr<Shard>& shard : shards)
+		{
+			wait(*shard);
+			std::lock_guard<std::mutex> treeLock(shard->treeMutex);
+			total += sizeOf(*shard);
+		}
+		return total;
+	}
+
+	template<class TreeType, class Compare>
+	std::optional<typename ShardedTree<TreeType, Compare>::KeyType> ShardedTree<TreeType, Compare>::select(size_t k) const
+	{
+		std::shared_lock<std::shared_mutex> lock(boundsMutex);
+		for (const std::unique_ptr<Shard>& shard : shards)
+		{
+			wait(*shard);
+			std::lock_guard<std::mutex> treeLock(shard->treeMutex);
+			size_t n = sizeOf(*shard);
+			if (k < n)
+				return shard->tree.select(k)->elem;
+			k -= n;
+		}
+		return std::nullopt;
+	}
+
+	template<class TreeType, class Compare>
+	size_t ShardedTree<TreeType, Compare>::rank(const KeyType& key) const
+	{
+		std::shared_lock<std::shared_mutex> lock(boundsMutex);
+		size_t owner = route(key), r = 0;
+		for (size_t i = 0; i <= owner; ++i)
+		{
+			wait(*shards[i]);
+			std::lock_guard<std::mutex> treeLock(shards[i]->treeMutex);
+			r += (i < owner ? sizeOf(*shards[i]) : shards[i]->tree.rank(key));
+		}
+		return r;
+	}
+
+	template<class TreeType, class Compare>
+	size_t ShardedTree<TreeType, Compare>::countInRange(const KeyType& lo, const KeyType& hi) const
+	{
+		if (comp(hi, lo))
+			return 0;
+		std::shared_lock<std::shared_mutex> lock(boundsMutex);
+		size_t first = route(lo), last = route(hi), count = 0;
+		for (size_t i = first; i <= last; ++i)
+		{
+			wait(*shards[i]);
+			std::lock_guard<std::mutex> treeLock(shards[i]->treeMutex);
+			count += (i == first || i == last ? shards[i]->tree.countInRange(lo, hi) : sizeOf(*shards[i]));
+		}
+		return count;
+	}
+
+	template<class TreeType, class Compare>
+	TreeStatistics ShardedTree<TreeType, Compare>::statistics(size_t shard) const
+	{
+		std::shared_lock<std::shared_mutex> lock(boundsMutex);
+		size_t i = std::min(shard, shards.size() - 1);
+		Shard& s = *shards[i];
+		wait(s);
+		std::lock_guard<std::mutex> treeLock(s.treeMutex);
+		TreeStatistics stats = s.tree.statistics();
+		for (const NodeType& node : s.tree)
+			stats.valid = stats.valid && route(node.elem) == i;
+		return stats;
+	}
+
+	template<class TreeType, class Compare>
+	size_t ShardedTree<TreeType, Compare>::shardCount() const
+	{
+		return shards.size();
+	}
+
+	template<class TreeType, class Compare>
+	template<class F>
+	void ShardedTree<TreeType, Compare>::visit(size_t shard, F&& f) const
+	{
+		std::shared_lock<std::shared_mutex> lock(boundsMutex);
+		Shard& s = *shards[std::min(shard, shards.size() - 1)];
+		wait(s);
+		std::lock_guard<std::mutex> treeLock(s.treeMutex);
+		f(static_cast<const TreeType&>(s.tree));
+	}
+	#pragma endregion
+}